@@ -0,0 +1,106 @@
+/*
+ * admit.c - admission control for the proxy's request children
+ *
+ * admit_start runs with SIGCHLD blocked and admit_exit from the SIGCHLD
+ * handler, so the child table and the in-flight counts are only ever
+ * changed by one of them at a time.
+ */
+
+#include "csapp.h"
+#include "admit.h"
+
+#define DECREASE 0.9            /* limit kept after a slow response */
+
+void admit_init(admit_t *a, int maxInFlight, int originMax, int targetMs)
+{
+	memset(a, 0, sizeof(*a));
+	a->maxInFlight = maxInFlight;
+	a->originMax = originMax;
+	a->targetMs = targetMs;
+	a->limit = maxInFlight;
+	a->children = Calloc(maxInFlight, sizeof(struct admitChild));
+}
+
+/* admit_origin - the bucket hostname:port is counted in (FNV-1a of both) */
+int admit_origin(const char *hostname, int port)
+{
+	uint32_t h = 2166136261u;
+
+	for (; *hostname; hostname++)
+		h = (h ^ (unsigned char)tolower((unsigned char)*hostname)) * 16777619u;
+	h = (h ^ (port & 0xff)) * 16777619u;
+	h = (h ^ ((port >> 8) & 0xff)) * 16777619u;
+	return h % ADMIT_BUCKETS;
+}
+
+/*
+ * admit_check - whether another child may start, fetching from origin
+ * (-1 if it will not contact one).  Returns 0, or -1 if the request has
+ * to be shed, which is counted.
+ */
+int admit_check(admit_t *a, int origin)
+{
+	if (a->inFlight >= (int)a->limit ||
+	    (origin >= 0 && a->originMax > 0 && a->originLoad[origin] >= a->originMax)) {
+		a->shed++;
+		return -1;
+	}
+	return 0;
+}
+
+/* admit_start - count child pid, which admit_check let in, as running */
+void admit_start(admit_t *a, pid_t pid, int origin)
+{
+	int i;
+
+	for (i = 0; i < a->maxInFlight && a->children[i].pid != 0; i++)
+		;
+	if (i == a->maxInFlight)  //cannot happen while every start was checked first
+		return;
+	a->children[i].pid = pid;
+	a->children[i].origin = origin;
+	a->inFlight++;
+	if (origin >= 0)
+		a->originLoad[origin]++;
+	a->admitted++;
+}
+
+/* admit_exit - a child has been reaped, async-signal-safe */
+void admit_exit(admit_t *a, pid_t pid)
+{
+	int i;
+
+	for (i = 0; i < a->maxInFlight; i++) {
+		if (a->children[i].pid == pid) {
+			if (a->children[i].origin >= 0)
+				a->originLoad[a->children[i].origin]--;
+			a->children[i].pid = 0;
+			a->inFlight--;
+			return;
+		}
+	}
+}
+
+/*
+ * admit_sample - adjust the limit for a response whose first byte took
+ * latencyMs.  The limit only grows while it is being used, so a quiet
+ * proxy does not build up a limit it has never tried.
+ */
+void admit_sample(admit_t *a, unsigned latencyMs, uint64_t now)
+{
+	if (a->targetMs <= 0)
+		return;
+	if (latencyMs > (unsigned)a->targetMs) {
+		if (now - a->lastDecrease >= (uint64_t)a->targetMs) {
+			a->limit *= DECREASE;
+			if (a->limit < 1)
+				a->limit = 1;
+			a->lastDecrease = now;
+		}
+	}
+	else if (a->inFlight * 2 >= (int)a->limit) {
+		a->limit += 1 / a->limit;
+		if (a->limit > a->maxInFlight)
+			a->limit = a->maxInFlight;
+	}
+}
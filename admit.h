@@ -0,0 +1,47 @@
+/*
+ * admit.h - admission control for the proxy's request children
+ *
+ * Every request is served by a child, and a child is only forked while
+ * the number running is under the limit.  The limit adapts to the
+ * latency origin servers are seen to have (AIMD): each response that
+ * starts within the target nudges it up by 1/limit, and one slower than
+ * the target cuts it by a tenth, at most once per target interval, so
+ * the proxy backs off as soon as its origins (or the machine) slow down
+ * instead of forking until it runs out of processes.  Children fetching
+ * from the same origin are also capped, so one slow origin cannot hold
+ * every slot.  Origins, a host name and port, are counted in buckets by
+ * their hash.
+ */
+#ifndef __ADMIT_H__
+#define __ADMIT_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ADMIT_BUCKETS 4096      /* origin buckets, hosts sharing one share its cap */
+
+struct admitChild {
+	pid_t pid;                  //0 while the entry is free
+	int origin;                 //bucket of the origin it fetches from, -1 for none
+};
+
+typedef struct {
+	int maxInFlight;            //hard limit on children
+	int originMax;              //children per origin bucket, 0 for no cap
+	int targetMs;               //origin latency target, 0 keeps the limit at maxInFlight
+	double limit;               //adaptive limit, 1 to maxInFlight
+	uint64_t lastDecrease;      //ioloop_time() of the last cut
+	volatile int inFlight;      //children running
+	int originLoad[ADMIT_BUCKETS];
+	struct admitChild *children;  //maxInFlight entries
+	unsigned long admitted, shed;
+} admit_t;
+
+void admit_init(admit_t *a, int maxInFlight, int originMax, int targetMs);
+int admit_origin(const char *hostname, int port);
+int admit_check(admit_t *a, int origin);
+void admit_start(admit_t *a, pid_t pid, int origin);
+void admit_exit(admit_t *a, pid_t pid);
+void admit_sample(admit_t *a, unsigned latencyMs, uint64_t now);
+
+#endif /* __ADMIT_H__ */
@@ -0,0 +1,109 @@
+/*
+ * bufpool.c - pooled fixed-size buffers and per-connection arenas
+ */
+
+#include "csapp.h"
+#include "bufpool.h"
+
+#define BUF_ALIGN 8
+
+void bufpool_init(bufpool_t *p, size_t chunkSize, size_t perSlab)
+{
+	memset(p, 0, sizeof(*p));
+	p->chunkSize = chunkSize;
+	p->perSlab = perSlab > 0 ? perSlab : 1;
+}
+
+/* grow - carve another slab into free chunks, -1 if it cannot be allocated */
+static int grow(bufpool_t *p)
+{
+	size_t stride = (sizeof(struct bufChunk) + p->chunkSize + BUF_ALIGN - 1) & ~(size_t)(BUF_ALIGN - 1);
+	char *slab = malloc(stride * p->perSlab);
+	struct bufChunk *c;
+	size_t i;
+
+	if (slab == NULL)
+		return -1;
+	for (i = 0; i < p->perSlab; i++) {
+		c = (struct bufChunk *)(slab + i * stride);
+		c->pool = p;
+		c->next = p->free;
+		p->free = c;
+	}
+	p->nfree += p->perSlab;
+	p->total += p->perSlab;
+	return 0;
+}
+
+/* bufpool_get - an empty chunk holding one reference, NULL if out of memory */
+struct bufChunk *bufpool_get(bufpool_t *p)
+{
+	struct bufChunk *c;
+
+	if (p->free == NULL && grow(p) < 0)
+		return NULL;
+	c = p->free;
+	p->free = c->next;
+	p->nfree--;
+	c->next = NULL;
+	c->refs = 1;
+	c->len = 0;
+	return c;
+}
+
+void bufchunk_ref(struct bufChunk *c)
+{
+	c->refs++;
+}
+
+/* bufchunk_put - drop a reference, the last one returns the chunk to its pool */
+void bufchunk_put(struct bufChunk *c)
+{
+	bufpool_t *p = c->pool;
+
+	if (--c->refs > 0)
+		return;
+	c->next = p->free;
+	p->free = c;
+	p->nfree++;
+}
+
+void arena_init(arena_t *a, bufpool_t *pool)
+{
+	a->pool = pool;
+	a->chunks = NULL;
+}
+
+/*
+ * arena_alloc - n bytes that live until arena_reset.  Returns NULL if n
+ * is larger than a chunk or the pool is out of memory.
+ */
+void *arena_alloc(arena_t *a, size_t n)
+{
+	struct bufChunk *c = a->chunks;
+	size_t at;
+
+	if (n > a->pool->chunkSize)
+		return NULL;
+	at = c ? (c->len + BUF_ALIGN - 1) & ~(size_t)(BUF_ALIGN - 1) : 0;
+	if (c == NULL || at + n > a->pool->chunkSize) {
+		if ((c = bufpool_get(a->pool)) == NULL)
+			return NULL;
+		c->next = a->chunks;
+		a->chunks = c;
+		at = 0;
+	}
+	c->len = at + n;
+	return c->data + at;
+}
+
+/* arena_reset - give every chunk back to the pool */
+void arena_reset(arena_t *a)
+{
+	struct bufChunk *c;
+
+	while ((c = a->chunks) != NULL) {
+		a->chunks = c->next;
+		bufchunk_put(c);
+	}
+}
@@ -0,0 +1,48 @@
+/*
+ * bufpool.h - pooled fixed-size buffers and per-connection arenas
+ *
+ * A pool hands out reference-counted chunks of one size, carved from
+ * slabs it allocates a batch at a time and never gives back, so once a
+ * process has warmed up, getting and releasing a buffer is a free list
+ * pop and push.  An arena bump-allocates small objects, such as the
+ * parsed pieces of a request, out of chunks from a pool and returns
+ * them all at once when its connection is done.
+ */
+#ifndef __BUFPOOL_H__
+#define __BUFPOOL_H__
+
+#include <stddef.h>
+
+struct bufPool;
+
+struct bufChunk {
+	struct bufChunk *next;           //free list, or the arena's chunks
+	struct bufPool *pool;
+	int refs;
+	size_t len;                      //bytes of data in use
+	char data[];
+};
+
+typedef struct bufPool {
+	size_t chunkSize;                //bytes of data per chunk
+	size_t perSlab;                  //chunks carved from each slab
+	struct bufChunk *free;
+	size_t nfree;
+	size_t total;                    //chunks carved in all
+} bufpool_t;
+
+typedef struct {
+	bufpool_t *pool;
+	struct bufChunk *chunks;         //newest first, allocating from its free tail
+} arena_t;
+
+void bufpool_init(bufpool_t *p, size_t chunkSize, size_t perSlab);
+struct bufChunk *bufpool_get(bufpool_t *p);
+void bufchunk_ref(struct bufChunk *c);
+void bufchunk_put(struct bufChunk *c);
+
+void arena_init(arena_t *a, bufpool_t *pool);
+void *arena_alloc(arena_t *a, size_t n);
+void arena_reset(arena_t *a);
+
+#endif /* __BUFPOOL_H__ */
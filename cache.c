@@ -0,0 +1,272 @@
+/*
+ * cache.c - page cache index and eviction policies
+ *
+ * Entries live in a fixed table of maxEntries slots so the proxy can
+ * name each cached file after its slot.  Lookups go through a chained
+ * hash table and eviction order is kept on a doubly linked list whose
+ * head is always the next victim:
+ *     FIFO  - entries are appended on insert and never moved
+ *     LRU   - entries are moved to the tail on every hit
+ *     CLOCK - hits only set a reference bit; a referenced head is given
+ *             a second chance by clearing the bit and moving it to the tail
+ * Every operation is O(1) apart from CLOCK skipping referenced entries.
+ */
+
+#include "csapp.h"
+#include "cache.h"
+
+static const char *policyNames[CACHE_NPOLICIES] = { "fifo", "lru", "clock" };
+
+/* list_unlink - remove e from the eviction list */
+static void list_unlink(cache_t *c, cache_entry_t *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		c->head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		c->tail = e->prev;
+	e->prev = e->next = NULL;
+}
+
+/* list_append - add e to the tail of the eviction list */
+static void list_append(cache_t *c, cache_entry_t *e)
+{
+	e->next = NULL;
+	e->prev = c->tail;
+	if (c->tail)
+		c->tail->next = e;
+	else
+		c->head = e;
+	c->tail = e;
+}
+
+/* pick_victim - return the entry the policy wants to drop next, never skip */
+static cache_entry_t *pick_victim(cache_t *c, cache_entry_t *skip)
+{
+	cache_entry_t *e;
+	size_t scanned = 0;
+
+	if (c->policy == CACHE_CLOCK) {
+		//give referenced entries a second chance, at most one full sweep
+		while ((e = c->head) != NULL && scanned++ < c->count) {
+			if (!e->referenced && e != skip)
+				return e;
+			e->referenced = 0;
+			if (e == c->tail)
+				break;
+			list_unlink(c, e);
+			list_append(c, e);
+		}
+	}
+	for (e = c->head; e != NULL; e = e->next) {
+		if (e != skip)
+			return e;
+	}
+	return NULL;
+}
+
+/* make_room - evict until size more bytes and one more entry fit, keeping skip */
+static int make_room(cache_t *c, size_t size, int needSlot, cache_entry_t *skip)
+{
+	cache_entry_t *victim;
+
+	while ((needSlot && c->nfree == 0) ||
+	       (c->maxBytes && c->bytes + size > c->maxBytes)) {
+		if ((victim = pick_victim(c, skip)) == NULL)
+			return -1;
+		cache_remove(c, victim);
+	}
+	return 0;
+}
+
+/*
+ * cache_init - create an empty index with maxEntries slots and a budget
+ * of maxBytes (0 means the budget is only limited by the slot count)
+ */
+void cache_init(cache_t *c, int policy, size_t maxEntries, size_t maxBytes)
+{
+	size_t i;
+
+	memset(c, 0, sizeof(*c));
+	c->policy = policy;
+	c->maxEntries = maxEntries;
+	c->maxBytes = maxBytes;
+	c->entries = Calloc(maxEntries, sizeof(cache_entry_t));
+	c->freeSlots = Malloc(maxEntries * sizeof(int));
+	for (i = 0; i < maxEntries; i++) {
+		c->entries[i].slot = i;
+		c->freeSlots[i] = maxEntries - 1 - i;  //hand out slot 0 first
+	}
+	c->nfree = maxEntries;
+	for (c->nbuckets = 16; c->nbuckets < maxEntries; c->nbuckets <<= 1)
+		;
+	c->buckets = Calloc(c->nbuckets, sizeof(cache_entry_t *));
+}
+
+/* cache_destroy - release the index without calling the evict hook */
+void cache_destroy(cache_t *c)
+{
+	size_t i;
+
+	for (i = 0; i < c->maxEntries; i++) {
+		if (c->entries[i].inuse)
+			Free(c->entries[i].key);
+	}
+	Free(c->entries);
+	Free(c->freeSlots);
+	Free(c->buckets);
+	memset(c, 0, sizeof(*c));
+}
+
+/* cache_set_evict - register a hook that runs before an entry is dropped */
+void cache_set_evict(cache_t *c, cache_evict_t *evict, void *arg)
+{
+	c->evict = evict;
+	c->evictArg = arg;
+}
+
+/* cache_hash - 64-bit FNV-1a hash of a key */
+uint64_t cache_hash(const char *key, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)key[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/*
+ * cache_makekey - build the lookup key for a page from its host and path.
+ * Returns the key length, or -1 if it does not fit in size bytes.
+ */
+int cache_makekey(char *key, size_t size, const char *hostname, const char *pathname)
+{
+	int len = snprintf(key, size, "%s/%s", hostname, pathname);
+
+	return (len < 0 || (size_t)len >= size) ? -1 : len;
+}
+
+/* cache_policy_byname - map "fifo", "lru" or "clock" to a policy, -1 if unknown */
+int cache_policy_byname(const char *name)
+{
+	int i;
+
+	for (i = 0; i < CACHE_NPOLICIES; i++) {
+		if (strcasecmp(name, policyNames[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/* cache_policy_name - printable name of a policy */
+const char *cache_policy_name(int policy)
+{
+	return (policy >= 0 && policy < CACHE_NPOLICIES) ? policyNames[policy] : "?";
+}
+
+/* cache_lookup - find a key and record the hit with the eviction policy */
+cache_entry_t *cache_lookup(cache_t *c, const char *key, size_t len, uint64_t hash)
+{
+	cache_entry_t *e;
+
+	for (e = c->buckets[hash & (c->nbuckets - 1)]; e != NULL; e = e->hnext) {
+		if (e->hash == hash && e->keylen == len && memcmp(e->key, key, len) == 0)
+			break;
+	}
+	if (e != NULL)
+		cache_touch(c, e);
+	return e;
+}
+
+/* cache_touch - record a hit on an entry found without cache_lookup */
+void cache_touch(cache_t *c, cache_entry_t *e)
+{
+	if (c->policy == CACHE_LRU) {
+		list_unlink(c, e);
+		list_append(c, e);
+	}
+	else if (c->policy == CACHE_CLOCK) {
+		e->referenced = 1;
+	}
+}
+
+/*
+ * cache_insert - add a key that was just looked up and missed, evicting
+ * as the policy dictates.  Returns NULL if the object can never fit.
+ */
+cache_entry_t *cache_insert(cache_t *c, const char *key, size_t len, uint64_t hash, size_t size)
+{
+	cache_entry_t *e;
+	size_t b;
+
+	if (c->maxEntries == 0 || (c->maxBytes && size > c->maxBytes))
+		return NULL;
+	if (make_room(c, size, 1, NULL) < 0)
+		return NULL;
+
+	e = &c->entries[c->freeSlots[--c->nfree]];
+	e->key = Malloc(len + 1);
+	memcpy(e->key, key, len);
+	e->key[len] = '\0';
+	e->keylen = len;
+	e->hash = hash;
+	e->size = size;
+	e->referenced = 0;
+	e->inuse = 1;
+
+	b = hash & (c->nbuckets - 1);
+	e->hnext = c->buckets[b];
+	c->buckets[b] = e;
+	list_append(c, e);
+
+	c->count++;
+	c->bytes += size;
+	return e;
+}
+
+/*
+ * cache_resize - change the bytes charged for e once its real size is
+ * known, evicting other entries if the budget is exceeded
+ */
+void cache_resize(cache_t *c, cache_entry_t *e, size_t size)
+{
+	if (c->maxBytes && size > c->maxBytes) {
+		cache_remove(c, e);
+		return;
+	}
+	c->bytes -= e->size;
+	e->size = 0;
+	make_room(c, size, 0, e);
+	e->size = size;
+	c->bytes += size;
+}
+
+/* cache_remove - drop e from the index and return its slot */
+void cache_remove(cache_t *c, cache_entry_t *e)
+{
+	cache_entry_t **pp;
+
+	if (!e->inuse)
+		return;
+	if (c->evict)
+		c->evict(e, c->evictArg);
+
+	for (pp = &c->buckets[e->hash & (c->nbuckets - 1)]; *pp != e; pp = &(*pp)->hnext)
+		;
+	*pp = e->hnext;
+	list_unlink(c, e);
+
+	c->count--;
+	c->bytes -= e->size;
+	Free(e->key);
+	e->key = NULL;
+	e->hnext = NULL;
+	e->inuse = 0;
+	c->freeSlots[c->nfree++] = e->slot;
+}
@@ -0,0 +1,64 @@
+/*
+ * cache.h - page cache index and eviction policies
+ *
+ * The same index is used by the proxy to track its cached pages and by
+ * cachesim to replay traces, so a simulated policy behaves exactly like
+ * the one running in production.
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Eviction policies */
+#define CACHE_FIFO  0   /* evict in insertion order (the old fileCount ring) */
+#define CACHE_LRU   1   /* evict the least recently used entry */
+#define CACHE_CLOCK 2   /* second chance: skip entries hit since the last sweep */
+#define CACHE_NPOLICIES 3
+
+typedef struct cache_entry {
+	char *key;                       //lookup key, owned by the cache
+	size_t keylen;                   //length of key in bytes
+	uint64_t hash;                   //hash of key
+	size_t size;                     //bytes charged against the byte budget
+	int slot;                        //position in the entry table, names the cached file
+	int referenced;                  //CLOCK reference bit
+	int inuse;                       //nonzero while the slot holds an entry
+	struct cache_entry *hnext;       //next entry in the same hash bucket
+	struct cache_entry *prev, *next; //eviction order, head is the next victim
+} cache_entry_t;
+
+typedef void cache_evict_t(cache_entry_t *e, void *arg);
+
+typedef struct {
+	int policy;                      //one of CACHE_FIFO, CACHE_LRU, CACHE_CLOCK
+	size_t maxEntries;               //number of slots in the entry table
+	size_t maxBytes;                 //byte budget, 0 for no limit
+	size_t count;                    //entries currently cached
+	size_t bytes;                    //bytes currently cached
+	cache_entry_t *entries;          //entry table, one per slot
+	int *freeSlots;                  //stack of unused slots
+	size_t nfree;                    //number of unused slots on the stack
+	cache_entry_t **buckets;         //hash table
+	size_t nbuckets;                 //power of two
+	cache_entry_t *head, *tail;      //eviction order
+	cache_evict_t *evict;            //called before an entry is dropped
+	void *evictArg;                  //passed through to evict
+} cache_t;
+
+void cache_init(cache_t *c, int policy, size_t maxEntries, size_t maxBytes);
+void cache_destroy(cache_t *c);
+void cache_set_evict(cache_t *c, cache_evict_t *evict, void *arg);
+uint64_t cache_hash(const char *key, size_t len);
+int cache_makekey(char *key, size_t size, const char *hostname, const char *pathname);
+int cache_policy_byname(const char *name);
+const char *cache_policy_name(int policy);
+
+cache_entry_t *cache_lookup(cache_t *c, const char *key, size_t len, uint64_t hash);
+void cache_touch(cache_t *c, cache_entry_t *e);
+cache_entry_t *cache_insert(cache_t *c, const char *key, size_t len, uint64_t hash, size_t size);
+void cache_resize(cache_t *c, cache_entry_t *e, size_t size);
+void cache_remove(cache_t *c, cache_entry_t *e);
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,314 @@
+/*
+ * cachesim.c - trace-driven simulator for the proxy's page cache
+ *
+ * Replays a request trace against the cache index in cache.c, the same
+ * code the proxy uses, for every combination of cache size and eviction
+ * policy asked for, and reports hit ratio, byte hit ratio and the bytes
+ * (and bandwidth) that would have been fetched from origin servers.
+ *
+ * A trace is either a proxy.log written by format_log_entry or a binary
+ * file of struct traceRecord, which can be produced from a log with -o.
+ * Binary traces skip all text parsing and replay fastest.
+ */
+
+#define _GNU_SOURCE  /* strptime */
+#include "csapp.h"
+#include "cache.h"
+#include "config.h"
+#include "http.h"
+
+/* One request in a binary trace, all fields in host byte order */
+struct traceRecord {
+	uint64_t hash;      //cache_hash of the page's cache key
+	uint32_t size;      //bytes sent to the client
+	uint32_t time;      //seconds since the epoch, 0 if unknown
+};
+
+/* One request after loading, keys are interned into keys[] */
+struct request {
+	uint32_t key;
+	uint32_t size;
+};
+
+struct key {
+	char *name;         //cache key, or the raw 8 byte hash for binary traces
+	size_t len;
+	uint64_t hash;
+	uint32_t next;      //next key in the same intern bucket, UINT32_MAX ends the chain
+};
+
+static struct request *requests;
+static size_t nrequests, maxrequests;
+static struct key *keys;
+static size_t nkeys, maxkeys;
+static uint32_t *internBuckets;
+static size_t ninternBuckets;
+static time_t firstTime, lastTime;
+static struct traceRecord *records;  //binary copy of the trace for -o
+
+/* usage - print the command line summary and exit */
+static void usage(char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-b] [-p policies] [-s sizes] [-n entries] [-o outfile] trace\n"
+		"  -b           trace is binary (struct traceRecord) instead of a proxy.log\n"
+		"  -p policies  comma separated list of fifo, lru, clock (default: all)\n"
+		"  -s sizes     comma separated cache sizes with K/M/G suffixes\n"
+		"               (default: 1M to 1G, doubling)\n"
+		"  -n entries   entry limit per cache, like cache_entries (default: none)\n"
+		"  -o outfile   write the trace as a binary trace to outfile and exit\n",
+		prog);
+	exit(1);
+}
+
+/* intern_grow - double the intern hash table and rehash every key */
+static void intern_grow(void)
+{
+	size_t i, b;
+
+	ninternBuckets = ninternBuckets ? 2 * ninternBuckets : 1024;
+	internBuckets = Realloc(internBuckets, ninternBuckets * sizeof(uint32_t));
+	memset(internBuckets, 0xff, ninternBuckets * sizeof(uint32_t));
+	for (i = 0; i < nkeys; i++) {
+		b = keys[i].hash & (ninternBuckets - 1);
+		keys[i].next = internBuckets[b];
+		internBuckets[b] = i;
+	}
+}
+
+/* intern - return the index of key, adding it on first sight */
+static uint32_t intern(const char *name, size_t len, uint64_t hash)
+{
+	uint32_t i;
+	size_t b;
+
+	if (nkeys >= ninternBuckets / 2)
+		intern_grow();
+	b = hash & (ninternBuckets - 1);
+	for (i = internBuckets[b]; i != UINT32_MAX; i = keys[i].next) {
+		if (keys[i].hash == hash && keys[i].len == len && memcmp(keys[i].name, name, len) == 0)
+			return i;
+	}
+
+	if (nkeys == maxkeys) {
+		maxkeys = maxkeys ? 2 * maxkeys : 4096;
+		keys = Realloc(keys, maxkeys * sizeof(struct key));
+	}
+	keys[nkeys].name = Malloc(len);
+	memcpy(keys[nkeys].name, name, len);
+	keys[nkeys].len = len;
+	keys[nkeys].hash = hash;
+	keys[nkeys].next = internBuckets[b];
+	internBuckets[b] = nkeys;
+	return nkeys++;
+}
+
+/* add_request - append one request to the in-memory trace */
+static void add_request(const char *name, size_t len, uint64_t hash, uint32_t size, time_t when)
+{
+	if (nrequests == maxrequests) {
+		maxrequests = maxrequests ? 2 * maxrequests : 65536;
+		requests = Realloc(requests, maxrequests * sizeof(struct request));
+		records = Realloc(records, maxrequests * sizeof(struct traceRecord));
+	}
+	requests[nrequests].key = intern(name, len, hash);
+	requests[nrequests].size = size;
+	records[nrequests].hash = hash;
+	records[nrequests].size = size;
+	records[nrequests].time = when;
+	nrequests++;
+
+	if (when) {
+		if (!firstTime || when < firstTime)
+			firstTime = when;
+		if (when > lastTime)
+			lastTime = when;
+	}
+}
+
+/*
+ * load_log - read a proxy.log.  Each line is
+ *     <time>: <a.b.c.d> <uri> <size> [status...]
+ * where <time> itself contains colons but never ": ".  Requests that
+ * sent nothing (origin not found) and non-http URIs are skipped.
+ */
+static void load_log(const char *filename)
+{
+	FILE *fp = Fopen(filename, "r");
+	char line[3 * MAXLINE], ip[64], uri[MAXLINE];
+	char hostname[MAXLINE], pathname[MAXLINE], key[2 * MAXLINE];
+	unsigned long size;
+	int port, keylen;
+	char *rest;
+	struct tm tm;
+	time_t when;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if ((rest = strstr(line, ": ")) == NULL)
+			continue;
+		*rest = '\0';
+		if (sscanf(rest + 2, "%63s %8191s %lu", ip, uri, &size) != 3 || size == 0)
+			continue;
+		if (parse_uri(uri, hostname, pathname, &port) < 0)
+			continue;
+		if ((keylen = cache_makekey(key, sizeof(key), hostname, pathname)) < 0)
+			continue;
+
+		memset(&tm, 0, sizeof(tm));
+		tm.tm_isdst = -1;
+		when = strptime(line, "%a %d %b %Y %H:%M:%S", &tm) ? mktime(&tm) : 0;
+		add_request(key, keylen, cache_hash(key, keylen), size, when > 0 ? when : 0);
+	}
+	Fclose(fp);
+}
+
+/* load_binary - read a binary trace of struct traceRecord */
+static void load_binary(const char *filename)
+{
+	FILE *fp = Fopen(filename, "rb");
+	struct traceRecord r[4096];
+	size_t i, n;
+
+	while ((n = fread(r, sizeof(r[0]), 4096, fp)) > 0) {
+		for (i = 0; i < n; i++)
+			add_request((char *)&r[i].hash, sizeof(r[i].hash), r[i].hash, r[i].size, r[i].time);
+	}
+	Fclose(fp);
+}
+
+/* parse_list - split a comma separated list in place, returns the item count */
+static int parse_list(char *s, char **items, int max)
+{
+	int n = 0;
+	char *tok;
+
+	for (tok = strtok(s, ","); tok != NULL && n < max; tok = strtok(NULL, ","))
+		items[n++] = tok;
+	return n;
+}
+
+/* print_bytes - format a byte count with a binary suffix */
+static char *print_bytes(char *out, double bytes)
+{
+	const char *units = "BKMGT";
+	int u = 0;
+
+	while (bytes >= 1024 && units[u + 1]) {
+		bytes /= 1024;
+		u++;
+	}
+	sprintf(out, u ? "%.1f%c" : "%.0f%c", bytes, units[u]);
+	return out;
+}
+
+/* simulate - replay the trace against one cache and print a result row */
+static void simulate(int policy, size_t bytes, size_t entries)
+{
+	cache_t c;
+	cache_entry_t *e;
+	struct request *r;
+	struct key *k;
+	size_t i, hits = 0;
+	double hitBytes = 0, totalBytes = 0, elapsed;
+	struct timeval start, end;
+	char sizeStr[32], originStr[32], rateStr[32];
+
+	cache_init(&c, policy, entries, bytes);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nrequests; i++) {
+		r = &requests[i];
+		k = &keys[r->key];
+		totalBytes += r->size;
+		if ((e = cache_lookup(&c, k->name, k->len, k->hash)) != NULL) {
+			hits++;
+			hitBytes += r->size;
+			if (e->size != r->size)  //object changed, recharge like the proxy does
+				cache_resize(&c, e, r->size);
+		}
+		else {
+			cache_insert(&c, k->name, k->len, k->hash, r->size);
+		}
+	}
+	gettimeofday(&end, NULL);
+	cache_destroy(&c);
+
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+	if (lastTime > firstTime)
+		sprintf(rateStr, "%s/s", print_bytes(originStr, (totalBytes - hitBytes) / (lastTime - firstTime)));
+	else
+		strcpy(rateStr, "-");
+	printf("%-6s %10s %8.2f%% %8.2f%% %12s %12s %10.2f\n",
+	       cache_policy_name(policy), print_bytes(sizeStr, bytes),
+	       nrequests ? 100.0 * hits / nrequests : 0.0,
+	       totalBytes ? 100.0 * hitBytes / totalBytes : 0.0,
+	       print_bytes(originStr, totalBytes - hitBytes), rateStr,
+	       elapsed > 0 ? nrequests / elapsed / 1e6 : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+	int c, i, j, binary = 0;
+	char *policyList = NULL, *sizeList = NULL, *outFile = NULL;
+	char *items[64];
+	int policies[CACHE_NPOLICIES], npolicies = 0;
+	size_t sizes[64], entries = 0;
+	int nsizes = 0;
+
+	while ((c = getopt(argc, argv, "bp:s:n:o:")) != -1) {
+		switch (c) {
+		case 'b': binary = 1; break;
+		case 'p': policyList = optarg; break;
+		case 's': sizeList = optarg; break;
+		case 'n': entries = parse_size(optarg); break;
+		case 'o': outFile = optarg; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || entries == (size_t)-1)
+		usage(argv[0]);
+
+	if (policyList) {
+		int n = parse_list(policyList, items, 64);
+		for (i = 0; i < n && npolicies < CACHE_NPOLICIES; i++) {
+			if ((policies[npolicies++] = cache_policy_byname(items[i])) < 0)
+				usage(argv[0]);
+		}
+	}
+	else {
+		for (npolicies = 0; npolicies < CACHE_NPOLICIES; npolicies++)
+			policies[npolicies] = npolicies;
+	}
+	if (sizeList) {
+		int n = parse_list(sizeList, items, 64);
+		for (i = 0; i < n; i++) {
+			if ((sizes[nsizes++] = parse_size(items[i])) == (size_t)-1)
+				usage(argv[0]);
+		}
+	}
+	else {
+		for (nsizes = 0; nsizes <= 10; nsizes++)
+			sizes[nsizes] = (size_t)1 << (20 + nsizes);
+	}
+
+	if (binary)
+		load_binary(argv[optind]);
+	else
+		load_log(argv[optind]);
+
+	if (outFile) {
+		FILE *fp = Fopen(outFile, "wb");
+		Fwrite(records, sizeof(struct traceRecord), nrequests, fp);
+		Fclose(fp);
+		printf("%lu requests written to %s\n", (unsigned long)nrequests, outFile);
+		return 0;
+	}
+
+	printf("%lu requests, %lu distinct objects\n", (unsigned long)nrequests, (unsigned long)nkeys);
+	printf("%-6s %10s %9s %9s %12s %12s %10s\n",
+	       "policy", "size", "hit", "bytehit", "origin", "origin/s", "Mreq/s");
+	for (j = 0; j < nsizes; j++) {
+		for (i = 0; i < npolicies; i++)
+			simulate(policies[i], sizes[j], entries ? entries : (nkeys ? nkeys : 1));
+	}
+	return 0;
+}
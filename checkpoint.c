@@ -0,0 +1,162 @@
+/*
+ * checkpoint.c - persistent copy of the page cache index
+ */
+
+#include "csapp.h"
+#include "checkpoint.h"
+#include "store.h"
+#include <stddef.h>
+
+/* record_checksum - checksum of a record's fields and its key */
+static uint64_t record_checksum(const struct checkpointRecord *r, const char *key)
+{
+	uint64_t h = store_checksum(r, offsetof(struct checkpointRecord, checksum));
+
+	return h ^ ((store_checksum(key, r->keyLen) << 1) | 1);
+}
+
+/* write_all - write n bytes or fail */
+static int write_all(int fd, const void *buf, size_t n)
+{
+	return rio_writen(fd, (void *)buf, n) == (ssize_t)n ? 0 : -1;
+}
+
+/*
+ * checkpoint_save - write every entry of c that get accepts to filename.
+ * The file is written as filename.tmp, synced and renamed over the old
+ * checkpoint.  Returns the number of records written, or -1.
+ */
+int checkpoint_save(const char *filename, uint64_t storeId, cache_t *c,
+		    checkpoint_get_t *get, void *arg)
+{
+	struct checkpointHeader hdr;
+	struct checkpointRecord *records;
+	char *keys, tmpname[512];
+	cache_entry_t *e;
+	size_t n = 0, keyBytes = 0, keyCap;
+	int fd, rc = -1;
+
+	records = malloc((c->count ? c->count : 1) * sizeof(*records));
+	keyCap = c->count ? c->count * 64 : 1;
+	keys = malloc(keyCap);  //doubled below if keys are long
+	if (records == NULL || keys == NULL) {
+		free(records);
+		free(keys);
+		return -1;
+	}
+	for (e = c->head; e != NULL; e = e->next) {
+		struct checkpointRecord *r = &records[n];
+
+		memset(r, 0, sizeof(*r));
+		if (get(e, r, arg) < 0)
+			continue;
+		if (keyBytes + e->keylen > keyCap) {
+			char *more;
+
+			while (keyBytes + e->keylen > keyCap)
+				keyCap *= 2;
+			if ((more = realloc(keys, keyCap)) == NULL)
+				goto out;
+			keys = more;
+		}
+		memcpy(keys + keyBytes, e->key, e->keylen);
+		r->keyhash = e->hash;
+		r->keyOffset = keyBytes;
+		r->keyLen = e->keylen;
+		r->checksum = record_checksum(r, e->key);
+		keyBytes += e->keylen;
+		n++;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = CHECKPOINT_MAGIC;
+	hdr.version = CHECKPOINT_VERSION;
+	hdr.recordBytes = sizeof(struct checkpointRecord);
+	hdr.storeId = storeId;
+	hdr.count = n;
+	hdr.keyBytes = keyBytes;
+	hdr.written = time(NULL);
+	hdr.checksum = store_checksum(&hdr, offsetof(struct checkpointHeader, checksum));
+
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+	if ((fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		goto out;
+	if (write_all(fd, &hdr, sizeof(hdr)) < 0 ||
+	    write_all(fd, records, n * sizeof(*records)) < 0 ||
+	    write_all(fd, keys, keyBytes) < 0 || fsync(fd) < 0) {
+		close(fd);
+		unlink(tmpname);
+		goto out;
+	}
+	close(fd);
+	if (rename(tmpname, filename) < 0) {
+		unlink(tmpname);
+		goto out;
+	}
+	rc = n;
+out:
+	free(records);
+	free(keys);
+	return rc;
+}
+
+/*
+ * checkpoint_load - map filename and pass each intact record to put,
+ * oldest first.  Only the newest records that fit in maxEntries and
+ * maxBytes (0 for no byte limit) are loaded, so replaying them never
+ * evicts.  Returns the number of records passed to put, or -1 if there
+ * is no checkpoint for this store.
+ */
+long checkpoint_load(const char *filename, uint64_t storeId, size_t maxEntries,
+		     size_t maxBytes, checkpoint_put_t *put, void *arg)
+{
+	const struct checkpointHeader *hdr;
+	const struct checkpointRecord *records, *r;
+	const char *keys;
+	struct stat st;
+	size_t i, start, bytes = 0;
+	long loaded = 0;
+	char *map;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0)
+		return -1;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(*hdr)) {
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	hdr = (const struct checkpointHeader *)map;
+	if (hdr->magic != CHECKPOINT_MAGIC || hdr->version != CHECKPOINT_VERSION ||
+	    hdr->recordBytes != sizeof(struct checkpointRecord) ||
+	    hdr->checksum != store_checksum(hdr, offsetof(struct checkpointHeader, checksum)) ||
+	    hdr->storeId != storeId ||
+	    hdr->count > (uint64_t)st.st_size / sizeof(struct checkpointRecord) ||
+	    sizeof(*hdr) + hdr->count * sizeof(struct checkpointRecord) + hdr->keyBytes != (uint64_t)st.st_size) {
+		munmap(map, st.st_size);
+		return -1;
+	}
+	records = (const struct checkpointRecord *)(map + sizeof(*hdr));
+	keys = (const char *)(records + hdr->count);
+
+	//newest records are at the end, keep as many of them as fit
+	for (start = hdr->count; start > 0 && hdr->count - start < maxEntries; start--) {
+		if (maxBytes && bytes + records[start - 1].length > maxBytes)
+			break;
+		bytes += records[start - 1].length;
+	}
+	for (i = start; i < hdr->count; i++) {
+		r = &records[i];
+		if (r->keyOffset > hdr->keyBytes || r->keyLen > hdr->keyBytes - r->keyOffset ||
+		    r->checksum != record_checksum(r, keys + r->keyOffset))
+			continue;  //damaged record
+		put(keys + r->keyOffset, r, arg);
+		loaded++;
+	}
+	munmap(map, st.st_size);
+	return loaded;
+}
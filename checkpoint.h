@@ -0,0 +1,52 @@
+/*
+ * checkpoint.h - persistent copy of the page cache index
+ *
+ * A checkpoint file is a header, an array of fixed-size records in
+ * eviction order (next victim first) and the keys they point into.
+ * Every part is checksummed, so the file can be mapped and used in
+ * place; a damaged record is skipped and a damaged header discards the
+ * whole checkpoint.  Files are written beside their final name and
+ * renamed into place, so a crash mid-write leaves the old checkpoint.
+ */
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <stdint.h>
+#include "cache.h"
+
+#define CHECKPOINT_MAGIC   0x5844494f59585850ULL  /* "PXYOIDX" */
+#define CHECKPOINT_VERSION 1
+
+struct checkpointHeader {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t recordBytes;   //sizeof(struct checkpointRecord)
+	uint64_t storeId;       //store file the records point into
+	uint64_t count;         //number of records
+	uint64_t keyBytes;      //size of the key area after the records
+	uint64_t written;       //time the checkpoint was taken
+	uint64_t checksum;      //store_checksum of the header up to this field
+};
+
+struct checkpointRecord {
+	uint64_t offset;        //object offset in the store
+	uint64_t seq;           //object sequence number
+	uint64_t keyhash;       //cache_hash of the key
+	uint64_t keyOffset;     //start of the key in the key area
+	uint32_t keyLen;
+	uint32_t length;        //payload bytes
+	uint64_t checksum;      //store_checksum of the record and its key up to this field
+};
+
+/* Fills in where the page in e lives, returns -1 to leave it out */
+typedef int checkpoint_get_t(cache_entry_t *e, struct checkpointRecord *r, void *arg);
+
+/* Called for each intact record on load */
+typedef void checkpoint_put_t(const char *key, const struct checkpointRecord *r, void *arg);
+
+int checkpoint_save(const char *filename, uint64_t storeId, cache_t *c,
+		    checkpoint_get_t *get, void *arg);
+long checkpoint_load(const char *filename, uint64_t storeId, size_t maxEntries,
+		     size_t maxBytes, checkpoint_put_t *put, void *arg);
+
+#endif /* __CHECKPOINT_H__ */
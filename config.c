@@ -0,0 +1,428 @@
+/*
+ * config.c - run-time settings for the proxy
+ */
+
+#include "csapp.h"
+#include "cache.h"
+#include "config.h"
+#include "ioloop.h"
+#include "http.h"
+#include "purge.h"
+#include <limits.h>
+
+struct proxyConfig config;
+
+/* config_defaults - settings that match the proxy's original behavior */
+void config_defaults(struct proxyConfig *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	cfg->cachePolicy = CACHE_FIFO;
+	cfg->cacheEntries = 1024;
+	cfg->cacheBytes = 0;
+	strcpy(cfg->storeFile, "cache.store");
+	cfg->storeBytes = 64 << 20;
+	cfg->storeLogBytes = 16 << 20;
+	cfg->storeMaxObject = 8 << 20;
+	cfg->bypassBytes = 0;
+	cfg->storeHugepages = 0;
+	strcpy(cfg->indexFile, "cache.idx");
+	cfg->checkpointInterval = 60;
+	cfg->ramBytes = 16 << 20;
+	cfg->ramAdmitBytes = 16 << 10;
+	cfg->ramMaxObject = 256 << 10;
+	cfg->promoteHits = 2;
+	cfg->fillQueueChunks = 64;
+	cfg->ioBackend = IOLOOP_AUTO;
+	cfg->maxPending = 256;
+	cfg->connectDelay = 250;
+	cfg->connectTimeout = 5000;
+	cfg->headerTimeout = 10000;
+	cfg->firstByteTimeout = 10000;
+	cfg->idleTimeout = 10000;
+	cfg->requestTimeout = 0;
+	cfg->outputHighWater = 64 << 10;
+	cfg->outputLowWater = 16 << 10;
+	cfg->maxInFlight = 512;
+	cfg->originMaxInFlight = 0;
+	cfg->latencyTarget = 0;
+	cfg->retryAfter = 1;
+	cfg->rateRequests = 0;
+	cfg->rateRequestBurst = 0;
+	cfg->rateBytes = 0;
+	cfg->rateByteBurst = 256 << 10;
+	cfg->rateClients = 65536;
+	cfg->rateIdle = 60;
+	cfg->healthFailures = 5;
+	cfg->healthOpenTime = 10000;
+	cfg->healthProbeInterval = 0;
+	cfg->cacheTtl = 0;
+	cfg->compressLevel = 0;
+	strcpy(cfg->compressTypes, "text/ application/json application/javascript application/xml image/svg+xml");
+	cfg->compressMinLength = 256;
+	cfg->storeCompressLevel = 0;
+	strcpy(cfg->storeCompressSkip, "image/ video/ audio/ font/ application/zip application/gzip application/zstd application/pdf");
+	cfg->dedupMinBytes = 0;
+	cfg->prefetchConcurrency = 0;
+	cfg->prefetchBytes = 4 << 20;
+	cfg->rangeRequests = HTTP_RANGE_ON;
+	cfg->purge = PURGE_LOCAL;
+	cfg->routes.balance = ROUTE_LEAST;
+	cfg->peerDigestInterval = 10000;
+	cfg->listenOpts.backlog = LISTENQ;
+}
+
+/*
+ * parse_size - parse a byte count with an optional K, M or G suffix.
+ * Returns (size_t)-1 if s is not a valid size.
+ */
+size_t parse_size(const char *s)
+{
+	char *end;
+	unsigned long long v = strtoull(s, &end, 10);
+
+	if (end == s)
+		return (size_t)-1;
+	switch (toupper((unsigned char)*end)) {
+	case 'G': v <<= 10; /* fall through */
+	case 'M': v <<= 10; /* fall through */
+	case 'K': v <<= 10; end++; break;
+	case '\0': break;
+	default: return (size_t)-1;
+	}
+	if (*end == 'B' || *end == 'b')
+		end++;
+	return *end == '\0' ? (size_t)v : (size_t)-1;
+}
+
+/*
+ * set_sockopt - apply the setting name, without its listen_, client_ or
+ * upstream_ prefix, to o.  Returns -1 if the name is not an option of
+ * role or the value is bad.
+ */
+static int set_sockopt(struct sockOpts *o, int role, const char *name, const char *value)
+{
+	size_t size;
+	int n = atoi(value);
+
+	if (strcmp(name, "backlog") == 0 && role == SOCK_LISTEN) {
+		if ((o->backlog = n) < 1)
+			return -1;
+	}
+	else if (strcmp(name, "reuseport") == 0 && role == SOCK_LISTEN) {
+		o->reusePort = n;
+	}
+	else if (strcmp(name, "defer_accept") == 0 && role == SOCK_LISTEN) {
+		if ((o->deferAccept = n) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "fastopen") == 0 && role != SOCK_CLIENT) {
+		if ((o->fastOpen = n) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "nodelay") == 0 && role != SOCK_LISTEN) {
+		o->noDelay = n;
+	}
+	else if (strcmp(name, "sndbuf") == 0 || strcmp(name, "rcvbuf") == 0) {
+		if ((size = parse_size(value)) == (size_t)-1 || size > INT_MAX)
+			return -1;
+		if (name[0] == 's')
+			o->sndBuf = size;
+		else
+			o->rcvBuf = size;
+	}
+	else if (strcmp(name, "keepalive") == 0 && role != SOCK_LISTEN) {
+		if ((o->keepIdle = n) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "keepalive_interval") == 0 && role != SOCK_LISTEN) {
+		if ((o->keepInterval = n) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "keepalive_probes") == 0 && role != SOCK_LISTEN) {
+		if ((o->keepProbes = n) < 0)
+			return -1;
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+/* set_option - apply one name/value pair, returns -1 if either is invalid */
+static int set_option(struct proxyConfig *cfg, const char *name, const char *value)
+{
+	size_t size;
+
+	if (strcmp(name, "cache_policy") == 0) {
+		if ((cfg->cachePolicy = cache_policy_byname(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "cache_entries") == 0) {
+		if ((size = parse_size(value)) == (size_t)-1 || size == 0)
+			return -1;
+		cfg->cacheEntries = size;
+	}
+	else if (strcmp(name, "cache_bytes") == 0) {
+		if ((size = parse_size(value)) == (size_t)-1)
+			return -1;
+		cfg->cacheBytes = size;
+	}
+	else if (strcmp(name, "store_file") == 0) {
+		if (strlen(value) >= sizeof(cfg->storeFile))
+			return -1;
+		strcpy(cfg->storeFile, value);
+	}
+	else if (strcmp(name, "store_bytes") == 0) {
+		if ((cfg->storeBytes = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "store_log_bytes") == 0) {
+		if ((cfg->storeLogBytes = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "store_max_object") == 0) {
+		if ((cfg->storeMaxObject = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "bypass_bytes") == 0) {
+		if ((cfg->bypassBytes = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "store_hugepages") == 0) {
+		cfg->storeHugepages = atoi(value);
+	}
+	else if (strcmp(name, "index_file") == 0) {
+		if (strlen(value) >= sizeof(cfg->indexFile))
+			return -1;
+		strcpy(cfg->indexFile, value);
+	}
+	else if (strcmp(name, "checkpoint_interval") == 0) {
+		cfg->checkpointInterval = atoi(value);
+	}
+	else if (strcmp(name, "ram_bytes") == 0) {
+		if ((cfg->ramBytes = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "ram_admit_bytes") == 0) {
+		if ((cfg->ramAdmitBytes = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "ram_max_object") == 0) {
+		if ((cfg->ramMaxObject = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "promote_hits") == 0) {
+		if ((cfg->promoteHits = atoi(value)) < 1)
+			return -1;
+	}
+	else if (strcmp(name, "io_backend") == 0) {
+		if ((cfg->ioBackend = ioloop_backend_byname(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "max_pending") == 0) {
+		if ((size = parse_size(value)) == (size_t)-1 || size == 0)
+			return -1;
+		cfg->maxPending = size;
+	}
+	else if (strcmp(name, "connect_delay") == 0) {
+		if ((cfg->connectDelay = atoi(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "connect_timeout") == 0) {
+		if ((cfg->connectTimeout = atoi(value)) < 1)
+			return -1;
+	}
+	else if (strcmp(name, "header_timeout") == 0) {
+		if ((cfg->headerTimeout = atoi(value)) < 1)
+			return -1;
+	}
+	else if (strcmp(name, "first_byte_timeout") == 0) {
+		if ((cfg->firstByteTimeout = atoi(value)) < 1)
+			return -1;
+	}
+	else if (strcmp(name, "idle_timeout") == 0) {
+		if ((cfg->idleTimeout = atoi(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "request_timeout") == 0) {
+		if ((cfg->requestTimeout = atoi(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "output_high_water") == 0) {
+		if ((size = parse_size(value)) == (size_t)-1 || size == 0)
+			return -1;
+		cfg->outputHighWater = size;
+	}
+	else if (strcmp(name, "output_low_water") == 0) {
+		if ((cfg->outputLowWater = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "max_in_flight") == 0) {
+		if ((cfg->maxInFlight = atoi(value)) < 1)
+			return -1;
+	}
+	else if (strcmp(name, "origin_max_in_flight") == 0) {
+		if ((cfg->originMaxInFlight = atoi(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "latency_target") == 0) {
+		if ((cfg->latencyTarget = atoi(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "retry_after") == 0) {
+		if ((cfg->retryAfter = atoi(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "rate_requests") == 0) {
+		if ((cfg->rateRequests = atof(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "rate_request_burst") == 0) {
+		if ((cfg->rateRequestBurst = atof(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "rate_bytes") == 0) {
+		if ((cfg->rateBytes = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "rate_byte_burst") == 0) {
+		if ((cfg->rateByteBurst = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "rate_clients") == 0) {
+		if ((size = parse_size(value)) == (size_t)-1 || size == 0)
+			return -1;
+		cfg->rateClients = size;
+	}
+	else if (strcmp(name, "rate_idle") == 0) {
+		if ((cfg->rateIdle = atoi(value)) < 1)
+			return -1;
+	}
+	else if (strcmp(name, "health_failures") == 0) {
+		if ((cfg->healthFailures = atoi(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "health_open_time") == 0) {
+		if ((cfg->healthOpenTime = atoi(value)) < 1)
+			return -1;
+	}
+	else if (strcmp(name, "health_probe_interval") == 0) {
+		if ((cfg->healthProbeInterval = atoi(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "cache_ttl") == 0) {
+		if ((cfg->cacheTtl = atoi(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "compress_level") == 0) {
+		if ((cfg->compressLevel = atoi(value)) < 0 || cfg->compressLevel > 9)
+			return -1;
+	}
+	else if (strcmp(name, "compress_types") == 0) {
+		if (strlen(value) >= sizeof(cfg->compressTypes))
+			return -1;
+		strcpy(cfg->compressTypes, value);
+	}
+	else if (strcmp(name, "compress_min_length") == 0) {
+		if ((cfg->compressMinLength = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "store_compress_level") == 0) {
+		if ((cfg->storeCompressLevel = atoi(value)) < 0 || cfg->storeCompressLevel > 9)
+			return -1;
+	}
+	else if (strcmp(name, "store_compress_skip") == 0) {
+		if (strlen(value) >= sizeof(cfg->storeCompressSkip))
+			return -1;
+		strcpy(cfg->storeCompressSkip, value);
+	}
+	else if (strcmp(name, "dedup_min_bytes") == 0) {
+		if ((cfg->dedupMinBytes = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "prefetch_concurrency") == 0) {
+		if ((cfg->prefetchConcurrency = atoi(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "prefetch_bytes") == 0) {
+		if ((cfg->prefetchBytes = parse_size(value)) == (size_t)-1)
+			return -1;
+	}
+	else if (strcmp(name, "range_requests") == 0) {
+		if ((cfg->rangeRequests = http_range_byname(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "purge") == 0) {
+		if ((cfg->purge = purge_byname(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "backend") == 0) {
+		return route_add_backend(&cfg->routes, value);
+	}
+	else if (strcmp(name, "route") == 0) {
+		return route_add(&cfg->routes, value);
+	}
+	else if (strcmp(name, "balance") == 0) {
+		if ((cfg->routes.balance = route_balance_byname(value)) < 0)
+			return -1;
+	}
+	else if (strcmp(name, "peer") == 0) {
+		return peer_add(&cfg->peers, value);
+	}
+	else if (strcmp(name, "peer_self") == 0) {
+		if (strlen(value) >= sizeof(cfg->peerSelf) || strchr(value, ':') == NULL)
+			return -1;
+		strcpy(cfg->peerSelf, value);
+	}
+	else if (strcmp(name, "peer_digest_interval") == 0) {
+		if ((cfg->peerDigestInterval = atoi(value)) < 1)
+			return -1;
+	}
+	else if (strncmp(name, "listen_", 7) == 0) {
+		return set_sockopt(&cfg->listenOpts, SOCK_LISTEN, name + 7, value);
+	}
+	else if (strncmp(name, "client_", 7) == 0) {
+		return set_sockopt(&cfg->clientOpts, SOCK_CLIENT, name + 7, value);
+	}
+	else if (strncmp(name, "upstream_", 9) == 0) {
+		return set_sockopt(&cfg->upstreamOpts, SOCK_UPSTREAM, name + 9, value);
+	}
+	else if (strcmp(name, "fill_queue_chunks") == 0) {
+		if ((size = parse_size(value)) == (size_t)-1 || size == 0)
+			return -1;
+		cfg->fillQueueChunks = size;
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * config_load - read settings from filename into cfg.  Unknown names and
+ * bad values are reported with their line number.  Returns -1 if the
+ * file could not be read or contained errors.
+ */
+int config_load(struct proxyConfig *cfg, const char *filename)
+{
+	FILE *fp;
+	char line[MAXLINE], name[MAXLINE], value[MAXLINE];
+	int lineno = 0, errors = 0;
+
+	if ((fp = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		if (sscanf(line, "%s", name) != 1 || name[0] == '#')
+			continue;
+		if (sscanf(line, "%s %[^\r\n]", name, value) != 2 ||
+		    set_option(cfg, name, value) < 0) {
+			fprintf(stderr, "%s:%d: invalid setting \"%s\"\n", filename, lineno, name);
+			errors++;
+		}
+	}
+	fclose(fp);
+	return errors ? -1 : 0;
+}
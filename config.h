@@ -0,0 +1,82 @@
+/*
+ * config.h - run-time settings for the proxy
+ *
+ * Settings come from an optional file given after the port number, one
+ * "name value" pair per line.  Blank lines and lines starting with '#'
+ * are ignored.
+ */
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include <stddef.h>
+#include "sockopt.h"
+#include "route.h"
+#include "peer.h"
+
+struct proxyConfig {
+	int cachePolicy;          //cache_policy: fifo, lru or clock
+	size_t cacheEntries;      //cache_entries: maximum number of cached pages
+	size_t cacheBytes;        //cache_bytes: byte budget for cached pages, 0 for none
+	char storeFile[256];      //store_file: path of the single file holding cached pages
+	size_t storeBytes;        //store_bytes: size the store file is preallocated to
+	size_t storeLogBytes;     //store_log_bytes: part of the store kept for the large object log
+	size_t storeMaxObject;    //store_max_object: largest page that is cached
+	size_t bypassBytes;       //bypass_bytes: responses declaring more are relayed without being cached, 0 for store_max_object
+	int storeHugepages;       //store_hugepages: 1 to advise huge pages for the slab region
+	char indexFile[256];      //index_file: checkpoint of the cache index for warm restarts
+	int checkpointInterval;   //checkpoint_interval: seconds between checkpoints, 0 for none
+	size_t ramBytes;          //ram_bytes: byte budget of the in-memory tier, 0 for none
+	size_t ramAdmitBytes;     //ram_admit_bytes: pages up to this size are cached in memory first
+	size_t ramMaxObject;      //ram_max_object: largest page promoted to memory
+	int promoteHits;          //promote_hits: hits a page on disk needs before it is promoted
+	size_t fillQueueChunks;   //fill_queue_chunks: 8K chunks a fill may queue before it is abandoned
+	int ioBackend;            //io_backend: auto, io_uring or epoll
+	size_t maxPending;        //max_pending: connections the parent reads request lines from at once
+	int connectDelay;         //connect_delay: ms before another address is tried alongside the last
+	int connectTimeout;       //connect_timeout: ms one connect attempt may take
+	int headerTimeout;        //header_timeout: ms a client has to send its request line
+	int firstByteTimeout;     //first_byte_timeout: ms the origin has to start its response
+	int idleTimeout;          //idle_timeout: ms a relay may go without progress, 0 for none
+	int requestTimeout;       //request_timeout: ms a whole request may take, 0 for none
+	size_t outputHighWater;   //output_high_water: bytes queued for a client before origin reads pause
+	size_t outputLowWater;    //output_low_water: bytes queued for a client when origin reads resume
+	int maxInFlight;          //max_in_flight: requests served at once, more are turned away with a 503
+	int originMaxInFlight;    //origin_max_in_flight: requests fetching from one origin at once, 0 for no cap
+	int latencyTarget;        //latency_target: ms to an origin's first byte above which the limit shrinks, 0 for a fixed limit
+	int retryAfter;           //retry_after: seconds a turned away client is told to wait
+	double rateRequests;      //rate_requests: requests per second a client may make, 0 for no limit
+	double rateRequestBurst;  //rate_request_burst: requests a client may make at once
+	size_t rateBytes;         //rate_bytes: bytes per second sent to a client, 0 for no limit
+	size_t rateByteBurst;     //rate_byte_burst: bytes a client may be sent at once
+	size_t rateClients;       //rate_clients: clients whose buckets are kept
+	int rateIdle;             //rate_idle: seconds before an idle client's buckets are reused
+	int healthFailures;       //health_failures: failures in a row that open an origin's circuit, 0 for no circuits
+	int healthOpenTime;       //health_open_time: ms an open circuit fails requests before letting one through
+	int healthProbeInterval;  //health_probe_interval: ms between connect probes of open origins, 0 for none
+	int cacheTtl;             //cache_ttl: seconds before a page is refetched, 0 to keep pages until evicted
+	int compressLevel;        //compress_level: gzip level for clients that accept it, 0 to send responses as received
+	char compressTypes[256];  //compress_types: content types worth compressing, "text/" covers all text
+	size_t compressMinLength; //compress_min_length: responses declaring fewer bytes are sent as received
+	int storeCompressLevel;   //store_compress_level: zlib level pages are packed at on disk, 0 to store them as received
+	char storeCompressSkip[256]; //store_compress_skip: content types stored as received, being compressed already
+	size_t dedupMinBytes;     //dedup_min_bytes: bodies this large are stored once for every page with them, 0 for no dedup
+	int prefetchConcurrency;  //prefetch_concurrency: subresources of a missed page fetched at once, 0 for no prefetching
+	size_t prefetchBytes;     //prefetch_bytes: no more prefetches of a page's subresources start past this many bytes
+	int rangeRequests;        //range_requests: off, on or fill, see http.h
+	int purge;                //purge: who may send PURGE, off, local or any, see purge.h
+	routes_t routes;          //backend, route and balance: reverse proxy pools and what goes to each
+	peers_t peers;            //peer: the proxy nodes sharing their caches, this one included
+	char peerSelf[256];       //peer_self: host:port this node is listed as, default localhost and its port
+	int peerDigestInterval;   //peer_digest_interval: ms between rebuilding this node's digest and fetching the peers'
+	struct sockOpts listenOpts;   //listen_*: the listening socket
+	struct sockOpts clientOpts;   //client_*: connections accepted from clients
+	struct sockOpts upstreamOpts; //upstream_*: connections to origin servers
+};
+
+extern struct proxyConfig config;
+
+void config_defaults(struct proxyConfig *cfg);
+int config_load(struct proxyConfig *cfg, const char *filename);
+size_t parse_size(const char *s);
+
+#endif /* __CONFIG_H__ */
@@ -0,0 +1,149 @@
+/*
+ * dedup.c - content addressed page bodies
+ *
+ * Entries are chained off a power of two bucket array by hash; free
+ * entries are kept on a list threaded through next.
+ */
+
+#include "csapp.h"
+#include "dedup.h"
+
+/*
+ * dedup_hash - fast 64-bit hash of a body.  Four lanes take 32 bytes a
+ * step so their multiplies overlap instead of each waiting on the last,
+ * which keeps it close to the speed of the copy that staged the body.
+ * Not cryptographic: bodies with the same hash are compared before they
+ * are shared.
+ */
+uint64_t dedup_hash(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	uint64_t a, b, c, d, w, x, y, z;
+
+	a = 0x9e3779b97f4a7c15ULL ^ len;
+	b = a + 1;
+	c = a + 2;
+	d = a + 3;
+	for (; len >= 32; p += 32, len -= 32) {
+		memcpy(&w, p, 8);
+		memcpy(&x, p + 8, 8);
+		memcpy(&y, p + 16, 8);
+		memcpy(&z, p + 24, 8);
+		a = (a ^ w) * 0xff51afd7ed558ccdULL;
+		b = (b ^ x) * 0xff51afd7ed558ccdULL;
+		c = (c ^ y) * 0xff51afd7ed558ccdULL;
+		d = (d ^ z) * 0xff51afd7ed558ccdULL;
+	}
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&w, p, 8);
+		a = (a ^ w) * 0xff51afd7ed558ccdULL;
+	}
+	for (w = 0; len > 0; len--)
+		w = (w << 8) | p[len - 1];
+	a ^= w;
+	//fold the lanes together, mixing each in
+	a = (a ^ (a >> 32) ^ b ^ (b >> 32)) * 0xc4ceb9fe1a85ec53ULL;
+	a = (a ^ c ^ (c >> 32)) * 0xc4ceb9fe1a85ec53ULL;
+	a = (a ^ d ^ (d >> 32)) * 0xc4ceb9fe1a85ec53ULL;
+	return a ^ (a >> 29);
+}
+
+/* dedup_init - an empty table of nblobs entries, one per page at most */
+void dedup_init(dedup_t *d, size_t nblobs)
+{
+	size_t i;
+
+	memset(d, 0, sizeof(*d));
+	for (d->nbuckets = 1; d->nbuckets < nblobs; d->nbuckets *= 2)
+		;
+	d->nblobs = nblobs;
+	d->blobs = Calloc(nblobs, sizeof(dedup_blob_t));
+	d->buckets = Malloc(d->nbuckets * sizeof(int));
+	for (i = 0; i < d->nbuckets; i++)
+		d->buckets[i] = -1;
+	for (i = 0; i < nblobs; i++)
+		d->blobs[i].next = i + 1 < nblobs ? (int)i + 1 : -1;
+	d->freeList = nblobs > 0 ? 0 : -1;
+}
+
+/* dedup_find - the entry of a body of length bytes with hash, -1 if there is none */
+int dedup_find(dedup_t *d, uint64_t hash, uint32_t length)
+{
+	int i;
+
+	if (d->nbuckets == 0)
+		return -1;
+	for (i = d->buckets[hash & (d->nbuckets - 1)]; i >= 0; i = d->blobs[i].next)
+		if (d->blobs[i].hash == hash && d->blobs[i].length == length)
+			return i;
+	return -1;
+}
+
+/*
+ * dedup_add - enter the body of length bytes with hash, starting at start
+ * in the payload of object seq at offset, with its page as its one
+ * owner.  Returns the entry, or -1 if the table is full.
+ */
+int dedup_add(dedup_t *d, uint64_t hash, uint64_t offset, uint64_t seq, uint32_t start, uint32_t length)
+{
+	dedup_blob_t *b;
+	int i, *bucket;
+
+	if ((i = d->freeList) < 0)
+		return -1;
+	b = &d->blobs[i];
+	d->freeList = b->next;
+	bucket = &d->buckets[hash & (d->nbuckets - 1)];
+	b->hash = hash;
+	b->offset = offset;
+	b->seq = seq;
+	b->start = start;
+	b->length = length;
+	b->owners = 1;
+	b->next = *bucket;
+	*bucket = i;
+	d->logical += length;
+	d->stored += length;
+	return i;
+}
+
+/* dedup_live - whether entry i still holds the body with hash in object seq */
+int dedup_live(dedup_t *d, int i, uint64_t hash, uint64_t seq)
+{
+	return i >= 0 && (size_t)i < d->nblobs && d->blobs[i].owners > 0 &&
+	       d->blobs[i].hash == hash && d->blobs[i].seq == seq;
+}
+
+/* dedup_get - count one more page sharing entry i's body */
+void dedup_get(dedup_t *d, int i)
+{
+	d->blobs[i].owners++;
+	d->logical += d->blobs[i].length;
+}
+
+/*
+ * dedup_put - a page no longer uses entry i's body.  Returns the owners
+ * left; at 0 the entry is freed and the caller releases the object.
+ */
+int dedup_put(dedup_t *d, int i)
+{
+	dedup_blob_t *b = &d->blobs[i];
+	int *pp;
+
+	d->logical -= b->length;
+	if (--b->owners > 0)
+		return b->owners;
+	for (pp = &d->buckets[b->hash & (d->nbuckets - 1)]; *pp != i; pp = &d->blobs[*pp].next)
+		;
+	*pp = b->next;
+	d->stored -= b->length;
+	b->next = d->freeList;
+	d->freeList = i;
+	return 0;
+}
+
+/* dedup_ratio - body bytes the cached pages hold for each byte stored */
+double dedup_ratio(dedup_t *d)
+{
+	return d->stored > 0 ? (double)d->logical / d->stored : 1.0;
+}
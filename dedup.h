@@ -0,0 +1,51 @@
+/*
+ * dedup.h - content addressed page bodies
+ *
+ * The same bytes are often cached under many URLs: a script library or
+ * a font served by several hosts, an image under more than one path.
+ * Every page on disk that is not packed is entered here by the
+ * dedup_hash of its body, the response after its head, with the
+ * store object holding it.  A child filling a page whose body is found
+ * here, and is the same byte for byte, writes only the page's head and
+ * the page shares the body.  Each entry counts the pages using its
+ * body; the object is released with the last of them.
+ *
+ * The table lives in the parent.  A child looks bodies up in the copy
+ * it was forked with, so an entry it finds may be gone by the time its
+ * fill is reported; the parent checks the entry still holds the same
+ * object before counting the page in.
+ */
+#ifndef __DEDUP_H__
+#define __DEDUP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	uint64_t hash;                //dedup_hash of the body
+	uint64_t offset, seq;         //disk store object the body is in
+	uint32_t start;               //where in the object's payload the body starts, after its head
+	uint32_t length;              //body bytes
+	int owners;                   //pages whose body this is, 0 while the entry is free
+	int next;                     //hash chain, or free list
+} dedup_blob_t;
+
+typedef struct {
+	dedup_blob_t *blobs;
+	int *buckets;
+	size_t nblobs, nbuckets;
+	int freeList;
+	uint64_t logical;             //body bytes of every owner, as if each had its own copy
+	uint64_t stored;              //body bytes actually stored
+} dedup_t;
+
+uint64_t dedup_hash(const void *data, size_t len);
+void dedup_init(dedup_t *d, size_t nblobs);
+int dedup_find(dedup_t *d, uint64_t hash, uint32_t length);
+int dedup_add(dedup_t *d, uint64_t hash, uint64_t offset, uint64_t seq, uint32_t start, uint32_t length);
+int dedup_live(dedup_t *d, int i, uint64_t hash, uint64_t seq);
+void dedup_get(dedup_t *d, int i);
+int dedup_put(dedup_t *d, int i);
+double dedup_ratio(dedup_t *d);
+
+#endif /* __DEDUP_H__ */
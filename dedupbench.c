@@ -0,0 +1,120 @@
+/*
+ * dedupbench.c - what deduplicating page bodies would save and cost
+ *
+ * Treats each file named on the command line as the body of a cached
+ * page and runs it through the fill path the way the proxy does with
+ * dedup_min_bytes set: the body is staged, as a fill copies it in from
+ * the relay, then hashed with dedup_hash and looked up in a dedup
+ * table, where a body already seen, byte for byte, is shared instead of
+ * stored again.  Each is timed over a number of rounds.  Reports per
+ * file the bytes, the time to stage it, the time to hash it and that as
+ * a share of staging, and which earlier file it duplicates; then in
+ * total the bytes the pages hold against the bytes stored, the dedup
+ * ratio, and the hashing overhead on the fill path.
+ */
+
+#include "csapp.h"
+#include <time.h>
+#include "dedup.h"
+#include "store.h"
+
+/* usage - print the command line summary and exit */
+static void usage(char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n rounds] file...\n"
+		"  -n rounds  times each file is staged and hashed (default: 100)\n",
+		prog);
+	exit(1);
+}
+
+/* now_us - a monotonic clock in microseconds */
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = 100, opt, i, r, j, nfiles;
+	size_t n, at;
+	double t, stageUs, hashUs, stageSum = 0, hashSum = 0;
+	char buf[MAXLINE], **bodies;
+	size_t *lengths;
+	uint64_t hash = 0;
+	store_fill_t fill;
+	dedup_t d;
+	FILE *fp;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n': rounds = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind == argc || rounds < 1)
+		usage(argv[0]);
+	nfiles = argc - optind;
+	bodies = Calloc(nfiles, sizeof(char *));
+	lengths = Calloc(nfiles, sizeof(size_t));
+	dedup_init(&d, nfiles);
+
+	printf("%-24s %10s %10s %10s %8s  %s\n", "file", "bytes", "stage us", "hash us", "hash %", "same as");
+	for (i = 0; i < nfiles; i++) {
+		if ((fp = fopen(argv[optind + i], "r")) == NULL) {
+			fprintf(stderr, "%s: %s\n", argv[optind + i], strerror(errno));
+			continue;
+		}
+		store_fill_begin(&fill, (size_t)1 << 40);
+		while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+			store_fill_append(&fill, buf, n);
+		fclose(fp);
+		if (fill.failed || fill.len == 0) {
+			store_fill_abort(&fill);
+			continue;
+		}
+		bodies[i] = fill.buf;
+		lengths[i] = fill.len;
+
+		//staging copies the body in as the relay reads it, a block at a time
+		t = now_us();
+		for (r = 0; r < rounds; r++) {
+			store_fill_begin(&fill, (size_t)1 << 40);
+			for (at = 0; at < lengths[i]; at += sizeof(buf))
+				store_fill_append(&fill, bodies[i] + at, lengths[i] - at < sizeof(buf) ? lengths[i] - at : sizeof(buf));
+			store_fill_abort(&fill);
+		}
+		stageUs = (now_us() - t) / rounds;
+		t = now_us();
+		for (r = 0; r < rounds; r++)
+			hash = dedup_hash(bodies[i], lengths[i]);
+		hashUs = (now_us() - t) / rounds;
+		stageSum += stageUs;
+		hashSum += hashUs;
+
+		//a body seen before is shared if it is the same, as the proxy checks before sharing it;
+		//an entry's offset is the file it came from here
+		if ((j = dedup_find(&d, hash, lengths[i])) >= 0 && memcmp(bodies[d.blobs[j].offset], bodies[i], lengths[i]) == 0) {
+			dedup_get(&d, j);
+		}
+		else {
+			dedup_add(&d, hash, i, 0, 0, lengths[i]);
+			j = -1;
+		}
+		printf("%-24.24s %10zu %10.1f %10.1f %7.1f%%  %s\n", argv[optind + i], lengths[i], stageUs, hashUs,
+		       stageUs > 0 ? 100 * hashUs / stageUs : 0, j >= 0 ? argv[optind + d.blobs[j].offset] : "-");
+	}
+	if (d.stored > 0)
+		printf("pages hold %llu bytes, %llu stored, dedup ratio %.2f\n"
+		       "hashing adds %.1f us to the %.1f us of staging, %.1f%% on the fill path\n",
+		       (unsigned long long)d.logical, (unsigned long long)d.stored, dedup_ratio(&d),
+		       hashSum, stageSum, stageSum > 0 ? 100 * hashSum / stageSum : 0);
+	for (i = 0; i < nfiles; i++)
+		free(bodies[i]);
+	free(bodies);
+	free(lengths);
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * gzip.c - compressing responses on their way to the client
+ */
+
+#include "csapp.h"
+#include "gzip.h"
+#include "http.h"
+
+void gzip_init(gzip_t *g, bufpool_t *pool, int level, const char *types, size_t minLength, gzip_out_t *out, void *arg)
+{
+	memset(g, 0, sizeof(*g));
+	g->state = GZIP_HEAD;
+	g->pool = pool;
+	g->level = level;
+	g->types = types;
+	g->minLength = minLength;
+	g->out = out;
+	g->arg = arg;
+}
+
+/*
+ * gzip_type - whether contentType, parameters and all, is listed in
+ * types, separated by blanks or commas.  A listed type ending in '/'
+ * covers every type under it, as "text/" does text/html.
+ */
+int gzip_type(const char *types, const char *contentType)
+{
+	size_t len = strcspn(contentType, " \t;"), n;
+
+	while (*types != '\0') {
+		types += strspn(types, " \t,");
+		n = strcspn(types, " \t,");
+		if (n > 0 && types[n - 1] == '/' && n <= len && strncasecmp(types, contentType, n) == 0)
+			return 1;
+		if (n > 0 && n == len && strncasecmp(types, contentType, n) == 0)
+			return 1;
+		types += n;
+	}
+	return 0;
+}
+
+/* emit - hand c to the output and drop this reference to it */
+static int emit(gzip_t *g, struct bufChunk *c)
+{
+	int rc = c->len > 0 ? g->out(c, g->arg) : 0;
+
+	bufchunk_put(c);
+	return rc;
+}
+
+/* deflate_data - compress n bytes of data, emitting each chunk as it fills; flush Z_FINISH ends the stream */
+static int deflate_data(gzip_t *g, const char *data, size_t n, int flush)
+{
+	struct bufChunk *c;
+	int rc;
+
+	g->z.next_in = (Bytef *)data;
+	g->z.avail_in = n;
+	for (;;) {
+		if (g->outc == NULL && (g->outc = bufpool_get(g->pool)) == NULL)
+			return -1;
+		g->z.next_out = (Bytef *)g->outc->data + g->outc->len;
+		g->z.avail_out = g->pool->chunkSize - g->outc->len;
+		if ((rc = deflate(&g->z, flush)) == Z_STREAM_ERROR)
+			return -1;
+		g->outc->len = g->pool->chunkSize - g->z.avail_out;
+		if (g->z.avail_out == 0 || rc == Z_STREAM_END) {
+			c = g->outc;
+			g->outc = NULL;
+			if (emit(g, c) < 0)
+				return -1;
+		}
+		if (rc == Z_STREAM_END || (flush != Z_FINISH && g->z.avail_in == 0 && g->z.avail_out > 0))
+			return 0;
+	}
+}
+
+/* compressible - whether the response with this head is worth compressing and may be */
+static int compressible(gzip_t *g, const char *head)
+{
+	char value[256];
+	int status;
+
+	if (sscanf(head, "HTTP/%*d.%*d %d", &status) != 1 || status != 200)
+		return 0;
+	if (http_header(head, "Content-Encoding", value, sizeof(value)) == 0 ||
+	    http_header(head, "Transfer-Encoding", value, sizeof(value)) == 0)
+		return 0;  //relayed as sent, so a chunked body stays chunked
+	if (http_header(head, "Cache-Control", value, sizeof(value)) == 0 && strstr(value, "no-transform") != NULL)
+		return 0;
+	if (http_header(head, "Content-Type", value, sizeof(value)) < 0 || !gzip_type(g->types, value))
+		return 0;
+	if (http_header(head, "Content-Length", value, sizeof(value)) == 0 && strtoull(value, NULL, 10) < g->minLength)
+		return 0;
+	return 1;
+}
+
+/* rewrite_head - the first hlen bytes of head as sent compressed, NULL if they do not fit in a chunk */
+static struct bufChunk *rewrite_head(gzip_t *g, const char *head, size_t hlen)
+{
+	struct bufChunk *c = bufpool_get(g->pool);
+	const char *line = head, *end = head + hlen, *eol, *tag;
+	size_t size = g->pool->chunkSize, n, m;
+	int vary = 0, w;
+
+	if (c == NULL)
+		return NULL;
+	for (; line < end; line += n) {
+		eol = memchr(line, '\n', end - line);
+		n = eol != NULL ? (size_t)(eol - line) + 1 : (size_t)(end - line);
+		for (m = n; m > 0 && (line[m - 1] == '\n' || line[m - 1] == '\r'); m--)
+			;
+		if (m == 0)  //the blank line, added back below
+			break;
+		if (strncasecmp(line, "Content-Length:", 15) == 0)
+			continue;  //unknown until the body is compressed, the client reads to the close
+		if (strncasecmp(line, "Vary:", 5) == 0) {
+			w = snprintf(c->data + c->len, size - c->len, "%.*s, Accept-Encoding\r\n", (int)m, line);
+			vary = 1;
+		}
+		else if (strncasecmp(line, "ETag:", 5) == 0) {
+			for (tag = line + 5; tag < line + m && (*tag == ' ' || *tag == '\t'); tag++)
+				;
+			w = snprintf(c->data + c->len, size - c->len, "ETag: %s%.*s\r\n",  //a different body, not a strong match
+				     strncmp(tag, "W/", 2) == 0 ? "" : "W/", (int)(line + m - tag), tag);
+		}
+		else {
+			w = snprintf(c->data + c->len, size - c->len, "%.*s\r\n", (int)m, line);
+		}
+		if (w < 0 || (size_t)w >= size - c->len) {
+			bufchunk_put(c);
+			return NULL;
+		}
+		c->len += w;
+	}
+	w = snprintf(c->data + c->len, size - c->len, "%sContent-Encoding: gzip\r\n\r\n",
+		     vary ? "" : "Vary: Accept-Encoding\r\n");
+	if (w < 0 || (size_t)w >= size - c->len) {
+		bufchunk_put(c);
+		return NULL;
+	}
+	c->len += w;
+	return c;
+}
+
+/* pass - give up on compressing: send the head collected so far and the rest of c from byte at as they are */
+static int pass(gzip_t *g, struct bufChunk *c, size_t at)
+{
+	struct bufChunk *rest;
+
+	g->state = GZIP_PASS;
+	if (g->head != NULL) {
+		rest = g->head;
+		g->head = NULL;
+		if (emit(g, rest) < 0)
+			return -1;
+	}
+	if (c == NULL || at == c->len)
+		return 0;
+	if ((rest = bufpool_get(g->pool)) == NULL)
+		return -1;
+	memcpy(rest->data, c->data + at, c->len - at);
+	rest->len = c->len - at;
+	return emit(g, rest);
+}
+
+/* start_body - the head, hlen bytes of g->head, is complete: rewrite it and deflate from there on, or pass */
+static int start_body(gzip_t *g, size_t hlen, struct bufChunk *c, size_t at)
+{
+	struct bufChunk *head = g->head, *rewritten;
+
+	if (!compressible(g, head->data) || (rewritten = rewrite_head(g, head->data, hlen)) == NULL)
+		return pass(g, c, at);
+	if (deflateInit2(&g->z, g->level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {  //+16 for a gzip wrapper
+		bufchunk_put(rewritten);
+		return pass(g, c, at);
+	}
+	g->state = GZIP_BODY;
+	g->head = NULL;
+	if (emit(g, rewritten) < 0 || deflate_data(g, head->data + hlen, head->len - hlen, Z_NO_FLUSH) < 0) {
+		bufchunk_put(head);
+		return -1;
+	}
+	bufchunk_put(head);
+	return deflate_data(g, c->data + at, c->len - at, Z_NO_FLUSH);
+}
+
+/* gzip_feed - the next chunk of the response, which the caller keeps its reference to */
+int gzip_feed(gzip_t *g, struct bufChunk *c)
+{
+	struct bufChunk *h;
+	size_t take;
+	char *end, *crlf, *lf;
+
+	if (g->state == GZIP_PASS)
+		return g->out(c, g->arg);
+	if (g->state == GZIP_BODY)
+		return deflate_data(g, c->data, c->len, Z_NO_FLUSH);
+	if (g->head == NULL && (g->head = bufpool_get(g->pool)) == NULL)
+		return -1;
+	h = g->head;
+	take = c->len < g->pool->chunkSize - 1 - h->len ? c->len : g->pool->chunkSize - 1 - h->len;
+	memcpy(h->data + h->len, c->data, take);
+	h->len += take;
+	h->data[h->len] = '\0';
+	crlf = strstr(h->data, "\r\n\r\n");
+	lf = strstr(h->data, "\n\n");
+	if (crlf != NULL && (lf == NULL || crlf < lf))
+		end = crlf + 4;
+	else
+		end = lf != NULL ? lf + 2 : NULL;
+	if (end == NULL)  //wait for the rest of the head, unless it is too long to be rewritten
+		return h->len < g->pool->chunkSize - 1 ? 0 : pass(g, c, take);
+	return start_body(g, end - h->data, c, take);
+}
+
+/* gzip_finish - the response has ended: end the compressed stream, or send what is left of a head */
+int gzip_finish(gzip_t *g)
+{
+	if (g->state == GZIP_HEAD)
+		return pass(g, NULL, 0);
+	if (g->state == GZIP_BODY)
+		return deflate_data(g, NULL, 0, Z_FINISH);
+	return 0;
+}
+
+void gzip_free(gzip_t *g)
+{
+	if (g->state == GZIP_BODY)
+		deflateEnd(&g->z);
+	if (g->head != NULL)
+		bufchunk_put(g->head);
+	if (g->outc != NULL)
+		bufchunk_put(g->outc);
+	g->head = g->outc = NULL;
+	g->state = GZIP_PASS;
+}
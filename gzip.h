@@ -0,0 +1,46 @@
+/*
+ * gzip.h - compressing responses on their way to the client
+ *
+ * A relay hands each chunk of the origin's response to gzip_feed as it
+ * arrives.  The head is collected first.  A 200 response of one of the
+ * configured content types, not already encoded and not too short, is
+ * then sent on with its head rewritten (Content-Length dropped, since
+ * the compressed length is only known at the end, Content-Encoding:
+ * gzip and Vary: Accept-Encoding added) and its body deflated as it
+ * streams.  Anything else passes through untouched, chunk by chunk.
+ * Output goes to a callback in pool chunks, so what the client is sent
+ * and what the cache keeps are the same bytes.
+ */
+#ifndef __GZIP_H__
+#define __GZIP_H__
+
+#include <zlib.h>
+#include "bufpool.h"
+
+#define GZIP_HEAD  0              /* collecting the response head */
+#define GZIP_BODY  1              /* deflating the body */
+#define GZIP_PASS  2              /* passing the response through as it is */
+
+/* Takes its own reference to c if it keeps it; returns -1 to stop the relay */
+typedef int gzip_out_t(struct bufChunk *c, void *arg);
+
+typedef struct {
+	int state;
+	z_stream z;                   //valid while GZIP_BODY
+	struct bufChunk *head;        //head so far while GZIP_HEAD
+	struct bufChunk *outc;        //chunk deflate is filling
+	bufpool_t *pool;
+	int level;
+	const char *types;            //compressible content types, see gzip_type
+	size_t minLength;             //responses declaring fewer bytes are not worth it
+	gzip_out_t *out;
+	void *arg;
+} gzip_t;
+
+void gzip_init(gzip_t *g, bufpool_t *pool, int level, const char *types, size_t minLength, gzip_out_t *out, void *arg);
+int gzip_feed(gzip_t *g, struct bufChunk *c);
+int gzip_finish(gzip_t *g);
+void gzip_free(gzip_t *g);
+int gzip_type(const char *types, const char *contentType);
+
+#endif /* __GZIP_H__ */
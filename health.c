@@ -0,0 +1,162 @@
+/*
+ * health.c - per-origin circuit breakers
+ *
+ * Only the parent changes the circuits.  Children report how their
+ * requests went through the note pipe, and only read their copy.
+ */
+
+#include "csapp.h"
+#include "health.h"
+
+void health_init(health_t *h, int threshold, int openMs)
+{
+	int i;
+
+	memset(h, 0, sizeof(*h));
+	h->threshold = threshold;
+	h->openMs = openMs;
+	for (i = 0; i < HEALTH_CIRCUITS; i++)
+		h->origins[i].probe = -1;
+}
+
+/* find - the circuit of host:port, NULL if it has none */
+static struct originHealth *find(health_t *h, const char *host, int port)
+{
+	struct originHealth *o;
+	int first = admit_origin(host, port), i;
+
+	for (i = 0; i < HEALTH_WAYS; i++) {
+		o = &h->origins[(first + i) % HEALTH_CIRCUITS];
+		if (o->host[0] != '\0' && o->port == port && strcmp(o->host, host) == 0)
+			return o;
+	}
+	return NULL;
+}
+
+/*
+ * take - the circuit of host:port, taking a free one of its ways, or
+ * the closed one that failed longest ago, if it has none.  NULL if every
+ * way is open, half-open or being probed.
+ */
+static struct originHealth *take(health_t *h, const char *host, int port)
+{
+	struct originHealth *o, *best = NULL;
+	int first = admit_origin(host, port), i;
+
+	if ((o = find(h, host, port)) != NULL)
+		return o;
+	for (i = 0; i < HEALTH_WAYS; i++) {
+		o = &h->origins[(first + i) % HEALTH_CIRCUITS];
+		if (o->host[0] == '\0') {
+			best = o;
+			break;
+		}
+		if (o->state == HEALTH_CLOSED && o->probe < 0 && (best == NULL || o->failed < best->failed))
+			best = o;
+	}
+	if (best == NULL)
+		return NULL;
+	memset(best, 0, sizeof(*best));
+	snprintf(best->host, sizeof(best->host), "%s", host);
+	best->port = port;
+	best->probe = -1;
+	return best;
+}
+
+/* update - move an open circuit whose time is up to half-open, and give up on a lost trial */
+static void update(struct originHealth *o, uint64_t now)
+{
+	if (o->state == HEALTH_OPEN && now >= o->until) {
+		o->state = HEALTH_HALF_OPEN;
+		o->trial = 0;
+	}
+	else if (o->state == HEALTH_HALF_OPEN && o->trial && now >= o->until) {
+		o->trial = 0;  //its child never reported back
+	}
+}
+
+/* health_allow - whether a request for host:port would be let through now, without taking the trial */
+int health_allow(health_t *h, const char *host, int port, uint64_t now)
+{
+	struct originHealth *o;
+
+	if (h->threshold <= 0 || (o = find(h, host, port)) == NULL)
+		return 1;
+	update(o, now);
+	return o->state == HEALTH_CLOSED || (o->state == HEALTH_HALF_OPEN && !o->trial);
+}
+
+/*
+ * health_begin - like health_allow for a request about to connect to
+ * host:port.  A request let through a half-open circuit is its trial.
+ */
+int health_begin(health_t *h, const char *host, int port, uint64_t now)
+{
+	struct originHealth *o;
+
+	if (!health_allow(h, host, port, now))
+		return 0;
+	if (h->threshold > 0 && (o = find(h, host, port)) != NULL && o->state == HEALTH_HALF_OPEN) {
+		o->trial = 1;
+		o->until = now + h->openMs;
+	}
+	return 1;
+}
+
+/* health_success - host:port answered, closing its circuit and giving it back */
+void health_success(health_t *h, const char *host, int port)
+{
+	struct originHealth *o;
+
+	if (h->threshold <= 0 || (o = find(h, host, port)) == NULL)
+		return;
+	o->failures = 0;
+	o->state = HEALTH_CLOSED;
+	o->trial = 0;
+	if (o->probe < 0)  //else health_probed gives it back
+		o->host[0] = '\0';
+}
+
+/*
+ * health_failure - a connect to host:port failed or its response never
+ * started.  Opens the circuit at the threshold, or at once if it was a
+ * half-open trial.  Returns 1 if it opened the circuit, 0 otherwise.
+ */
+int health_failure(health_t *h, const char *host, int port, uint64_t now)
+{
+	struct originHealth *o;
+
+	if (h->threshold <= 0 || (o = take(h, host, port)) == NULL)
+		return 0;
+	o->failures++;
+	o->failed = now;
+	if (o->state == HEALTH_HALF_OPEN || (o->state == HEALTH_CLOSED && o->failures >= h->threshold)) {
+		if (o->state == HEALTH_CLOSED)
+			h->opened++;
+		o->state = HEALTH_OPEN;
+		o->until = now + h->openMs;
+		o->trial = 0;
+		return 1;
+	}
+	return 0;
+}
+
+/* health_probed - an active probe found the origin of circuit up (accepting connections) or not */
+void health_probed(health_t *h, int circuit, int up, uint64_t now)
+{
+	struct originHealth *o = &h->origins[circuit];
+
+	o->probe = -1;
+	if (o->state == HEALTH_CLOSED && o->failures == 0) {
+		o->host[0] = '\0';  //it answered a request while probed
+		return;
+	}
+	if (o->state != HEALTH_OPEN)
+		return;
+	if (up) {
+		o->state = HEALTH_HALF_OPEN;  //the next request is the trial
+		o->trial = 0;
+	}
+	else
+		o->until = now + h->openMs;
+}
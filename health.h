@@ -0,0 +1,57 @@
+/*
+ * health.h - per-origin circuit breakers
+ *
+ * Every origin, by host and port, has a circuit.  It is closed while
+ * the origin answers.  After
+ * threshold failures in a row, failed connects or responses that never
+ * started, it opens: requests for the origin fail at once instead of
+ * each waiting out a connect or first byte timeout.  After openMs, or
+ * sooner if an active probe finds the origin accepting connections
+ * again, it is half-open and lets a single request through as a trial,
+ * whose outcome closes the circuit or opens it for another openMs.
+ *
+ * Circuits are kept in a table of HEALTH_CIRCUITS, where an origin's
+ * circuit is one of the HEALTH_WAYS from its admission bucket on.  An
+ * origin without one is closed; one is taken on its first failure,
+ * reusing the least recently failed closed circuit if every way is
+ * taken, and given back when the origin answers.
+ */
+#ifndef __HEALTH_H__
+#define __HEALTH_H__
+
+#include <stdint.h>
+#include "admit.h"
+
+#define HEALTH_CLOSED     0
+#define HEALTH_OPEN       1
+#define HEALTH_HALF_OPEN  2
+
+#define HEALTH_CIRCUITS   ADMIT_BUCKETS
+#define HEALTH_WAYS       8
+
+struct originHealth {
+	char host[256];             //origin the circuit is for, empty while it is free
+	int port;
+	int state;
+	int failures;               //in a row
+	uint64_t until;             //ms: OPEN until then, or when a HALF_OPEN trial is given up on
+	int trial;                  //a HALF_OPEN trial request is out
+	uint64_t failed;            //ms of the last failure
+	int probe;                  //socket of a probe in flight, -1 for none
+};
+
+typedef struct {
+	int threshold;              //failures in a row that open a circuit
+	int openMs;                 //time an open circuit fails requests before a trial
+	unsigned long opened;       //circuits opened in all
+	struct originHealth origins[HEALTH_CIRCUITS];
+} health_t;
+
+void health_init(health_t *h, int threshold, int openMs);
+int health_allow(health_t *h, const char *host, int port, uint64_t now);
+int health_begin(health_t *h, const char *host, int port, uint64_t now);
+void health_success(health_t *h, const char *host, int port);
+int health_failure(health_t *h, const char *host, int port, uint64_t now);
+void health_probed(health_t *h, int circuit, int up, uint64_t now);
+
+#endif /* __HEALTH_H__ */
@@ -0,0 +1,238 @@
+/*
+ * http.c - HTTP parsing helpers shared by the proxy and its tools
+ */
+
+#include "csapp.h"
+#include "http.h"
+#include <stdarg.h>
+
+/*
+ * parse_uri - URI parser
+ *
+ * Given a URI from an HTTP proxy GET request (i.e., a URL), extract
+ * the host name, path name, and port.  The memory for hostname and
+ * pathname must already be allocated and should be at least MAXLINE
+ * bytes. Return -1 if there are any problems.
+ */
+int parse_uri(char *uri, char *hostname, char *pathname, int *port)
+{
+    char *hostbegin;
+    char *hostend;
+    char *pathbegin;
+    int len;
+
+    if (strncasecmp(uri, "http://", 7) != 0) {
+	hostname[0] = '\0';
+	return -1;
+    }
+
+    /* Extract the host name */
+    hostbegin = uri + 7;
+    hostend = strpbrk(hostbegin, " :/\r\n\0");
+    if (hostend == NULL)
+	hostend = hostbegin + strlen(hostbegin);
+    len = hostend - hostbegin;
+    strncpy(hostname, hostbegin, len);
+    hostname[len] = '\0';
+
+    /* Extract the port number */
+    *port = 80; /* default */
+    if (*hostend == ':')
+	*port = atoi(hostend + 1);
+
+    /* Extract the path */
+    pathbegin = strchr(hostbegin, '/');
+    if (pathbegin == NULL) {
+	pathname[0] = '\0';
+    }
+    else {
+	pathbegin++;
+	strcpy(pathname, pathbegin);
+    }
+
+    return 0;
+}
+
+/*
+ * http_header - copy the value of header name from head, a request or
+ * response line followed by its headers, into value without surrounding
+ * blanks.  Returns -1 if head has no such header or its value does not
+ * fit in size bytes.
+ */
+int http_header(const char *head, const char *name, char *value, size_t size)
+{
+	size_t nameLen = strlen(name), len;
+	const char *line, *end;
+
+	for (line = strchr(head, '\n'); line != NULL && line[1] != '\0'; line = strchr(line, '\n')) {
+		line++;
+		if (*line == '\r' || *line == '\n')  //blank line, end of the headers
+			break;
+		if (strncasecmp(line, name, nameLen) != 0 || line[nameLen] != ':')
+			continue;
+		line += nameLen + 1;
+		while (*line == ' ' || *line == '\t')
+			line++;
+		end = line + strcspn(line, "\r\n");
+		while (end > line && (end[-1] == ' ' || end[-1] == '\t'))
+			end--;
+		if ((len = end - line) >= size)
+			return -1;
+		memcpy(value, line, len);
+		value[len] = '\0';
+		return 0;
+	}
+	return -1;
+}
+
+/*
+ * http_accepts - whether an Accept-Encoding value lets a response be
+ * sent with coding: it is listed, or "*" is, with a q value above 0
+ */
+int http_accepts(const char *value, const char *coding)
+{
+	char item[64], *token, *q;
+	double weight;
+	int star = 0;
+	size_t n;
+
+	while (*value != '\0') {
+		n = strcspn(value, ",");
+		if (n < sizeof(item)) {
+			memcpy(item, value, n);
+			item[n] = '\0';
+			weight = (q = strstr(item, "q=")) != NULL ? atof(q + 2) : 1;
+			token = item + strspn(item, " \t");
+			token[strcspn(token, " \t;")] = '\0';
+			if (strcasecmp(token, coding) == 0)
+				return weight > 0;
+			if (strcmp(token, "*") == 0)
+				star = weight > 0;
+		}
+		value += n;
+		if (*value == ',')
+			value++;
+	}
+	return star;
+}
+
+/*
+ * http_ranges - parse a Range value against an object of length bytes.
+ * Returns the number of satisfiable ranges stored in ranges, 0 if there
+ * are none (416), or -1 if the value is not a byte range set or holds
+ * more than max ranges, in which case the Range is ignored and the whole
+ * object sent.  Last positions past the end are cut to it.
+ */
+int http_ranges(const char *value, unsigned long long length, struct httpRange *ranges, int max)
+{
+	unsigned long long first, last;
+	int n = 0, specs = 0;
+	char *end;
+
+	if (strncasecmp(value, "bytes=", 6) != 0)
+		return -1;
+	for (value += 6; ; value++) {
+		value += strspn(value, " \t");
+		if (*value == ',')  //empty list elements are allowed
+			continue;
+		if (*value == '\0')
+			break;
+		if (++specs > max)
+			return -1;
+		if (*value == '-') {  //suffix: the last so many bytes
+			if (!isdigit((unsigned char)value[1]))
+				return -1;
+			last = strtoull(value + 1, &end, 10);
+			if (last > 0 && length > 0) {
+				ranges[n].first = last < length ? length - last : 0;
+				ranges[n++].last = length - 1;
+			}
+		}
+		else {
+			if (!isdigit((unsigned char)*value))
+				return -1;
+			first = strtoull(value, &end, 10);
+			if (*end++ != '-')
+				return -1;
+			if (!isdigit((unsigned char)*end))
+				last = length - 1;  //to the end
+			else if ((last = strtoull(end, &end, 10)) < first)
+				return -1;
+			if (first < length) {
+				ranges[n].first = first;
+				ranges[n++].last = last < length ? last : length - 1;
+			}
+		}
+		value = end + strspn(end, " \t");
+		if (*value == '\0')
+			break;
+		if (*value != ',')
+			return -1;
+	}
+	return specs > 0 ? n : -1;
+}
+
+/* http_range_byname - HTTP_RANGE_OFF, HTTP_RANGE_ON or HTTP_RANGE_FILL by name, -1 if unknown */
+int http_range_byname(const char *name)
+{
+	if (strcmp(name, "off") == 0)
+		return HTTP_RANGE_OFF;
+	if (strcmp(name, "on") == 0)
+		return HTTP_RANGE_ON;
+	if (strcmp(name, "fill") == 0)
+		return HTTP_RANGE_FILL;
+	return -1;
+}
+
+void http_head_init(http_head_t *h)
+{
+	h->len = 0;
+	h->overflow = 0;
+}
+
+/* http_head_add - append a formatted line (or lines) to h */
+void http_head_add(http_head_t *h, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (h->overflow)
+		return;
+	va_start(ap, fmt);
+	n = vsnprintf(h->buf + h->len, sizeof(h->buf) - h->len, fmt, ap);
+	va_end(ap);
+	if (n < 0 || (size_t)n >= sizeof(h->buf) - h->len)
+		h->overflow = 1;
+	else
+		h->len += n;
+}
+
+/*
+ * http_head_send - send h to fd with one send call where the socket takes
+ * it all, which it does for any head that fits its buffer.  flags are
+ * passed on: MSG_MORE when a body follows, so head and body can share a
+ * packet, or MSG_DONTWAIT, in which case a full socket ends the send
+ * early.  Never raises SIGPIPE.  Returns the bytes sent, or -1 with
+ * errno set (EMSGSIZE if the head overflowed).
+ */
+ssize_t http_head_send(int fd, http_head_t *h, int flags)
+{
+	size_t sent = 0;
+	ssize_t m;
+
+	if (h->overflow) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	while (sent < h->len) {
+		if ((m = send(fd, h->buf + sent, h->len - sent, flags | MSG_NOSIGNAL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) && sent > 0)
+				break;
+			return -1;
+		}
+		sent += m;
+	}
+	return sent;
+}
@@ -0,0 +1,45 @@
+/*
+ * http.h - HTTP parsing helpers shared by the proxy and its tools
+ */
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define HTTP_HEAD_MAX 16384   /* bytes of request or status line plus headers */
+
+/* How Range requests are served, the range_requests setting */
+#define HTTP_RANGE_OFF   0    /* never, the whole object is sent */
+#define HTTP_RANGE_ON    1    /* from cached objects; a miss asks the origin for the range */
+#define HTTP_RANGE_FILL  2    /* as on, and a miss also caches the whole object for later ranges */
+
+#define HTTP_RANGES_MAX  16   /* ranges served in one response, more are answered in full */
+
+/* A satisfiable byte range, both ends included */
+struct httpRange {
+	unsigned long long first, last;
+};
+
+/*
+ * A message head built in one buffer, so it goes out in one send and,
+ * unless it is larger than a segment, one packet.
+ */
+typedef struct {
+	char buf[HTTP_HEAD_MAX];
+	size_t len;
+	int overflow;             //a line did not fit, the head must not be sent
+} http_head_t;
+
+int parse_uri(char *uri, char *hostname, char *pathname, int *port);
+int http_header(const char *head, const char *name, char *value, size_t size);
+int http_accepts(const char *value, const char *coding);
+int http_ranges(const char *value, unsigned long long length, struct httpRange *ranges, int max);
+int http_range_byname(const char *name);
+
+void http_head_init(http_head_t *h);
+void http_head_add(http_head_t *h, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+ssize_t http_head_send(int fd, http_head_t *h, int flags);
+
+#endif /* __HTTP_H__ */
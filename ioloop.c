@@ -0,0 +1,901 @@
+/*
+ * ioloop.c - completion based I/O loop with io_uring and epoll backends
+ *
+ * The io_uring backend talks to the kernel through the raw syscalls and
+ * one shared mapping of the submission and completion rings.  Queued
+ * operations only fill in submission entries; ioloop_run() submits them
+ * all and waits for completions in a single io_uring_enter().
+ *
+ * The epoll backend queues reads (and accepts) and writes per fd,
+ * registers interest one-shot and performs the operations itself, in
+ * order, when the fd is ready.  Sockets are read and written with
+ * MSG_DONTWAIT so a stale readiness report can never block the loop;
+ * accepts and pipe reads cannot be made non-blocking per call, so only
+ * one is done per report.  Regular files, which epoll cannot watch, are
+ * read and written straight away.
+ */
+
+#include "csapp.h"
+#include "ioloop.h"
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define IOLOOP_OP_ACCEPT 1
+#define IOLOOP_OP_READ   2
+#define IOLOOP_OP_WRITE  3
+#define IOLOOP_OP_POLL   4
+
+#define EPOLL_BATCH 64
+
+static const char *backendNames[] = { "auto", "io_uring", "epoll" };
+
+/* op_get - a free operation record */
+static ioloop_op_t *op_get(ioloop_t *loop)
+{
+	ioloop_op_t *op = loop->freeOps;
+
+	if (op != NULL)
+		loop->freeOps = op->next;
+	else if ((op = malloc(sizeof(*op))) == NULL)
+		return NULL;
+	memset(op, 0, sizeof(*op));
+	return op;
+}
+
+static void op_put(ioloop_t *loop, ioloop_op_t *op)
+{
+	op->next = loop->freeOps;
+	loop->freeOps = op;
+}
+
+/* complete - report an operation's result and recycle it */
+static void complete(ioloop_t *loop, ioloop_op_t *op, int res)
+{
+	ioloop_cb_t *cb = op->cb;
+	void *arg = op->arg;
+
+	op_put(loop, op);
+	loop->completions++;
+	cb(loop, res, arg);
+}
+
+/*
+ * io_uring backend
+ */
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(ioloop_t *loop, unsigned submit, unsigned wait, int timeoutMs)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.sigmask_sz = _NSIG / 8;
+	if (wait && timeoutMs >= 0) {
+		ts.tv_sec = timeoutMs / 1000;
+		ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+	}
+	loop->enters++;
+	return syscall(__NR_io_uring_enter, loop->ringfd, submit, wait, flags | IORING_ENTER_EXT_ARG,
+		       &arg, sizeof(arg));
+}
+
+/* uring_submit - hand every queued entry to the kernel without waiting */
+static void uring_submit(ioloop_t *loop)
+{
+	int rc;
+
+	while (loop->pending > 0) {
+		if ((rc = uring_enter(loop, loop->pending, 0, -1)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		loop->pending -= rc;
+	}
+}
+
+static int uring_init(ioloop_t *loop, unsigned entries)
+{
+	struct io_uring_params p;
+	size_t sqBytes, cqBytes;
+
+	memset(&p, 0, sizeof(p));
+	if ((loop->ringfd = uring_setup(entries, &p)) < 0)
+		return -1;
+	//one mapping for both rings, completions never dropped, timeouts on enter
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP) ||
+	    !(p.features & IORING_FEAT_EXT_ARG)) {
+		close(loop->ringfd);
+		return -1;
+	}
+	sqBytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqBytes = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	loop->ringBytes = sqBytes > cqBytes ? sqBytes : cqBytes;
+	loop->ring = mmap(NULL, loop->ringBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			  loop->ringfd, IORING_OFF_SQ_RING);
+	if (loop->ring == MAP_FAILED) {
+		close(loop->ringfd);
+		return -1;
+	}
+	loop->sqesBytes = p.sq_entries * sizeof(struct io_uring_sqe);
+	loop->sqes = mmap(NULL, loop->sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			  loop->ringfd, IORING_OFF_SQES);
+	if (loop->sqes == MAP_FAILED) {
+		munmap(loop->ring, loop->ringBytes);
+		close(loop->ringfd);
+		return -1;
+	}
+	loop->sqHead = (unsigned *)(loop->ring + p.sq_off.head);
+	loop->sqTail = (unsigned *)(loop->ring + p.sq_off.tail);
+	loop->sqMask = (unsigned *)(loop->ring + p.sq_off.ring_mask);
+	loop->sqArray = (unsigned *)(loop->ring + p.sq_off.array);
+	loop->cqHead = (unsigned *)(loop->ring + p.cq_off.head);
+	loop->cqTail = (unsigned *)(loop->ring + p.cq_off.tail);
+	loop->cqMask = (unsigned *)(loop->ring + p.cq_off.ring_mask);
+	loop->cqes = (struct io_uring_cqe *)(loop->ring + p.cq_off.cqes);
+	loop->sqEntries = p.sq_entries;
+	return 0;
+}
+
+/* uring_sqe - next free submission entry, submitting the queue if it is full */
+static struct io_uring_sqe *uring_sqe(ioloop_t *loop)
+{
+	unsigned tail = *loop->sqTail;
+	struct io_uring_sqe *sqe;
+
+	if (tail - __atomic_load_n(loop->sqHead, __ATOMIC_ACQUIRE) == loop->sqEntries) {
+		uring_submit(loop);
+		if (tail - __atomic_load_n(loop->sqHead, __ATOMIC_ACQUIRE) == loop->sqEntries)
+			return NULL;
+	}
+	sqe = &loop->sqes[tail & *loop->sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	loop->sqArray[tail & *loop->sqMask] = tail & *loop->sqMask;
+	return sqe;
+}
+
+/* uring_queue - fill in and publish the submission entry for op */
+static int uring_queue(ioloop_t *loop, ioloop_op_t *op)
+{
+	struct io_uring_sqe *sqe = uring_sqe(loop);
+	unsigned i;
+
+	if (sqe == NULL)
+		return -1;
+	sqe->fd = op->fd;
+	for (i = 0; i < loop->nfiles; i++) {
+		if (loop->files[i] == op->fd) {
+			sqe->fd = i;
+			sqe->flags |= IOSQE_FIXED_FILE;
+			break;
+		}
+	}
+	sqe->addr = (uint64_t)(uintptr_t)op->buf;
+	sqe->len = op->len;
+	sqe->user_data = (uint64_t)(uintptr_t)op;
+	if (op->type == IOLOOP_OP_ACCEPT) {
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->addr = (uint64_t)(uintptr_t)op->addr;
+		sqe->addr2 = (uint64_t)(uintptr_t)op->addrlen;
+		sqe->len = 0;
+	}
+	else if (op->type == IOLOOP_OP_POLL) {
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->addr = 0;
+		sqe->len = 0;
+		sqe->poll32_events = op->len;
+	}
+	else {
+		sqe->opcode = op->type == IOLOOP_OP_READ ? IORING_OP_READ : IORING_OP_WRITE;
+		sqe->off = (uint64_t)-1;  //current position, sockets and pipes ignore it
+		for (i = 0; i < loop->nbufs; i++) {
+			char *base = loop->bufs[i].iov_base;
+
+			if (op->buf >= base && op->buf + op->len <= base + loop->bufs[i].iov_len) {
+				sqe->opcode = op->type == IOLOOP_OP_READ ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+				sqe->buf_index = i;
+				break;
+			}
+		}
+	}
+	__atomic_store_n(loop->sqTail, *loop->sqTail + 1, __ATOMIC_RELEASE);
+	loop->pending++;
+	return 0;
+}
+
+/* uring_reap - report every completion the kernel has posted */
+static int uring_reap(ioloop_t *loop)
+{
+	unsigned head = *loop->cqHead;
+	struct io_uring_cqe *cqe;
+	ioloop_op_t *op;
+	int n = 0, res;
+
+	while (head != __atomic_load_n(loop->cqTail, __ATOMIC_ACQUIRE)) {
+		cqe = &loop->cqes[head & *loop->cqMask];
+		op = (ioloop_op_t *)(uintptr_t)cqe->user_data;
+		res = cqe->res;
+		head++;
+		__atomic_store_n(loop->cqHead, head, __ATOMIC_RELEASE);  //free the entry before the callback queues more
+		complete(loop, op, res);
+		n++;
+	}
+	return n;
+}
+
+static int uring_run(ioloop_t *loop, int timeoutMs)
+{
+	int rc, n;
+
+	if ((n = uring_reap(loop)) > 0) {
+		uring_submit(loop);
+		return n;
+	}
+	rc = uring_enter(loop, loop->pending, 1, timeoutMs);
+	if (rc >= 0)
+		loop->pending -= rc;
+	else if (errno != EINTR && errno != ETIME && errno != EBUSY)
+		return -1;
+	return uring_reap(loop);
+}
+
+/*
+ * epoll backend
+ */
+
+/* fd_state - bookkeeping for fd, growing the table as needed */
+static struct ioloop_fd *fd_state(ioloop_t *loop, int fd)
+{
+	struct ioloop_fd *fds;
+	int n;
+
+	if (fd >= loop->nfds) {
+		for (n = loop->nfds ? loop->nfds : 64; n <= fd; n *= 2)
+			;
+		if ((fds = realloc(loop->fds, n * sizeof(*fds))) == NULL)
+			return NULL;
+		memset(fds + loop->nfds, 0, (n - loop->nfds) * sizeof(*fds));
+		loop->fds = fds;
+		loop->nfds = n;
+	}
+	return &loop->fds[fd];
+}
+
+/* epoll_arm - register one-shot interest in whatever fd is waiting for */
+static int epoll_arm(ioloop_t *loop, int fd)
+{
+	struct ioloop_fd *st = &loop->fds[fd];
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLONESHOT | (st->rd ? EPOLLIN : 0) | (st->wr ? EPOLLOUT : 0);
+	ev.data.fd = fd;
+	if (!st->rd && !st->wr)
+		return 0;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev) == 0)
+		return 0;
+	if (errno != ENOENT)
+		return -1;
+	return epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/*
+ * epoll_try - attempt op without blocking, -EAGAIN if the fd is not ready.
+ * *again is cleared when the attempt could not use MSG_DONTWAIT (accepts,
+ * pipes), so it is only safe once per readiness report.
+ */
+static int epoll_try(ioloop_op_t *op, int *again)
+{
+	ssize_t rc;
+
+	*again = 0;
+	if (op->type == IOLOOP_OP_POLL)
+		return op->len;  //ready is all it waits for; the caller's I/O may not drain it
+	if (op->type == IOLOOP_OP_ACCEPT)
+		rc = accept(op->fd, op->addr, op->addrlen);
+	else if (op->type == IOLOOP_OP_READ) {
+		if ((rc = recv(op->fd, op->buf, op->len, MSG_DONTWAIT)) < 0 && errno == ENOTSOCK)
+			rc = read(op->fd, op->buf, op->len);
+		else
+			*again = 1;
+	}
+	else {
+		if ((rc = send(op->fd, op->buf, op->len, MSG_DONTWAIT)) < 0 && errno == ENOTSOCK)
+			rc = write(op->fd, op->buf, op->len);
+		else
+			*again = 1;
+	}
+	if (rc < 0)
+		return errno == EWOULDBLOCK ? -EAGAIN : -errno;
+	return rc;
+}
+
+static int epoll_queue(ioloop_t *loop, ioloop_op_t *op)
+{
+	struct ioloop_fd *st = fd_state(loop, op->fd);
+	ioloop_op_t **head, **tail;
+	int again, out;
+
+	if (st == NULL)
+		return -1;
+	out = op->type == IOLOOP_OP_WRITE || (op->type == IOLOOP_OP_POLL && !(op->len & POLLIN));
+	head = out ? &st->wr : &st->rd;
+	tail = out ? &st->wrTail : &st->rdTail;
+	op->next = NULL;
+	if (*head != NULL) {  //already armed for this direction
+		(*tail)->next = op;
+		*tail = op;
+		return 0;
+	}
+	*head = *tail = op;
+	if (epoll_arm(loop, op->fd) == 0)
+		return 0;
+	*head = *tail = NULL;
+	if (errno != EPERM)
+		return -1;
+	//a regular file, always ready: do it now and report it on the next pass
+	op->len = epoll_try(op, &again);
+	op->next = NULL;
+	if (loop->doneTail)
+		loop->doneTail->next = op;
+	else
+		loop->done = op;
+	loop->doneTail = op;
+	return 0;
+}
+
+static int epoll_run(ioloop_t *loop, int timeoutMs)
+{
+	struct epoll_event evs[EPOLL_BATCH];
+	ioloop_op_t *op, *done;
+	int i, n, fd, res, again, count = 0;
+
+	if ((done = loop->done) != NULL) {  //regular file operations finished when queued
+		loop->done = loop->doneTail = NULL;
+		for (; done != NULL; done = op) {
+			op = done->next;
+			complete(loop, done, (int)done->len);
+			count++;
+		}
+		timeoutMs = 0;
+	}
+	loop->enters++;
+	if ((n = epoll_wait(loop->epfd, evs, EPOLL_BATCH, timeoutMs)) < 0)
+		return errno == EINTR ? count : -1;
+	for (i = 0; i < n; i++) {
+		fd = evs[i].data.fd;
+		//callbacks may queue on other fds and grow the table, so look the fd up each time
+		again = 1;
+		while (again && evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP) &&
+		       (op = loop->fds[fd].rd) != NULL && (res = epoll_try(op, &again)) != -EAGAIN) {
+			if ((loop->fds[fd].rd = op->next) == NULL)
+				loop->fds[fd].rdTail = NULL;
+			complete(loop, op, res);
+			count++;
+		}
+		again = 1;
+		while (again && evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP) &&
+		       (op = loop->fds[fd].wr) != NULL && (res = epoll_try(op, &again)) != -EAGAIN) {
+			if ((loop->fds[fd].wr = op->next) == NULL)
+				loop->fds[fd].wrTail = NULL;
+			complete(loop, op, res);
+			count++;
+		}
+		epoll_arm(loop, fd);  //one-shot, re-arm for whatever is still waiting
+	}
+	return count;
+}
+
+/*
+ * Timers
+ *
+ * Level 0 holds timers due within 64 ticks, one slot per tick; each
+ * level above covers 64 times the span of the one below.  Whenever a
+ * level wraps, the next slot of the level above is cascaded down and
+ * its timers land in finer slots.  Timers further out than the wheel
+ * reaches are clamped to its last slot.
+ */
+
+#define WHEEL_MASK (IOLOOP_WHEEL_SLOTS - 1)
+#define WHEEL_SPAN (1ULL << (IOLOOP_WHEEL_BITS * IOLOOP_WHEEL_LEVELS))
+
+/* ioloop_time - monotonic clock in milliseconds, the wheel's tick */
+uint64_t ioloop_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/* timer_link - put t in the slot its expiry falls in, seen from loop->tick */
+static void timer_link(ioloop_t *loop, ioloop_timer_t *t)
+{
+	uint64_t expires = t->expires, delta;
+	ioloop_timer_t **slot;
+	int level = 0;
+
+	if (expires < loop->tick)
+		expires = loop->tick;  //overdue, runs on the next tick
+	if ((delta = expires - loop->tick) >= WHEEL_SPAN)
+		expires = t->expires = loop->tick + WHEEL_SPAN - 1;
+	while (level < IOLOOP_WHEEL_LEVELS - 1 && delta >> ((level + 1) * IOLOOP_WHEEL_BITS))
+		level++;
+	slot = &loop->wheel[level][(expires >> (level * IOLOOP_WHEEL_BITS)) & WHEEL_MASK];
+	if ((t->next = *slot) != NULL)
+		t->next->pprev = &t->next;
+	*slot = t;
+	t->pprev = slot;
+}
+
+static void timer_unlink(ioloop_timer_t *t)
+{
+	if ((*t->pprev = t->next) != NULL)
+		t->next->pprev = t->pprev;
+	t->pprev = NULL;
+}
+
+void ioloop_timer_init(ioloop_timer_t *t, ioloop_timer_cb_t *cb, void *arg)
+{
+	memset(t, 0, sizeof(*t));
+	t->cb = cb;
+	t->arg = arg;
+}
+
+/* ioloop_timer_arm - run t's callback ms from now, replacing any earlier arming */
+void ioloop_timer_arm(ioloop_t *loop, ioloop_timer_t *t, int ms)
+{
+	uint64_t now = ioloop_time();
+
+	if (t->pprev != NULL)
+		timer_unlink(t);
+	else
+		loop->ntimers++;
+	if (loop->ntimers == 1 && loop->tick < now)
+		loop->tick = now;  //nothing else pending, no ticks to catch up on
+	t->expires = now + (ms > 0 ? ms : 0);
+	timer_link(loop, t);
+}
+
+void ioloop_timer_cancel(ioloop_t *loop, ioloop_timer_t *t)
+{
+	if (t->pprev == NULL)
+		return;
+	timer_unlink(t);
+	loop->ntimers--;
+}
+
+/* due - whether tick t has timers to run or a non-empty slot to cascade */
+static int due(ioloop_t *loop, uint64_t t)
+{
+	int level, shift;
+
+	if (loop->wheel[0][t & WHEEL_MASK] != NULL)
+		return 1;
+	for (level = 1; level < IOLOOP_WHEEL_LEVELS; level++) {
+		shift = level * IOLOOP_WHEEL_BITS;
+		if ((t & ((1ULL << shift) - 1)) != 0)
+			break;
+		if (loop->wheel[level][(t >> shift) & WHEEL_MASK] != NULL)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * next_tick - first tick from loop->tick on that is due.  Level 0 is
+ * checked tick by tick up to its wrap; past that only cascades can put
+ * timers back into it, so each level above is checked at its own slot
+ * boundaries up to where it wraps in turn.
+ */
+static uint64_t next_tick(ioloop_t *loop)
+{
+	uint64_t t = loop->tick;
+	int level, shift;
+
+	for (level = 0; level < IOLOOP_WHEEL_LEVELS; level++) {
+		shift = level * IOLOOP_WHEEL_BITS;
+		do {
+			if (due(loop, t))
+				return t;
+			t += 1ULL << shift;
+		} while ((t >> shift) & WHEEL_MASK);
+	}
+	return t;
+}
+
+/* timers_wait - how long the backend may sleep, at most timeoutMs */
+static int timers_wait(ioloop_t *loop, int timeoutMs)
+{
+	uint64_t now, next;
+
+	if (loop->ntimers == 0)
+		return timeoutMs;
+	now = ioloop_time();
+	if ((next = next_tick(loop)) <= now)
+		return 0;
+	if (timeoutMs >= 0 && next - now > (uint64_t)timeoutMs)
+		return timeoutMs;
+	return (int)(next - now);
+}
+
+/* timers_run - run the wheel up to now and call every timer that expired */
+static int timers_run(ioloop_t *loop)
+{
+	uint64_t now = ioloop_time(), tick;
+	ioloop_timer_t *expired, *t, *list;
+	int level, shift, n = 0;
+
+	while (loop->ntimers > 0 && (tick = next_tick(loop)) <= now) {
+		loop->tick = tick;
+		for (level = 1; level < IOLOOP_WHEEL_LEVELS; level++) {
+			shift = level * IOLOOP_WHEEL_BITS;
+			if ((tick & ((1ULL << shift) - 1)) != 0)
+				break;
+			list = loop->wheel[level][(tick >> shift) & WHEEL_MASK];
+			loop->wheel[level][(tick >> shift) & WHEEL_MASK] = NULL;
+			while ((t = list) != NULL) {
+				list = t->next;
+				timer_link(loop, t);
+			}
+		}
+		loop->tick = tick + 1;
+		//detach the slot so callbacks can arm and cancel freely, including each other
+		if ((expired = loop->wheel[0][tick & WHEEL_MASK]) != NULL) {
+			loop->wheel[0][tick & WHEEL_MASK] = NULL;
+			expired->pprev = &expired;
+		}
+		while ((t = expired) != NULL) {
+			timer_unlink(t);
+			loop->ntimers--;
+			loop->expired++;
+			n++;
+			t->cb(loop, t, t->arg);
+		}
+	}
+	if (loop->tick <= now)
+		loop->tick = now + 1;
+	return n;
+}
+
+/*
+ * Common interface
+ */
+
+/*
+ * ioloop_init - set up a loop with room for entries operations in flight
+ * per pass.  IOLOOP_AUTO tries io_uring first.  Returns -1 if neither
+ * the requested backend nor (for IOLOOP_AUTO) epoll is available.
+ */
+int ioloop_init(ioloop_t *loop, int backend, unsigned entries)
+{
+	memset(loop, 0, sizeof(*loop));
+	loop->ringfd = loop->epfd = -1;
+	loop->tick = ioloop_time();
+	if ((backend == IOLOOP_AUTO || backend == IOLOOP_URING) && uring_init(loop, entries) == 0) {
+		loop->backend = IOLOOP_URING;
+		return 0;
+	}
+	if (backend == IOLOOP_URING)
+		return -1;
+	if ((loop->epfd = epoll_create1(0)) < 0)
+		return -1;
+	loop->backend = IOLOOP_EPOLL;
+	return 0;
+}
+
+/* ioloop_close - free the loop; operations still queued are forgotten */
+void ioloop_close(ioloop_t *loop)
+{
+	ioloop_op_t *op;
+
+	if (loop->backend == IOLOOP_URING) {
+		munmap(loop->sqes, loop->sqesBytes);
+		munmap(loop->ring, loop->ringBytes);
+		close(loop->ringfd);
+	}
+	else if (loop->epfd >= 0) {
+		close(loop->epfd);
+	}
+	while ((op = loop->freeOps) != NULL) {
+		loop->freeOps = op->next;
+		free(op);
+	}
+	free(loop->files);
+	free(loop->bufs);
+	free(loop->fds);
+	memset(loop, 0, sizeof(*loop));
+	loop->ringfd = loop->epfd = -1;
+}
+
+const char *ioloop_backend_name(int backend)
+{
+	return (backend >= 0 && backend <= IOLOOP_EPOLL) ? backendNames[backend] : "?";
+}
+
+/* ioloop_backend_byname - IOLOOP_AUTO, IOLOOP_URING or IOLOOP_EPOLL, or -1 */
+int ioloop_backend_byname(const char *name)
+{
+	int i;
+
+	for (i = 0; i <= IOLOOP_EPOLL; i++) {
+		if (strcmp(name, backendNames[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * ioloop_register_files - let io_uring refer to fds by index instead of
+ * looking them up on every operation.  A no-op for epoll.
+ */
+int ioloop_register_files(ioloop_t *loop, const int *fds, unsigned n)
+{
+	if (loop->backend != IOLOOP_URING || loop->nfiles > 0)
+		return 0;
+	if (syscall(__NR_io_uring_register, loop->ringfd, IORING_REGISTER_FILES, fds, n) < 0)
+		return -1;
+	loop->files = malloc(n * sizeof(int));
+	memcpy(loop->files, fds, n * sizeof(int));
+	loop->nfiles = n;
+	return 0;
+}
+
+/*
+ * ioloop_register_buffers - pin buffers for io_uring so reads and writes
+ * into them skip the per-operation page mapping.  A no-op for epoll.
+ */
+int ioloop_register_buffers(ioloop_t *loop, const struct iovec *iov, unsigned n)
+{
+	if (loop->backend != IOLOOP_URING || loop->nbufs > 0)
+		return 0;
+	if (syscall(__NR_io_uring_register, loop->ringfd, IORING_REGISTER_BUFFERS, iov, n) < 0)
+		return -1;
+	loop->bufs = malloc(n * sizeof(struct iovec));
+	memcpy(loop->bufs, iov, n * sizeof(struct iovec));
+	loop->nbufs = n;
+	return 0;
+}
+
+/* queue - hand a filled in operation to the backend */
+static int queue(ioloop_t *loop, int type, int fd, void *buf, size_t len,
+		 ioloop_cb_t *cb, void *arg, ioloop_op_t **out)
+{
+	ioloop_op_t *op = op_get(loop);
+	int rc;
+
+	if (op == NULL)
+		return -1;
+	op->type = type;
+	op->fd = fd;
+	op->buf = buf;
+	op->len = len;
+	op->cb = cb;
+	op->arg = arg;
+	if (out)
+		*out = op;
+	if (type == IOLOOP_OP_ACCEPT)
+		return 0;  //caller fills in the address and queues it
+	rc = loop->backend == IOLOOP_URING ? uring_queue(loop, op) : epoll_queue(loop, op);
+	if (rc < 0)
+		op_put(loop, op);
+	return rc;
+}
+
+/* ioloop_accept - accept a connection on fd, cb gets the new fd */
+int ioloop_accept(ioloop_t *loop, int fd, struct sockaddr *addr, socklen_t *addrlen,
+		  ioloop_cb_t *cb, void *arg)
+{
+	ioloop_op_t *op;
+	int rc;
+
+	if (queue(loop, IOLOOP_OP_ACCEPT, fd, NULL, 0, cb, arg, &op) < 0)
+		return -1;
+	op->addr = addr;
+	op->addrlen = addrlen;
+	rc = loop->backend == IOLOOP_URING ? uring_queue(loop, op) : epoll_queue(loop, op);
+	if (rc < 0)
+		op_put(loop, op);
+	return rc;
+}
+
+/* ioloop_read - read up to len bytes from fd, cb gets the count, 0 at end of file */
+int ioloop_read(ioloop_t *loop, int fd, void *buf, size_t len, ioloop_cb_t *cb, void *arg)
+{
+	return queue(loop, IOLOOP_OP_READ, fd, buf, len, cb, arg, NULL);
+}
+
+/*
+ * ioloop_poll - wait for fd to be ready for events (POLLIN or POLLOUT),
+ * cb gets the events that are ready.  Lets a caller hold off on taking a
+ * buffer until there is data for it.
+ */
+int ioloop_poll(ioloop_t *loop, int fd, unsigned events, ioloop_cb_t *cb, void *arg)
+{
+	return queue(loop, IOLOOP_OP_POLL, fd, NULL, events, cb, arg, NULL);
+}
+
+/* ioloop_write - write up to len bytes to fd, cb gets the count written */
+int ioloop_write(ioloop_t *loop, int fd, const void *buf, size_t len, ioloop_cb_t *cb, void *arg)
+{
+	return queue(loop, IOLOOP_OP_WRITE, fd, (void *)buf, len, cb, arg, NULL);
+}
+
+/*
+ * ioloop_run - submit everything queued, wait up to timeoutMs (-1 for
+ * ever) for completions or the next timer and report them, then run the
+ * timers that are due.  Returns the number of completions and timers,
+ * or -1 if the backend failed.
+ */
+int ioloop_run(ioloop_t *loop, int timeoutMs)
+{
+	int n, wait = timers_wait(loop, timeoutMs);
+
+	n = loop->backend == IOLOOP_URING ? uring_run(loop, wait) : epoll_run(loop, wait);
+	if (n < 0)
+		return -1;
+	return n + timers_run(loop);
+}
+
+/*
+ * Relay
+ *
+ * Two buffers alternate so the next read from the origin is in flight
+ * while the previous block is written to the client; with io_uring the
+ * write and the following read go to the kernel in the same call.  An
+ * idle timer, pushed back whenever either side makes progress, and a
+ * timer for the whole relay shut both sockets down when they expire,
+ * which fails whatever is in flight.
+ */
+
+struct relay {
+	ioloop_t *loop;
+	int from, to;
+	char **bufs;
+	size_t size;
+	size_t len[2], sent[2];       //bytes read into each buffer, and written out of it
+	int reading, writing, full;   //buffer in each state, -1 for none
+	int eof, error;
+	long total;
+	ioloop_timer_t idle, deadline;
+	int idleMs;
+	ioloop_data_t *seen;
+	void *arg;
+};
+
+static void relay_read_done(ioloop_t *loop, int res, void *arg);
+static void relay_write_done(ioloop_t *loop, int res, void *arg);
+
+/* relay_progress - push the idle deadline back */
+static void relay_progress(struct relay *r)
+{
+	if (r->idleMs > 0)
+		ioloop_timer_arm(r->loop, &r->idle, r->idleMs);
+}
+
+/* relay_expired - neither side moved in time, or the relay ran out of it */
+static void relay_expired(ioloop_t *loop, ioloop_timer_t *t, void *arg)
+{
+	struct relay *r = arg;
+
+	r->error = 1;
+	shutdown(r->from, SHUT_RDWR);
+	shutdown(r->to, SHUT_RDWR);
+}
+
+static void relay_read(struct relay *r, int i)
+{
+	r->reading = i;
+	if (ioloop_read(r->loop, r->from, r->bufs[i], r->size, relay_read_done, r) < 0) {
+		r->reading = -1;
+		r->error = 1;
+	}
+}
+
+static void relay_write(struct relay *r, int i)
+{
+	r->writing = i;
+	if (ioloop_write(r->loop, r->to, r->bufs[i] + r->sent[i], r->len[i] - r->sent[i],
+			 relay_write_done, r) < 0) {
+		r->writing = -1;
+		r->error = 1;
+	}
+}
+
+static void relay_read_done(ioloop_t *loop, int res, void *arg)
+{
+	struct relay *r = arg;
+	int i = r->reading;
+
+	r->reading = -1;
+	if (res <= 0) {
+		r->eof = 1;
+		r->error |= res < 0;
+		return;
+	}
+	relay_progress(r);
+	r->seen(r->bufs[i], res, r->arg);
+	r->total += res;
+	r->len[i] = res;
+	r->sent[i] = 0;
+	if (r->error)
+		return;
+	if (r->writing >= 0) {  //both buffers busy, the write finishing starts this one
+		r->full = i;
+		return;
+	}
+	relay_write(r, i);
+	relay_read(r, 1 - i);
+}
+
+static void relay_write_done(ioloop_t *loop, int res, void *arg)
+{
+	struct relay *r = arg;
+	int i = r->writing;
+
+	r->writing = -1;
+	if (res <= 0) {
+		r->error = 1;
+		return;
+	}
+	relay_progress(r);
+	r->sent[i] += res;
+	if (r->sent[i] < r->len[i]) {  //short write, send the rest
+		relay_write(r, i);
+		return;
+	}
+	if (r->full >= 0 && !r->error) {
+		int j = r->full;
+
+		r->full = -1;
+		relay_write(r, j);
+		if (!r->eof)
+			relay_read(r, i);
+	}
+}
+
+/*
+ * ioloop_relay - copy everything from from to to through the two bufSize
+ * buffers, passing each block to seen as it is read.  idleMs and totalMs
+ * of 0 leave the relay without that timer.  Returns the bytes relayed,
+ * or -1 if either side failed or a timer expired.
+ */
+long ioloop_relay(ioloop_t *loop, int from, int to, char *bufs[2], size_t bufSize,
+		  int idleMs, int totalMs, ioloop_data_t *seen, void *arg)
+{
+	struct relay r;
+
+	memset(&r, 0, sizeof(r));
+	r.loop = loop;
+	r.from = from;
+	r.to = to;
+	r.bufs = bufs;
+	r.size = bufSize;
+	r.reading = r.writing = r.full = -1;
+	r.seen = seen;
+	r.arg = arg;
+	r.idleMs = idleMs;
+	ioloop_timer_init(&r.idle, relay_expired, &r);
+	ioloop_timer_init(&r.deadline, relay_expired, &r);
+
+	relay_progress(&r);
+	if (totalMs > 0)
+		ioloop_timer_arm(loop, &r.deadline, totalMs);
+	relay_read(&r, 0);
+	while (r.reading >= 0 || r.writing >= 0) {
+		if (ioloop_run(loop, -1) < 0)
+			return -1;  //operations may still reference r, the caller must not reuse the loop
+	}
+	ioloop_timer_cancel(loop, &r.idle);
+	ioloop_timer_cancel(loop, &r.deadline);
+	return r.error ? -1 : r.total;
+}
@@ -0,0 +1,129 @@
+/*
+ * ioloop.h - completion based I/O loop with io_uring and epoll backends
+ *
+ * Callers queue accepts, reads, writes and polls and are called back with the
+ * result (a byte count or fd, or -errno) once the operation completes.
+ * With io_uring every queued operation goes to the kernel in one
+ * io_uring_enter() per loop pass, which also collects the completions;
+ * registered buffers and files are used automatically when an
+ * operation's buffer or fd was registered.  Without io_uring the same
+ * calls are served from epoll readiness, one syscall per operation.
+ *
+ * Timers live on a hierarchical wheel of 1 ms ticks that the loop runs
+ * after each pass, so arming and cancelling a deadline is a list insert
+ * or unlink however many are pending, and the loop sleeps only until
+ * the next one is due.
+ */
+#ifndef __IOLOOP_H__
+#define __IOLOOP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* Backends */
+#define IOLOOP_AUTO  0   /* io_uring if the kernel allows it, else epoll */
+#define IOLOOP_URING 1
+#define IOLOOP_EPOLL 2
+
+#define IOLOOP_WHEEL_BITS   6
+#define IOLOOP_WHEEL_SLOTS  (1 << IOLOOP_WHEEL_BITS)
+#define IOLOOP_WHEEL_LEVELS 4    /* 64 ms, 4 s, 4 min and 4.6 h of 1 ms ticks */
+
+typedef struct ioloop ioloop_t;
+typedef void ioloop_cb_t(ioloop_t *loop, int res, void *arg);
+
+typedef struct ioloop_timer ioloop_timer_t;
+typedef void ioloop_timer_cb_t(ioloop_t *loop, ioloop_timer_t *t, void *arg);
+
+/* A deadline, owned by the caller and armed on one loop at a time */
+struct ioloop_timer {
+	uint64_t expires;                 //tick it fires on
+	ioloop_timer_t *next;             //wheel slot list
+	ioloop_timer_t **pprev;           //NULL while not armed
+	ioloop_timer_cb_t *cb;
+	void *arg;
+};
+
+/* One queued operation */
+typedef struct ioloop_op {
+	int type;                         //IOLOOP_OP_ACCEPT, _READ, _WRITE or _POLL
+	int fd;
+	char *buf;
+	size_t len;                       //events for a poll
+	struct sockaddr *addr;            //accept only
+	socklen_t *addrlen;
+	ioloop_cb_t *cb;
+	void *arg;
+	struct ioloop_op *next;           //free list, or the epoll backend's per fd and done lists
+} ioloop_op_t;
+
+/* Operations waiting on one fd, epoll backend only */
+struct ioloop_fd {
+	ioloop_op_t *rd, *rdTail;         //reads and accepts, oldest first
+	ioloop_op_t *wr, *wrTail;         //writes, oldest first
+};
+
+struct ioloop {
+	int backend;                      //IOLOOP_URING or IOLOOP_EPOLL
+	ioloop_op_t *freeOps;
+	unsigned long enters;             //syscalls spent waiting and submitting
+	unsigned long completions;        //operations completed
+
+	//io_uring
+	int ringfd;
+	char *ring;                       //submission and completion rings, one mapping
+	size_t ringBytes;
+	struct io_uring_sqe *sqes;
+	size_t sqesBytes;
+	unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+	unsigned *cqHead, *cqTail, *cqMask;
+	struct io_uring_cqe *cqes;
+	unsigned sqEntries;
+	unsigned pending;                 //queued, not yet submitted
+	int *files;                       //registered fds, by fixed file index
+	unsigned nfiles;
+	struct iovec *bufs;               //registered buffers, by buffer index
+	unsigned nbufs;
+
+	//epoll
+	int epfd;
+	struct ioloop_fd *fds;            //indexed by fd
+	int nfds;
+	ioloop_op_t *done, *doneTail;     //completed without waiting, reported on the next pass
+
+	//timers
+	uint64_t tick;                    //first tick the wheel has not run yet
+	unsigned ntimers;                 //armed
+	unsigned long expired;            //timers that fired
+	ioloop_timer_t *wheel[IOLOOP_WHEEL_LEVELS][IOLOOP_WHEEL_SLOTS];
+};
+
+int ioloop_init(ioloop_t *loop, int backend, unsigned entries);
+void ioloop_close(ioloop_t *loop);
+const char *ioloop_backend_name(int backend);
+int ioloop_backend_byname(const char *name);
+
+int ioloop_register_files(ioloop_t *loop, const int *fds, unsigned n);
+int ioloop_register_buffers(ioloop_t *loop, const struct iovec *iov, unsigned n);
+
+int ioloop_accept(ioloop_t *loop, int fd, struct sockaddr *addr, socklen_t *addrlen,
+		  ioloop_cb_t *cb, void *arg);
+int ioloop_read(ioloop_t *loop, int fd, void *buf, size_t len, ioloop_cb_t *cb, void *arg);
+int ioloop_write(ioloop_t *loop, int fd, const void *buf, size_t len, ioloop_cb_t *cb, void *arg);
+int ioloop_poll(ioloop_t *loop, int fd, unsigned events, ioloop_cb_t *cb, void *arg);
+int ioloop_run(ioloop_t *loop, int timeoutMs);
+
+uint64_t ioloop_time(void);
+void ioloop_timer_init(ioloop_timer_t *t, ioloop_timer_cb_t *cb, void *arg);
+void ioloop_timer_arm(ioloop_t *loop, ioloop_timer_t *t, int ms);
+void ioloop_timer_cancel(ioloop_t *loop, ioloop_timer_t *t);
+
+/* Called with each block relayed by ioloop_relay */
+typedef void ioloop_data_t(const char *data, size_t n, void *arg);
+
+long ioloop_relay(ioloop_t *loop, int from, int to, char *bufs[2], size_t bufSize,
+		  int idleMs, int totalMs, ioloop_data_t *seen, void *arg);
+
+#endif /* __IOLOOP_H__ */
@@ -0,0 +1,110 @@
+/*
+ * outq.c - per-connection output queue
+ *
+ * Queued buffers are sent from the oldest with one sendmsg() covering as
+ * many of them as fit in its iovec, and released as the socket takes
+ * them.  Sends use MSG_DONTWAIT, so the socket may stay in blocking
+ * mode, and MSG_NOSIGNAL, so a client that went away shows up as EPIPE.
+ */
+
+#include "csapp.h"
+#include "outq.h"
+
+#define OUTQ_IOV 16
+
+void outq_init(outq_t *q, size_t lowWater, size_t highWater)
+{
+	memset(q, 0, sizeof(*q));
+	q->lowWater = lowWater;
+	q->highWater = highWater > lowWater ? highWater : lowWater + 1;
+}
+
+/* update_paused - apply the watermarks after the queue grew or shrank */
+static void update_paused(outq_t *q)
+{
+	if (q->bytes >= q->highWater || q->count == OUTQ_SLOTS)
+		q->paused = 1;
+	else if (q->bytes <= q->lowWater)
+		q->paused = 0;
+}
+
+/*
+ * outq_push - queue c->len bytes of c, taking a reference to it.
+ * Returns -1 if the queue has no free slot or the socket has already
+ * failed.
+ */
+int outq_push(outq_t *q, struct bufChunk *c)
+{
+	size_t i;
+
+	if (q->error || q->count == OUTQ_SLOTS)
+		return -1;
+	i = (q->head + q->count++) % OUTQ_SLOTS;
+	bufchunk_ref(c);
+	q->slots[i].chunk = c;
+	q->slots[i].sent = 0;
+	q->bytes += c->len;
+	update_paused(q);
+	return 0;
+}
+
+/*
+ * outq_flush - send as much of the queue to fd as it takes without
+ * blocking.  Returns 0, also when the socket is full, or -1 once a send
+ * has failed, with the error in q->error.
+ */
+int outq_flush(outq_t *q, int fd)
+{
+	struct iovec iov[OUTQ_IOV];
+	struct msghdr msg;
+	struct bufChunk *c;
+	ssize_t m;
+	size_t i, n, slot;
+
+	while (q->bytes > 0 && !q->error) {
+		for (i = 0; i < q->count && i < OUTQ_IOV; i++) {
+			slot = (q->head + i) % OUTQ_SLOTS;
+			c = q->slots[slot].chunk;
+			iov[i].iov_base = c->data + q->slots[slot].sent;
+			iov[i].iov_len = c->len - q->slots[slot].sent;
+		}
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = i;
+		if ((m = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL)) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				q->error = errno;
+			break;
+		}
+		q->bytes -= m;
+		q->sent += m;
+		while (m > 0) {  //release what was sent
+			slot = q->head;
+			c = q->slots[slot].chunk;
+			n = c->len - q->slots[slot].sent;
+			if ((size_t)m < n) {
+				q->slots[slot].sent += m;
+				break;
+			}
+			m -= n;
+			bufchunk_put(c);
+			q->head = (q->head + 1) % OUTQ_SLOTS;
+			q->count--;
+		}
+	}
+	update_paused(q);
+	return q->error ? -1 : 0;
+}
+
+/* outq_free - release anything still queued */
+void outq_free(outq_t *q)
+{
+	while (q->count > 0) {
+		bufchunk_put(q->slots[q->head].chunk);
+		q->head = (q->head + 1) % OUTQ_SLOTS;
+		q->count--;
+	}
+	q->bytes = 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * outq.h - per-connection output queue
+ *
+ * Buffers for a client are queued by reference and sent with
+ * non-blocking writes as the socket has room, so a slow client never
+ * blocks the process.  Once highWater bytes are waiting the queue
+ * reports itself paused, and the producer should stop reading from its
+ * source until the client has drained it back to lowWater.  A send
+ * error is kept in the queue rather than raised as a signal or an exit.
+ */
+#ifndef __OUTQ_H__
+#define __OUTQ_H__
+
+#include <stddef.h>
+#include "bufpool.h"
+
+#define OUTQ_SLOTS 64                    /* buffers queued at most */
+
+typedef struct {
+	struct {
+		struct bufChunk *chunk;
+		size_t sent;                     //bytes of chunk->data already sent
+	} slots[OUTQ_SLOTS];
+	size_t head, count;                  //oldest queued buffer and number queued
+	size_t bytes;                        //queued, not yet sent
+	size_t lowWater, highWater;
+	int paused;                          //reached highWater or OUTQ_SLOTS, not yet back to lowWater
+	int error;                           //errno of a failed send, 0 while the socket is fine
+	unsigned long sent;                  //bytes the socket has taken in all
+} outq_t;
+
+void outq_init(outq_t *q, size_t lowWater, size_t highWater);
+int outq_push(outq_t *q, struct bufChunk *c);
+int outq_flush(outq_t *q, int fd);
+void outq_free(outq_t *q);
+
+#endif /* __OUTQ_H__ */
@@ -0,0 +1,121 @@
+/*
+ * pack.c - block compression of stored pages
+ */
+
+#include "csapp.h"
+#include <zlib.h>
+#include "pack.h"
+
+/*
+ * pack_fill - replace f's staged payload with its packed form.  Returns
+ * -1, leaving f as it was, if packing would not save an eighth of it.
+ */
+int pack_fill(store_fill_t *f, int level)
+{
+	size_t nblocks = (f->len + PACK_BLOCK - 1) / PACK_BLOCK, cap, at, i, n;
+	struct packHeader *h;
+	uLongf packed;
+	uint32_t word;
+	char *buf, *block;
+
+	if (f->failed || f->len == 0)
+		return -1;
+	cap = sizeof(*h) + nblocks * sizeof(word) + f->len;
+	if ((buf = malloc(cap)) == NULL || (block = malloc(compressBound(PACK_BLOCK))) == NULL) {
+		free(buf);
+		return -1;
+	}
+	h = (struct packHeader *)buf;
+	h->magic = PACK_MAGIC;
+	h->blocks = nblocks;
+	h->rawLength = f->len;
+	at = sizeof(*h);
+	for (i = 0; i < nblocks; i++) {
+		n = f->len - i * PACK_BLOCK < PACK_BLOCK ? f->len - i * PACK_BLOCK : PACK_BLOCK;
+		packed = compressBound(PACK_BLOCK);
+		if (compress2((Bytef *)block, &packed, (Bytef *)f->buf + i * PACK_BLOCK, n, level) == Z_OK && packed < n) {
+			word = packed;
+			memcpy(buf + at, &word, sizeof(word));
+			memcpy(buf + at + sizeof(word), block, packed);
+		}
+		else {  //incompressible, e.g. an image inside a text page
+			word = n | PACK_RAW;
+			memcpy(buf + at, &word, sizeof(word));
+			memcpy(buf + at + sizeof(word), f->buf + i * PACK_BLOCK, n);
+		}
+		at += sizeof(word) + (word & ~PACK_RAW);
+	}
+	free(block);
+	if (at > f->len - f->len / 8) {
+		free(buf);
+		return -1;
+	}
+	free(f->buf);
+	f->buf = buf;
+	f->len = at;
+	f->cap = cap;
+	return 0;
+}
+
+/* pack_length - the unpacked length of a packed payload of len bytes, 0 if it is not packed */
+uint64_t pack_length(const char *payload, size_t len)
+{
+	struct packHeader h;
+
+	if (len < sizeof(h))
+		return 0;
+	memcpy(&h, payload, sizeof(h));
+	return h.magic == PACK_MAGIC ? h.rawLength : 0;
+}
+
+/*
+ * pack_read - unpack the raw bytes from up to to of a payload of len
+ * bytes, block by block into buf, PACK_BLOCK bytes, handing each piece
+ * to out; blocks stored as they were go to out straight from the
+ * payload, and blocks outside the bytes wanted are not unpacked at all.
+ * Returns the bytes handed over, or -1 if the payload is damaged or out
+ * failed.
+ */
+long pack_read(const char *payload, size_t len, char *buf, uint64_t from, uint64_t to, pack_out_t *out, void *arg)
+{
+	struct packHeader h;
+	const char *p = payload + sizeof(h), *end = payload + len, *data;
+	uint64_t at = 0;
+	long total = 0;
+	uLongf n;
+	uint32_t word, i, stored;
+
+	if (pack_length(payload, len) == 0)
+		return -1;
+	memcpy(&h, payload, sizeof(h));
+	for (i = 0; i < h.blocks && at < to; i++, at += PACK_BLOCK) {
+		if (p + sizeof(word) > end)
+			return -1;
+		memcpy(&word, p, sizeof(word));
+		p += sizeof(word);
+		stored = word & ~PACK_RAW;
+		if (p + stored > end)
+			return -1;
+		if (at + PACK_BLOCK > from) {
+			data = p;
+			n = stored;
+			if (!(word & PACK_RAW)) {
+				n = PACK_BLOCK;
+				if (uncompress((Bytef *)buf, &n, (const Bytef *)p, stored) != Z_OK)
+					return -1;
+				data = buf;
+			}
+			if (at + n > to)
+				n = to - at;
+			if (from > at) {
+				data += from - at;
+				n -= from - at;
+			}
+			if (out(data, n, arg) < 0)
+				return -1;
+			total += n;
+		}
+		p += stored;
+	}
+	return total;
+}
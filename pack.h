@@ -0,0 +1,40 @@
+/*
+ * pack.h - block compression of stored pages
+ *
+ * A page bound for the disk store can be packed before it is committed:
+ * its payload becomes a struct packHeader followed by PACK_BLOCK sized
+ * blocks, each deflated on its own (zlib at a low level, the fastest of
+ * the codecs this build has), or kept as it was if deflate does not
+ * shrink it.  The index charges the packed length against the cache's
+ * budget, so compressible pages take less of the store.  A hit inflates
+ * one block at a time into a buffer it writes to the client from,
+ * instead of sending the store's pages with sendfile.  The header's
+ * magic begins with a zero byte, which no stored response starts with,
+ * so a payload tells by itself whether it is packed.
+ */
+#ifndef __PACK_H__
+#define __PACK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "store.h"
+
+#define PACK_MAGIC  0x315a5000        /* "\0PZ1" */
+#define PACK_BLOCK  (64 << 10)        /* raw bytes per block, the last may be shorter */
+#define PACK_RAW    0x80000000u       /* block word flag: stored as is */
+
+struct packHeader {
+	uint32_t magic;
+	uint32_t blocks;
+	uint64_t rawLength;
+	//then per block a uint32_t of PACK_RAW and its stored length, and its bytes
+};
+
+/* Called with each block as it is unpacked; -1 stops pack_read */
+typedef int pack_out_t(const char *data, size_t n, void *arg);
+
+int pack_fill(store_fill_t *f, int level);
+uint64_t pack_length(const char *payload, size_t len);
+long pack_read(const char *payload, size_t len, char *buf, uint64_t from, uint64_t to, pack_out_t *out, void *arg);
+
+#endif /* __PACK_H__ */
@@ -0,0 +1,121 @@
+/*
+ * packbench.c - what packing the disk store would gain and cost
+ *
+ * Packs each file named on the command line the way the proxy packs a
+ * page for its disk store (see pack.h), then times serving it both ways
+ * for a number of rounds: unpacking it block by block, as a hit on a
+ * packed page does, against copying it as it is.  Reports per file and
+ * in total the raw and packed bytes, how much more the store would hold,
+ * the time to pack a page once, and the time per hit each way, so the
+ * capacity gained can be weighed against the latency added to hits.
+ * Files that packing would not shrink by an eighth are kept as they
+ * are, as the proxy keeps them.
+ */
+
+#include "csapp.h"
+#include <time.h>
+#include "pack.h"
+#include "store.h"
+
+/* usage - print the command line summary and exit */
+static void usage(char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-l level] [-n rounds] file...\n"
+		"  -l level   zlib level pages are packed at, 1-9 (default: 1)\n"
+		"  -n rounds  hits timed per file (default: 100)\n",
+		prog);
+	exit(1);
+}
+
+/* now_us - a monotonic clock in microseconds */
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* sink - pack_read output that copies each block where a socket write would */
+static int sink(const char *data, size_t n, void *arg)
+{
+	memcpy(arg, data, n);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int level = 1, rounds = 100, opt, i, r, packed;
+	size_t rawTotal = 0, packTotal = 0, n, at;
+	double packUs, copyUs, unpackUs, t, packSum = 0, copySum = 0, unpackSum = 0;
+	char buf[MAXLINE], *block, *out;
+	store_fill_t fill;
+	FILE *fp;
+
+	while ((opt = getopt(argc, argv, "l:n:")) != -1) {
+		switch (opt) {
+		case 'l': level = atoi(optarg); break;
+		case 'n': rounds = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind == argc || level < 1 || level > 9 || rounds < 1)
+		usage(argv[0]);
+	block = Malloc(PACK_BLOCK);
+	out = Malloc(PACK_BLOCK);
+
+	printf("%-24s %10s %10s %6s %10s %10s %10s\n", "file", "raw", "stored", "ratio", "pack us", "copy us", "unpack us");
+	for (i = optind; i < argc; i++) {
+		if ((fp = fopen(argv[i], "r")) == NULL) {
+			fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+			continue;
+		}
+		store_fill_begin(&fill, (size_t)1 << 40);
+		while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+			store_fill_append(&fill, buf, n);
+		fclose(fp);
+		if (fill.failed || fill.len == 0) {
+			store_fill_abort(&fill);
+			continue;
+		}
+		rawTotal += fill.len;
+
+		t = now_us();
+		packed = pack_fill(&fill, level) == 0;
+		packUs = now_us() - t;
+		packTotal += fill.len;
+
+		//a hit on a page kept as it is copies it in blocks, one on a packed page unpacks them
+		t = now_us();
+		for (r = 0; r < rounds; r++)
+			for (at = 0; at < fill.len; at += PACK_BLOCK)
+				memcpy(out, fill.buf + at, fill.len - at < PACK_BLOCK ? fill.len - at : PACK_BLOCK);
+		copyUs = (now_us() - t) / rounds;
+		unpackUs = copyUs;
+		if (packed) {
+			t = now_us();
+			for (r = 0; r < rounds; r++)
+				if (pack_read(fill.buf, fill.len, block, 0, UINT64_MAX, sink, out) < 0)
+					app_error("pack_read failed");
+			unpackUs = (now_us() - t) / rounds;
+		}
+		packSum += packUs;
+		copySum += copyUs;
+		unpackSum += unpackUs;
+
+		printf("%-24.24s %10llu %10zu %6.2f %10.1f %10.1f %10.1f%s\n", argv[i],
+		       packed ? (unsigned long long)pack_length(fill.buf, fill.len) : (unsigned long long)fill.len,
+		       fill.len, packed ? (double)pack_length(fill.buf, fill.len) / fill.len : 1.0,
+		       packUs, copyUs, unpackUs, packed ? "" : "  (kept as is)");
+		store_fill_abort(&fill);
+	}
+	if (packTotal > 0)
+		printf("%-24s %10zu %10zu %6.2f %10.1f %10.1f %10.1f\n"
+		       "store holds %.2fx the pages, hits take %.1f us more each on average\n",
+		       "total", rawTotal, packTotal, (double)rawTotal / packTotal, packSum, copySum, unpackSum,
+		       (double)rawTotal / packTotal, (unpackSum - copySum) / (argc - optind));
+	free(block);
+	free(out);
+	return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * pagebench.c - page load times through the proxy, as a browser sees them
+ *
+ * Acts as both the browser and a slow origin server for a running proxy.
+ * The origin answers every request after a delay, standing in for the
+ * round trip to a distant server.  Each round asks the proxy for a page
+ * it cannot have cached, whose HTML refers to a stylesheet, two scripts
+ * and images.  Like a browser, the client takes some time to parse the
+ * page before it discovers the subresources, then fetches them in
+ * document order over a limited number of connections.  Reported per
+ * round, as the mean and the 50th and 99th percentiles: when the HTML
+ * arrived, when the render-blocking stylesheet and scripts had all
+ * arrived (first paint), and when everything had (load).  Runs against
+ * the proxy with and without prefetch_concurrency set show what
+ * prefetching saves.
+ */
+
+#include "csapp.h"
+#include <time.h>
+
+#define BLOCKING  3               /* the stylesheet and two scripts, in the head */
+
+/* usage - print the command line summary and exit */
+static void usage(char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n rounds] [-k resources] [-s size] [-d delay] [-c conns] [-p parse] proxyport\n"
+		"  -n rounds     page loads (default: 20)\n"
+		"  -k resources  subresources per page, at least 3 (default: 12)\n"
+		"  -s size       bytes of each subresource (default: 8192)\n"
+		"  -d delay      ms the origin takes to answer (default: 50)\n"
+		"  -c conns      connections the browser fetches over (default: 6)\n"
+		"  -p parse      ms the browser parses before fetching (default: 20)\n",
+		prog);
+	exit(1);
+}
+
+static int resources = 12, size = 8192, delay = 50, conns = 6, parseMs = 20;
+static int proxyport, originport;
+static char *body;
+
+/* shared by a round's fetching threads */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int nextResource, blockingLeft, left, round_;
+static double roundStart, paintAt, loadAt;
+
+/* now_ms - monotonic time in milliseconds */
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* by_value - qsort comparison of doubles */
+static int by_value(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* report - print one line of results, sorting times */
+static void report(const char *kind, int rounds, double *times)
+{
+	double total = 0;
+	int i;
+
+	for (i = 0; i < rounds; i++)
+		total += times[i];
+	qsort(times, rounds, sizeof(double), by_value);
+	printf("%-12s %9.1f %9.1f %9.1f\n", kind, total / rounds, times[rounds / 2], times[(rounds * 99) / 100]);
+}
+
+/* resource - the name of subresource i of a page */
+static void resource(char *name, size_t len, int i)
+{
+	if (i == 0)
+		snprintf(name, len, "style.css");
+	else if (i < BLOCKING)
+		snprintf(name, len, "script%d.js", i);
+	else
+		snprintf(name, len, "image%d.png", i);
+}
+
+/* serve - origin side of one connection: wait out the delay, then answer with a page or a subresource */
+static void *serve(void *arg)
+{
+	int fd = (int)(long)arg, i;
+	char request[MAXLINE], page[16 * MAXLINE], name[64], head[MAXLINE];
+	size_t len = 0, n;
+	ssize_t m;
+	struct timespec ts = { delay / 1000, (delay % 1000) * 1000000L };
+
+	Pthread_detach(pthread_self());
+	while (len < sizeof(request) - 1 && (m = read(fd, request + len, sizeof(request) - 1 - len)) > 0) {
+		len += m;
+		request[len] = '\0';
+		if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+			break;
+	}
+	request[len] = '\0';
+	nanosleep(&ts, NULL);
+	if (strstr(request, ".html ") != NULL) {
+		n = snprintf(page, sizeof(page), "<!DOCTYPE html>\n<html><head>\n");
+		for (i = 0; i < resources; i++) {
+			resource(name, sizeof(name), i);
+			if (i == 0)
+				n += snprintf(page + n, sizeof(page) - n, "<link rel=\"stylesheet\" href=\"%s\">\n", name);
+			else if (i < BLOCKING)
+				n += snprintf(page + n, sizeof(page) - n, "<script src=\"%s\"></script>\n", name);
+			else
+				n += snprintf(page + n, sizeof(page) - n, "%s<img src=\"%s\" alt=\"\">\n",
+					      i == BLOCKING ? "</head><body>\n" : "", name);
+		}
+		n += snprintf(page + n, sizeof(page) - n, "</body></html>\n");
+		len = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: text/html\r\nContent-Length: %zu\r\n\r\n", n);
+		if (rio_writen(fd, head, len) == (ssize_t)len)
+			rio_writen(fd, page, n);
+	}
+	else {
+		len = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %d\r\n\r\n",
+			       strstr(request, ".css ") ? "text/css" : strstr(request, ".js ") ? "application/javascript" : "image/png",
+			       size);
+		if (rio_writen(fd, head, len) == (ssize_t)len)
+			rio_writen(fd, body, size);
+	}
+	Close(fd);
+	return NULL;
+}
+
+/* origin - accept the proxy's connections, each served on a thread of its own */
+static void *origin(void *arg)
+{
+	int listenfd = (int)(long)arg, fd;
+
+	while ((fd = accept(listenfd, NULL, NULL)) >= 0)
+		Pthread_create(&(pthread_t){ 0 }, NULL, serve, (void *)(long)fd);
+	return NULL;
+}
+
+/* fetch - ask the proxy for path and read the response to its end */
+static void fetch(const char *path)
+{
+	char request[MAXLINE], buf[MAXLINE];
+	int fd = Open_clientfd("localhost", proxyport);
+	size_t len = snprintf(request, sizeof(request), "GET http://localhost:%d/%s HTTP/1.0\r\n\r\n", originport, path);
+
+	Rio_writen(fd, request, len);
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	Close(fd);
+}
+
+/* browser - one of a round's connections, fetching subresources in document order until none are left */
+static void *browser(void *arg)
+{
+	char path[MAXLINE], name[64];
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&lock);
+		i = nextResource++;
+		pthread_mutex_unlock(&lock);
+		if (i >= resources)
+			return NULL;
+		resource(name, sizeof(name), i);
+		snprintf(path, sizeof(path), "pagebench/%d/%d/%s", (int)getpid(), round_, name);
+		fetch(path);
+		pthread_mutex_lock(&lock);
+		if (i < BLOCKING && --blockingLeft == 0)
+			paintAt = now_ms() - roundStart;
+		if (--left == 0)
+			loadAt = now_ms() - roundStart;
+		pthread_mutex_unlock(&lock);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int c, i, j, rounds = 20, listenfd;
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	struct timespec parse;
+	pthread_t *threads;
+	char path[MAXLINE];
+	double *htmlMs, *paintMs, *loadMs;
+
+	while ((c = getopt(argc, argv, "n:k:s:d:c:p:")) != -1) {
+		switch (c) {
+		case 'n': rounds = atoi(optarg); break;
+		case 'k': resources = atoi(optarg); break;
+		case 's': size = atoi(optarg); break;
+		case 'd': delay = atoi(optarg); break;
+		case 'c': conns = atoi(optarg); break;
+		case 'p': parseMs = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || rounds < 1 || resources < BLOCKING || resources > 100 || size < 0 ||
+	    delay < 0 || conns < 1 || parseMs < 0)
+		usage(argv[0]);
+	proxyport = atoi(argv[optind]);
+	Signal(SIGPIPE, SIG_IGN);
+
+	listenfd = Open_listenfd(0);
+	if (getsockname(listenfd, (SA *)&addr, &addrlen) < 0)
+		unix_error("getsockname error");
+	originport = ntohs(addr.sin_port);
+	body = Calloc(size + 1, 1);
+	memset(body, 'x', size);
+	htmlMs = Calloc(rounds, sizeof(double));
+	paintMs = Calloc(rounds, sizeof(double));
+	loadMs = Calloc(rounds, sizeof(double));
+	threads = Calloc(conns, sizeof(pthread_t));
+	Pthread_create(&(pthread_t){ 0 }, NULL, origin, (void *)(long)listenfd);
+	parse.tv_sec = parseMs / 1000;
+	parse.tv_nsec = (parseMs % 1000) * 1000000L;
+
+	for (i = 0; i < rounds; i++) {
+		round_ = i;
+		nextResource = 0;
+		blockingLeft = BLOCKING;
+		left = resources;
+		roundStart = now_ms();
+		snprintf(path, sizeof(path), "pagebench/%d/%d/index.html", (int)getpid(), i);
+		fetch(path);
+		htmlMs[i] = now_ms() - roundStart;
+		nanosleep(&parse, NULL);
+		for (j = 0; j < conns; j++)
+			Pthread_create(&threads[j], NULL, browser, NULL);
+		for (j = 0; j < conns; j++)
+			Pthread_join(threads[j], NULL);
+		paintMs[i] = paintAt;
+		loadMs[i] = loadAt;
+	}
+
+	printf("%-12s %9s %9s %9s\n", "rounds", "mean ms", "p50 ms", "p99 ms");
+	report("html", rounds, htmlMs);
+	report("first paint", rounds, paintMs);
+	report("load", rounds, loadMs);
+	return 0;
+}
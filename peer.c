@@ -0,0 +1,176 @@
+/*
+ * peer.c - cache peering between proxy nodes
+ */
+
+#include "csapp.h"
+#include <sys/mman.h>
+#include "peer.h"
+
+#define DIGEST_HASHES 4           /* bits set per key */
+
+/* mix - spread a hash's bits, so FNV hashes of similar keys land far apart on the ring */
+static uint64_t mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* fnv - 64-bit FNV-1a hash of a string */
+static uint64_t fnv(const char *s)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while (*s != '\0') {
+		h ^= (unsigned char)*s++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/* peer_add - add "host[:port]" to p, -1 if it is malformed or there is no room */
+int peer_add(peers_t *p, const char *value)
+{
+	char host[MAXLINE], *colon;
+	struct peer *e;
+
+	if (p->npeers == PEER_MAX || sscanf(value, "%s", host) != 1)
+		return -1;
+	e = &p->peers[p->npeers];
+	e->port = 80;
+	if ((colon = strrchr(host, ':')) != NULL) {
+		*colon = '\0';
+		if ((e->port = atoi(colon + 1)) <= 0 || e->port > 65535)
+			return -1;
+	}
+	if (host[0] == '\0' || strlen(host) >= sizeof(e->host))
+		return -1;
+	strcpy(e->host, host);
+	e->origin = -1;
+	p->npeers++;
+	return 0;
+}
+
+/* by_point - qsort comparison of ring points */
+static int by_point(const void *a, const void *b)
+{
+	uint64_t x = ((const struct ringPoint *)a)->point, y = ((const struct ringPoint *)b)->point;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * peer_ring - build p's ring once every peer is added, finding this
+ * node among them as selfHost:selfPort, and size its own digest for a
+ * cache of entries pages.  Returns -1 if memory cannot be had.
+ */
+int peer_ring(peers_t *p, const char *selfHost, int selfPort, size_t entries)
+{
+	char name[MAXLINE];
+	int i, v;
+
+	p->self = -1;
+	for (i = 0; i < p->npeers; i++)
+		if (p->peers[i].port == selfPort && strcmp(p->peers[i].host, selfHost) == 0)
+			p->self = i;
+	p->nring = (size_t)p->npeers * PEER_VNODES;
+	if ((p->ring = malloc(p->nring * sizeof(struct ringPoint))) == NULL)
+		return -1;
+	for (i = 0; i < p->npeers; i++) {
+		for (v = 0; v < PEER_VNODES; v++) {
+			snprintf(name, sizeof(name), "%s:%d#%d", p->peers[i].host, p->peers[i].port, v);
+			p->ring[i * PEER_VNODES + v].point = mix(fnv(name));
+			p->ring[i * PEER_VNODES + v].peer = i;
+		}
+	}
+	qsort(p->ring, p->nring, sizeof(struct ringPoint), by_point);
+
+	//about a byte per page keeps false positives near 2% with DIGEST_HASHES bits per key
+	for (p->ownBytes = 64; p->ownBytes < entries && p->ownBytes < PEER_DIGEST_MAX; p->ownBytes <<= 1)
+		;
+	if ((p->own = calloc(p->ownBytes, 1)) == NULL)
+		return -1;
+	p->digests = mmap(NULL, (size_t)p->npeers * PEER_DIGEST_MAX + p->npeers * sizeof(uint32_t),
+			  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p->digests == MAP_FAILED) {
+		p->digests = NULL;
+		return -1;
+	}
+	p->digestBytes = (uint32_t *)(p->digests + (size_t)p->npeers * PEER_DIGEST_MAX);
+	return 0;
+}
+
+/* peer_owner - the peer a page with key hash keyhash belongs to, -1 if there are no peers */
+int peer_owner(peers_t *p, uint64_t keyhash)
+{
+	uint64_t h = mix(keyhash);
+	size_t lo = 0, hi = p->nring;
+
+	if (p->nring == 0)
+		return -1;
+	while (lo < hi) {  //first point at or after h
+		size_t mid = (lo + hi) / 2;
+
+		if (p->ring[mid].point < h)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return p->ring[lo == p->nring ? 0 : lo].peer;
+}
+
+/* bit - the i'th digest bit of keyhash in a digest of bytes bytes (double hashing) */
+static size_t bit(uint64_t keyhash, int i, size_t bytes)
+{
+	uint64_t h = mix(keyhash);
+	uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32) | 1;
+
+	return (h1 + (uint64_t)i * h2) & (bytes * 8 - 1);
+}
+
+void peer_digest_clear(peers_t *p)
+{
+	memset(p->own, 0, p->ownBytes);
+}
+
+void peer_digest_add(peers_t *p, uint64_t keyhash)
+{
+	size_t b;
+	int i;
+
+	for (i = 0; i < DIGEST_HASHES; i++) {
+		b = bit(keyhash, i, p->ownBytes);
+		p->own[b / 8] |= 1 << (b % 8);
+	}
+}
+
+/* peer_digest_set - keep len bytes of bits as peer i's digest, -1 if len is not a usable size */
+int peer_digest_set(peers_t *p, int i, const unsigned char *bits, size_t len)
+{
+	if (len < 8 || len > PEER_DIGEST_MAX || (len & (len - 1)) != 0)
+		return -1;
+	p->digestBytes[i] = 0;  //a lookup meanwhile finds no digest rather than half of one
+	memcpy(p->digests + (size_t)i * PEER_DIGEST_MAX, bits, len);
+	p->digestBytes[i] = len;
+	return 0;
+}
+
+/* peer_digest_test - whether peer i's digest says it holds the page with key hash keyhash */
+int peer_digest_test(peers_t *p, int i, uint64_t keyhash)
+{
+	unsigned char *d = p->digests + (size_t)i * PEER_DIGEST_MAX;
+	size_t len = p->digestBytes[i], b;
+	int k;
+
+	if (len == 0)
+		return 0;
+	for (k = 0; k < DIGEST_HASHES; k++) {
+		b = bit(keyhash, k, len);
+		if (!(d[b / 8] & (1 << (b % 8))))
+			return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,66 @@
+/*
+ * peer.h - cache peering between proxy nodes
+ *
+ * Every node lists the same peers, itself included, and places each of
+ * them at PEER_VNODES points of a consistent hash ring; a page belongs
+ * to the first peer at or after its key's hash.  A node that misses a
+ * page another peer owns asks the owner for it and keeps no copy, so
+ * each page is cached once in the cluster, and adding or removing a
+ * peer moves only that peer's share of the pages.
+ *
+ * Each node also publishes a digest of its cache, a Bloom filter over
+ * the hashes of the keys it holds, and periodically fetches the digests
+ * of the others.  When the owner misses a page, it asks a peer whose
+ * digest says it has one, for example a node that fetched it while the
+ * owner was down, instead of asking every peer or going straight to the
+ * origin.  Digests are only hints: a false positive costs the peer a
+ * fetch from the origin, which it would have made anyway.
+ */
+#ifndef __PEER_H__
+#define __PEER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PEER_MAX          32
+#define PEER_VNODES       64              /* ring points per peer */
+#define PEER_DIGEST_MAX   (1 << 20)       /* bytes of a digest kept for a peer at most */
+#define PEER_DIGEST_PATH  "/.peer-digest" /* where a node serves its own digest */
+#define PEER_HEADER       "X-Peer"        /* marks a request from a peer, see below */
+
+/* What a peer's request asked for, the value of its PEER_HEADER */
+#define PEER_ASKED_OWNER  1               /* "owner": the page's owner, which may look in digests */
+#define PEER_ASKED_DIGEST 2               /* "digest": a peer whose digest has it, never passed on */
+
+struct peer {
+	char host[256];
+	int port;
+	int origin;                   //admission bucket, which counts its outstanding requests
+};
+
+struct ringPoint {
+	uint64_t point;
+	int peer;
+};
+
+typedef struct {
+	int npeers;
+	struct peer peers[PEER_MAX];
+	int self;                     //this node's index in peers, -1 if it only asks the others
+	struct ringPoint *ring;       //PEER_VNODES points per peer, sorted
+	size_t nring;
+	unsigned char *own;           //this node's digest, rebuilt by the parent
+	size_t ownBytes;              //a power of two
+	unsigned char *digests;       //PEER_DIGEST_MAX bytes per peer, shared with the child fetching them
+	uint32_t *digestBytes;        //size of each peer's digest, 0 until one is fetched
+} peers_t;
+
+int peer_add(peers_t *p, const char *value);
+int peer_ring(peers_t *p, const char *selfHost, int selfPort, size_t entries);
+int peer_owner(peers_t *p, uint64_t keyhash);
+void peer_digest_clear(peers_t *p);
+void peer_digest_add(peers_t *p, uint64_t keyhash);
+int peer_digest_set(peers_t *p, int i, const unsigned char *bits, size_t len);
+int peer_digest_test(peers_t *p, int i, uint64_t keyhash);
+
+#endif /* __PEER_H__ */
@@ -0,0 +1,355 @@
+/*
+ * prefetch.c - warming a page's subresources into the cache
+ */
+
+#include "csapp.h"
+#include <ctype.h>
+#include <poll.h>
+#include "prefetch.h"
+#include "http.h"
+
+void prefetch_init(prefetch_t *p, const char *host, int port, const char *path)
+{
+	size_t n = strcspn(path, "?");
+
+	memset(p, 0, sizeof(*p));
+	p->state = PREFETCH_HEAD;
+	snprintf(p->host, sizeof(p->host), "%s", host);
+	p->port = port;
+	while (n > 0 && path[n - 1] != '/')
+		n--;
+	if (n >= sizeof(p->dir))
+		n = 0;
+	memcpy(p->dir, path, n);
+	p->dir[n] = '\0';
+}
+
+/* is_html - whether the head, NUL terminated, is that of a 200 text/html response sent as is */
+static int is_html(const char *head)
+{
+	char value[256];
+	int status;
+
+	if (sscanf(head, "HTTP/%*d.%*d %d", &status) != 1 || status != 200)
+		return 0;
+	if (http_header(head, "Content-Encoding", value, sizeof(value)) == 0)
+		return 0;
+	return http_header(head, "Content-Type", value, sizeof(value)) == 0 && strncasecmp(value, "text/html", 9) == 0;
+}
+
+/* normalize - remove the "." and ".." segments of path, in place, as a browser would */
+static void normalize(char *path)
+{
+	char out[PREFETCH_PATH_MAX], *seg = path, *query = path + strcspn(path, "?"), *end;
+	size_t len = 0, n;
+	int slash;
+
+	while (seg < query) {
+		end = memchr(seg, '/', query - seg);
+		n = (end != NULL ? end : query) - seg;
+		slash = end != NULL;
+		if (n == 2 && strncmp(seg, "..", 2) == 0) {
+			while (len > 0 && out[len - 1] == '/')  //back over the last segment
+				len--;
+			while (len > 0 && out[len - 1] != '/')
+				len--;
+		}
+		else if (!(n == 1 && seg[0] == '.')) {
+			memcpy(out + len, seg, n);
+			len += n;
+			if (slash)
+				out[len++] = '/';
+		}
+		seg += n + slash;
+	}
+	memcpy(out + len, query, strlen(query) + 1);
+	strcpy(path, out);
+}
+
+/* add - resolve a URL found in the page and keep its path if it is on the page's site */
+static void add(prefetch_t *p, char *url)
+{
+	char path[PREFETCH_PATH_MAX], *amp, *host, *rest;
+	size_t n, hostLen;
+	int port, i;
+
+	while ((amp = strstr(url, "&amp;")) != NULL)
+		memmove(amp + 1, amp + 5, strlen(amp + 5) + 1);
+	url[strcspn(url, "#")] = '\0';
+	if (url[0] == '\0' || url[0] == '?')
+		return;
+	if (strncasecmp(url, "http://", 7) == 0 || strncmp(url, "//", 2) == 0) {
+		host = url + (url[0] == '/' ? 2 : 7);
+		rest = host + strcspn(host, "/?");
+		hostLen = strcspn(host, ":/?");
+		port = host[hostLen] == ':' ? atoi(host + hostLen + 1) : 80;
+		if (hostLen != strlen(p->host) || strncasecmp(host, p->host, hostLen) != 0 || port != p->port)
+			return;  //another site
+		if (snprintf(path, sizeof(path), "%s", *rest == '/' ? rest + 1 : rest) >= (int)sizeof(path))
+			return;
+	}
+	else if (url[n = strspn(url, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+.-")] == ':') {
+		return;  //https:, data:, javascript: and the like
+	}
+	else if (snprintf(path, sizeof(path), "%s%s", url[0] == '/' ? "" : p->dir, url[0] == '/' ? url + 1 : url) >=
+		 (int)sizeof(path)) {
+		return;
+	}
+	for (n = 0; path[n] != '\0'; n++)
+		if ((unsigned char)path[n] <= ' ' || path[n] == '"' || path[n] == 0x7f)
+			return;  //goes into a request line as it is
+	normalize(path);
+	for (i = 0; i < p->npaths; i++)
+		if (strcmp(p->paths[i], path) == 0)
+			return;
+	strcpy(p->paths[p->npaths++], path);
+	if (p->npaths == PREFETCH_MAX_URLS)
+		p->state = PREFETCH_OFF;
+}
+
+/* tag - look into a complete tag, its name and attributes without the brackets, NUL terminated */
+static void tag(prefetch_t *p, char *t)
+{
+	char *name, *value, *src = NULL, *href = NULL, *rel = NULL, *end;
+	size_t len = strspn(t, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"), n;
+
+	if (len == 6 && strncasecmp(t, "script", 6) == 0)
+		p->rawEnd = "</script";
+	else if (len == 5 && strncasecmp(t, "style", 5) == 0)
+		p->rawEnd = "</style";
+	if (!(len == 3 && strncasecmp(t, "img", 3) == 0) && !(len == 6 && strncasecmp(t, "script", 6) == 0) &&
+	    !(len == 4 && strncasecmp(t, "link", 4) == 0))
+		return;
+	for (t += len; *t != '\0'; ) {
+		t += strspn(t, " \t\r\n/");
+		name = t;
+		n = strcspn(t, " \t\r\n=/");
+		t += n;
+		t += strspn(t, " \t\r\n");
+		if (*t != '=' || n == 0) {
+			t += n == 0 && *t != '\0';  //a stray character, step over it
+			continue;
+		}
+		t++;
+		t += strspn(t, " \t\r\n");
+		if (*t == '"' || *t == '\'') {
+			value = t + 1;
+			if ((end = strchr(value, *t)) == NULL)
+				return;
+		}
+		else {
+			value = t;
+			end = t + strcspn(t, " \t\r\n");
+		}
+		t = *end != '\0' ? end + 1 : end;
+		*end = '\0';
+		if (n == 3 && strncasecmp(name, "src", 3) == 0)
+			src = value;
+		else if (n == 4 && strncasecmp(name, "href", 4) == 0)
+			href = value;
+		else if (n == 3 && strncasecmp(name, "rel", 3) == 0)
+			rel = value;
+	}
+	if (src != NULL && len != 4) {
+		add(p, src);
+		return;
+	}
+	if (len != 4 || href == NULL || rel == NULL)
+		return;
+	for (end = rel; *end != '\0'; end++)
+		*end = tolower((unsigned char)*end);
+	if (strstr(rel, "stylesheet") != NULL || strstr(rel, "icon") != NULL || strstr(rel, "preload") != NULL)
+		add(p, href);  //not other pages, as rel=alternate or canonical would be
+}
+
+/* prefetch_scan - the next n bytes of the origin's response */
+void prefetch_scan(prefetch_t *p, const char *data, size_t n)
+{
+	const char *end = data + n, *lt;
+	char *blank;
+	size_t take, rest;
+	char c;
+
+	while (data < end && p->state != PREFETCH_OFF) {
+		switch (p->state) {
+		case PREFETCH_HEAD:
+			take = (size_t)(end - data) < sizeof(p->head) - 1 - p->len ? (size_t)(end - data) : sizeof(p->head) - 1 - p->len;
+			memcpy(p->head + p->len, data, take);
+			p->len += take;
+			p->head[p->len] = '\0';
+			if ((blank = strstr(p->head, "\r\n\r\n")) != NULL)
+				blank += 4;
+			else if ((blank = strstr(p->head, "\n\n")) != NULL)
+				blank += 2;
+			if (blank == NULL) {
+				if (p->len == sizeof(p->head) - 1)
+					p->state = PREFETCH_OFF;  //too long a head to be worth it
+				return;
+			}
+			rest = p->head + p->len - blank;  //body bytes that came with the head
+			blank[-1] = '\0';
+			p->state = is_html(p->head) ? PREFETCH_TEXT : PREFETCH_OFF;
+			data += take - rest;
+			p->len = 0;
+			break;
+		case PREFETCH_TEXT:
+			if ((lt = memchr(data, '<', end - data)) == NULL)
+				return;
+			data = lt + 1;
+			p->state = PREFETCH_TAG;
+			p->len = 0;
+			p->quote = 0;
+			break;
+		case PREFETCH_TAG:
+			c = *data++;
+			if (p->quote) {
+				if (c == p->quote)
+					p->quote = 0;
+			}
+			else if (c == '"' || c == '\'') {
+				p->quote = p->len > 0 && (p->head[p->len - 1] == '=' || isspace((unsigned char)p->head[p->len - 1])) ? c : 0;
+			}
+			else if (c == '<') {  //the last one was text after all
+				p->len = 0;
+				break;
+			}
+			else if (c == '>') {
+				p->state = PREFETCH_TEXT;
+				if (p->len < PREFETCH_TAG_MAX) {
+					p->head[p->len] = '\0';
+					p->rawEnd = NULL;
+					tag(p, p->head);
+					if (p->rawEnd != NULL && p->head[0] != '/' && p->state == PREFETCH_TEXT) {
+						p->state = PREFETCH_RAW;
+						p->matched = 0;
+					}
+				}
+				break;
+			}
+			if (p->len < PREFETCH_TAG_MAX)
+				p->head[p->len++] = c;
+			if (p->len == 3 && strncmp(p->head, "!--", 3) == 0) {
+				p->state = PREFETCH_COMMENT;
+				p->matched = 0;
+			}
+			break;
+		case PREFETCH_COMMENT:
+			c = *data++;
+			if (c == '>' && p->matched >= 2)
+				p->state = PREFETCH_TEXT;
+			p->matched = c == '-' ? p->matched + 1 : 0;
+			break;
+		case PREFETCH_RAW:
+			if (p->matched == 0) {
+				if ((lt = memchr(data, '<', end - data)) == NULL)
+					return;
+				data = lt;
+			}
+			c = tolower((unsigned char)*data++);
+			if (c == p->rawEnd[p->matched])
+				p->matched++;
+			else
+				p->matched = c == '<';
+			if (p->rawEnd[p->matched] == '\0')
+				p->state = PREFETCH_TEXT;  //the rest of the end tag is skipped as text
+			break;
+		}
+	}
+}
+
+/* start - connect a new socket to the proxy on loopback, -1 if it fails at once */
+static int start(int proxyPort)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(proxyPort);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * prefetch_run - request the wanted paths from the proxy listening on
+ * proxyPort as prefix followed by the path, with the extra header lines
+ * in headers, concurrency of them at a time, until budget bytes have
+ * been read.  Responses are read to their end and dropped.  Gives up on
+ * all of them once none has moved for timeoutMs.  Returns the bytes read.
+ */
+long prefetch_run(prefetch_t *p, int proxyPort, const char *prefix, const char *headers, int concurrency,
+		  size_t budget, int timeoutMs, prefetch_wanted_t *wanted, void *arg)
+{
+	struct pollfd fds[PREFETCH_MAX_URLS];
+	char req[PREFETCH_MAX_URLS][PREFETCH_PATH_MAX + 1024], discard[MAXLINE];
+	size_t sent[PREFETCH_MAX_URLS], len[PREFETCH_MAX_URLS];
+	int active = 0, next = 0, i, err;
+	socklen_t errlen;
+	long bytes = 0;
+	ssize_t m;
+
+	if (concurrency > PREFETCH_MAX_URLS)
+		concurrency = PREFETCH_MAX_URLS;
+	for (;;) {
+		while (active < concurrency && next < p->npaths && (size_t)bytes < budget) {
+			if (wanted != NULL && !wanted(p->paths[next], arg)) {
+				next++;
+				continue;
+			}
+			if ((fds[active].fd = start(proxyPort)) < 0) {
+				next = p->npaths;  //the proxy is not taking connections, start no more
+				break;
+			}
+			len[active] = snprintf(req[active], sizeof(req[active]), "GET %s%s HTTP/1.0\r\n%s: 1\r\n%s\r\n",
+					       prefix, p->paths[next++], PREFETCH_HEADER, headers);
+			sent[active] = 0;
+			fds[active].events = POLLOUT;
+			active++;
+		}
+		if (active == 0)
+			return bytes;
+		if ((m = poll(fds, active, timeoutMs > 0 ? timeoutMs : -1)) == 0)
+			break;  //stuck, give up on the rest
+		if (m < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (i = active - 1; i >= 0; i--) {
+			if (fds[i].revents == 0)
+				continue;
+			m = 0;
+			if (fds[i].events == POLLOUT) {
+				errlen = sizeof(err);
+				if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &errlen) == 0 && err == 0 &&
+				    (m = send(fds[i].fd, req[i] + sent[i], len[i] - sent[i], MSG_NOSIGNAL)) > 0 &&
+				    (sent[i] += m) == len[i])
+					fds[i].events = POLLIN;
+				if (m > 0 || (m < 0 && errno == EAGAIN))
+					continue;
+			}
+			else if ((m = read(fds[i].fd, discard, sizeof(discard))) > 0) {
+				bytes += m;
+				continue;
+			}
+			else if (m < 0 && (errno == EAGAIN || errno == EINTR)) {
+				continue;
+			}
+			close(fds[i].fd);  //done, or failed
+			active--;
+			fds[i] = fds[active];
+			memcpy(req[i], req[active], len[active]);
+			sent[i] = sent[active];
+			len[i] = len[active];
+		}
+	}
+	for (i = 0; i < active; i++)
+		close(fds[i].fd);
+	return bytes;
+}
@@ -0,0 +1,60 @@
+/*
+ * prefetch.h - warming a page's subresources into the cache
+ *
+ * A child relaying a missed page feeds the origin's bytes to
+ * prefetch_scan as they pass.  The scanner reads the response head and,
+ * for a 200 text/html response that is not encoded, tokenizes the body
+ * in one pass with no copy of it kept: text is skipped with memchr for
+ * the next '<', comments and the contents of script and style elements
+ * are skipped whole, and only the attributes of img, script and link
+ * tags are looked at.  The src of an img or script, and the href of a
+ * link to a stylesheet, icon or preload, is resolved against the page's
+ * URL and kept if it is on the same site.
+ *
+ * Once the client has the page, prefetch_run requests the URLs from the
+ * proxy itself over loopback, so they are fetched and cached the way a
+ * client's requests would be, marked with PREFETCH_HEADER so they are
+ * not scanned in turn.  At most a given number are in flight at once,
+ * and no more are started once a byte budget has been spent.
+ */
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+#include <stddef.h>
+
+#define PREFETCH_MAX_URLS  32             /* subresources taken from a page at most */
+#define PREFETCH_PATH_MAX  1024           /* longest path kept, without its leading '/' */
+#define PREFETCH_TAG_MAX   2048           /* longest tag looked into, longer ones are skipped */
+#define PREFETCH_HEADER    "X-Prefetch"   /* marks the proxy's own prefetch requests */
+
+/* Scanner states */
+#define PREFETCH_HEAD      0              /* collecting the response head */
+#define PREFETCH_TEXT      1              /* between tags */
+#define PREFETCH_TAG       2              /* inside a tag, collecting it */
+#define PREFETCH_COMMENT   3              /* inside <!-- --> */
+#define PREFETCH_RAW       4              /* inside script or style, until its end tag */
+#define PREFETCH_OFF       5              /* not HTML, or nothing more to take */
+
+/* Whether a path is worth fetching, e.g. not cached already */
+typedef int prefetch_wanted_t(const char *path, void *arg);
+
+typedef struct {
+	int state;
+	char host[256];               //the page's host and port, whose URLs count as the same site
+	int port;
+	char dir[PREFETCH_PATH_MAX];  //the page's path up to its last '/', relative URLs start here
+	char head[8192];              //head so far while PREFETCH_HEAD, the tag so far while PREFETCH_TAG
+	size_t len;
+	int quote;                    //quote character the tag is inside, 0 for none
+	const char *rawEnd;           //end tag PREFETCH_RAW waits for, and how much of it has matched
+	size_t matched;
+	int npaths;
+	char paths[PREFETCH_MAX_URLS][PREFETCH_PATH_MAX];
+} prefetch_t;
+
+void prefetch_init(prefetch_t *p, const char *host, int port, const char *path);
+void prefetch_scan(prefetch_t *p, const char *data, size_t n);
+long prefetch_run(prefetch_t *p, int proxyPort, const char *prefix, const char *headers, int concurrency,
+		  size_t budget, int timeoutMs, prefetch_wanted_t *wanted, void *arg);
+
+#endif /* __PREFETCH_H__ */
@@ -12,46 +12,296 @@
 
 #include "csapp.h"
 #include "stdio.h"
+#include <sys/sendfile.h>
+#include <poll.h>
+#include "cache.h"
+#include "config.h"
+#include "http.h"
+#include "store.h"
+#include "checkpoint.h"
+#include "writer.h"
+#include "ioloop.h"
+#include "upstream.h"
+#include "outq.h"
+#include "bufpool.h"
+#include "admit.h"
+#include "ratelimit.h"
+#include "health.h"
+#include "peer.h"
+#include "gzip.h"
+#include "pack.h"
+#include "prefetch.h"
+#include "dedup.h"
+#include "purge.h"
+#include "vary.h"
+
+struct cachePage;
+struct pendingConn;
+struct fillNote;
 
 /*
  * Function prototypes
  */
-int parse_uri(char *uri, char *target_addr, char *path, int  *port);
 void format_log_entry(char *logstring, struct sockaddr_in *sockaddr, char *uri, int size, char* pageCachedStatus);
 int handle_request(int connfd, struct sockaddr_in *sockaddr);
 int checkIfPageCached();
+void evictPage(cache_entry_t *e, void *arg);
+void sendNote(int type, int slot, int tier, uint64_t fillId, uint64_t offset, uint64_t seq, uint32_t length);
+void droppedPage(struct storeObject *o, void *arg);
+void finishFill(store_fill_t *fill, void *arg);
+void fillNotesRead(ioloop_t *loop, int res, void *arg);
+void hostNotesRead(ioloop_t *loop, int res, void *arg);
+void reportHost(const char *hostname, upstream_t *u);
+void startLoop();
+void postAccepts();
+void freeConn(struct pendingConn *c);
+void acceptDone(ioloop_t *loop, int res, void *arg);
+void headReady(ioloop_t *loop, int res, void *arg);
+void headExpired(ioloop_t *loop, ioloop_timer_t *t, void *arg);
+void setTimeout(int fd, int option, int ms);
+int relayQueued(int connfd, outq_t *out, writer_t *writer, int writing, int maxBlocks, long *bytes);
+int relayTimeout(int ms);
+int relayRingReady();
+void closeInherited(int connfd);
+void serveRequest(int connfd, struct sockaddr_in *clientaddr, arena_t *arena);
+void unreachable(int connfd, struct sockaddr_in *clientaddr);
+pid_t startChild(int origin);
+void shedRequest(int connfd);
+void paceClient(size_t n);
+void routeRequest(size_t len);
+int originAvailable();
+void originFailed(const char *host, int port);
+void originNote(int tier, uint32_t ms);
+void serveCached(int connfd, struct sockaddr_in *clientaddr);
+void serveStale(int connfd, struct sockaddr_in *clientaddr);
+void probeOrigins(ioloop_t *loop, ioloop_timer_t *t, void *arg);
+void probeDone(ioloop_t *loop, int res, void *arg);
+void pickPeer();
+void sendDigest(int connfd);
+void refreshDigests(ioloop_t *loop, ioloop_timer_t *t, void *arg);
+void fetchDigests();
+int pageKey(char *key, size_t size);
+int variantKey(char *key, size_t size, const char *host, const char *path);
+int gzipKey(char *key, size_t size, int len);
+int queueChunk(struct bufChunk *c, void *arg);
+int connectOrigin();
+int pickOrigin();
+void backendUnreachable(const char *host, int port);
+long relayPage(int connfd, writer_t *writer, int writing);
+void relaySeen(const char *data, size_t n, void *arg);
+void prefetchPages();
+int notCached(const char *path, void *arg);
+store_t *pageTier(struct cachePage *page);
+void dropFromRam(struct cachePage *page);
+void demotePage(cache_entry_t *re, void *arg);
+void promotePage(cache_entry_t *e);
+int admitToRam(int slot);
+void droppedHere(struct storeObject *o, void *arg);
+int sendFromDisk(int connfd, struct cachePage *page);
+size_t sendfileRange(int connfd, off_t pos, size_t n);
+void holdPage(struct cachePage *page);
+int sendRanges(int connfd, struct cachePage *page);
+size_t sendPageBytes(int connfd, struct cachePage *page, size_t from, size_t n);
+int copyBlock(const char *data, size_t n, void *arg);
+int rangePart(char *part, size_t size, const char *type, struct httpRange *r, unsigned long long length);
+void buildRequest(http_head_t *request, int ranged);
+void fetchWhole();
+int sendPacked(int connfd, struct cachePage *page);
+int sizeFill(const char *data, size_t n, writer_t *writer);
+void bypassPage(uint64_t hash);
+int isBypassed(uint64_t hash);
+int pinPage(struct cachePage *page);
+void unpinPage(struct cachePage *page);
+void releasePage(struct cachePage *page);
+void dropBody(struct cachePage *page);
+size_t sharedLength(struct cachePage *page);
+int findBody(store_fill_t *fill, uint64_t *hash, size_t *headLength);
+int shareBody(cache_entry_t *e, struct fillNote *note);
+void writeNote(struct fillNote *note);
+void purgeRequest(int connfd, struct sockaddr_in *clientaddr, size_t len);
+int varyChanged(store_fill_t *fill);
+int sendBlock(const char *data, size_t n, void *arg);
+int packable(store_fill_t *fill);
+int isPacked(store_t *s, uint64_t offset, size_t length);
+void reloadPage(const char *key, const struct checkpointRecord *r, void *arg);
+int checkpointPage(cache_entry_t *e, struct checkpointRecord *r, void *arg);
+void saveCheckpoint();
 int checkIfIPCached(char* hostname);
 void sigchld_handler(int sig);
 int Openclientfd(char *hostname, int port);
 int openclientfd(char *hostname, int port);
-int checkFileLength();
 
 //structure to store a DNS entry and map it to the host name
 struct DNSCache {
 	char hostName[MAXLINE];
-	struct hostent *hp;
+	upstream_t upstream;	//every address of the host and how connecting to each has gone
 };
 
-//structure to store a page and map it to a host name and path
+//structure to track where the page in each cache index slot lives in the store
 struct cachePage {
-	char cachedHostName[MAXLINE];
-	char cachedPathName[MAXLINE];
-	char filename[1024];
+	int state;			//PAGE_EMPTY, PAGE_FILLING or PAGE_READY
+	uint64_t fillId;	//which fill the slot is waiting for, stale notes are ignored
+	uint64_t offset;	//object offset in the store file
+	uint64_t seq;		//object sequence number, see store.h
+	size_t length;		//bytes in the page
+	int verified;		//payload checksum checked since it was reloaded from a checkpoint
+	int tier;			//TIER_DISK or TIER_RAM, which store offset and seq point into
+	int ramSlot;		//slot in ramCache while the page is in memory
+	int hits;			//hits since the page was written to disk, for promotion
+	time_t filled;		//when the page was fetched, or reloaded after a restart
+	int packed;			//stored compressed, length is the packed length, see pack.h
+	int blob;			//dedup entry of the page's body, -1 if it is not in the table
+	int shared;			//the page's object holds only its head, its body is blob's
+};
+#define PAGE_EMPTY   0
+#define PAGE_FILLING 1
+#define PAGE_READY   2
+#define TIER_DISK    0
+#define TIER_RAM     1
+
+#define HOST_NOTE_NAME 256	//longest host name reported, a note has to fit in one pipe write
+
+//structure a child writes to notePipe when it finishes a fill, the store drops a page or an
+//origin's response starts or fails to
+struct fillNote {
+	int type;			//NOTE_FILLED, NOTE_DROPPED, NOTE_UNFILLED, NOTE_ORIGIN, NOTE_BYPASS or NOTE_VARY
+	int slot;			//cache slot
+	int tier;			//store the page was written to; for NOTE_ORIGIN 1 if the origin answered, 0 if it
+						//did not, -1 if it could not be connected to
+	uint64_t fillId;
+	uint64_t offset;
+	uint64_t seq;
+	uint32_t length;	//page bytes, or ms to the origin's first byte for NOTE_ORIGIN
+	uint32_t headLength;	//bytes of the page's head before a body worth sharing, 0 for none
+	uint64_t bodyHash;	//dedup_hash of that body
+	int blob;			//dedup entry whose body the page shares, the object is only its head; -1 for none
+	uint64_t blobSeq;	//object that entry held when the child found it
+	char vary[VARY_NAMES];	//headers the page's URL varies by for NOTE_VARY, empty if it does not
+	char host[HOST_NOTE_NAME];	//the origin for NOTE_ORIGIN, whose circuit it counts against
+	int port;
+};
+#define NOTE_FILLED  1
+#define NOTE_DROPPED 2
+#define NOTE_UNFILLED 3	//the fill never started, its origin could not be connected to
+#define NOTE_ORIGIN  4
+#define NOTE_BYPASS  5	//the page is too large to cache
+#define NOTE_VARY    6	//the page varies by other headers than it was keyed by
+
+//structure a child writes to hostPipe after resolving or connecting to a host, so the parent's
+//DNS cache has its addresses and how connecting to each has gone
+struct hostNote {
+	char host[HOST_NOTE_NAME];
+	upstream_t upstream;
+};
+
+//structure remembering a page found too large to cache, so its misses are relayed without a fill
+struct bypassEntry {
+	uint64_t hash;		//index key hash, 0 for none
+	time_t since;		//when it was found too large
 };
 
-struct DNSCache DNSCaches[1024];		//array to hold DNS caches
-struct cachePage cachedPages[1024];		//array to hold page caches
-int fileCount = 0;						//number of files stored in the page cache
-int isPageCached = -1;					//location of a page in the array if the lookup finds it was cached
+//structure for where relayed chunks go, see queueChunk
+struct relayTarget {
+	int connfd;
+	outq_t *out;				//client's output queue
+	writer_t *writer;			//cache fill, if writing
+	int writing;
+};
+
+//structure for a connection whose request line the parent is still reading
+struct pendingConn {
+	int fd;						//-1 while the structure is free
+	struct sockaddr_in addr;	//client address, filled in by the accept
+	socklen_t addrlen;
+	struct bufChunk *head;		//request line so far, taken from bufPool once the first bytes arrive
+	arena_t arena;				//parsed pieces of the request
+	ioloop_timer_t timer;		//config.headerTimeout from the accept
+	struct pendingConn *next;	//free list
+};
+#define DNS_CACHE_SIZE    1024	//hosts whose addresses are kept
+#define ACCEPTS_IN_FLIGHT 8		//accepts kept queued so a burst of connections is taken in one pass
+#define RELAY_RING_AFTER  8		//blocks a miss relays one syscall at a time before it sets up a ring
+#define RELAY_RING_BUFFER (64 << 10)	//bytes of each of the two buffers a ring relays through
+#define PACE_CHUNK        (64 << 10)	//bytes of a cached page sent at a time while a byte limit paces it
+#define SENDFILE_HOLD     60		//seconds a page sent with sendfile keeps its space from being reused
+#define PROBES_IN_FLIGHT  16		//connect probes of open origins running at once
+#define RANGE_BOUNDARY    "PROXY_BYTERANGES"	//separates the parts of a multiple range response
+#define BYPASS_ENTRIES    1024	//pages too large to cache that are remembered, by key hash
+
+struct DNSCache DNSCaches[DNS_CACHE_SIZE];	//array to hold DNS caches
+cache_t pageCache;						//index of cached pages, see cache.c
+struct cachePage *cachedPages;			//store location of each slot in pageCache
+store_t pageStore;						//single file holding every cached page, see store.c
+store_t ramStore;						//in-memory tier for small and hot pages
+cache_t ramCache;						//pages held in ramStore, evicting one demotes it to pageStore
+int *ramOwner;							//pageCache slot of each ramCache slot, -1 while it is being dropped
+bufpool_t bufPool;						//MAXLINE buffers for request lines, arenas and relays
+admit_t admission;						//children running and the adaptive limit on them, see admit.c
+http_head_t overloadResponse;			//503 sent, prebuilt, to requests over the limit
+int originBucket = -1;					//admission bucket of the origin the current request fetches from
+ratelimit_t rateLimit;					//per-client request and byte buckets, shared with the children
+http_head_t throttledResponse;			//429 sent, prebuilt, to clients over their request rate
+struct backendPool *routePool;			//reverse proxy pool the current request was routed to, NULL if forwarded
+struct backend *backend;				//backend of routePool the current request is fetched from
+struct rateEntry *clientRate;			//buckets of the current request's client, NULL if it is not limited
+uint32_t clientAddr;					//address of the current request's client
+uint64_t requestSent;					//ioloop_time() the current request went to the origin
+health_t health;						//circuit breakers of origins by host and port, see health.c
+ioloop_timer_t probeTimer;				//config.healthProbeInterval between probes of open origins
+int probesRunning = 0;					//probes waiting on their connect
+int pageStale = 0;						//the page checkIfPageCached found is older than config.cacheTtl
+int staleSlot = -1;						//stale page kept pinned while the child connects to refetch it
+struct peer *peer;						//peer node the current request is fetched from, NULL for its origin
+int keepCopy = 1;						//cache what the current request fetches, not done when its owner is a peer
+int fromPeer = 0;						//PEER_ASKED_OWNER or PEER_ASKED_DIGEST if the current request came from a peer
+ioloop_timer_t digestTimer;				//config.peerDigestInterval between digest refreshes
+int acceptGzip = 0;						//client accepts gzip, its page is the gzip variant
+int compressing = 0;					//the child compresses the response it relays, see gzip.c
+gzip_t gzipper;							//compressor of the current relay while compressing
+int prefetched = 0;						//the current request is one of this proxy's own prefetches
+int scanning = 0;						//the child scans the page it relays for subresources to prefetch
+prefetch_t prefetcher;					//scanner of the current relay while scanning, see prefetch.c
+int listenPort;							//port this proxy listens on, which prefetches are sent to
+char rangeSpec[256] = "";				//the current request's Range, empty if it has none or ranges are off
+char ifRange[256] = "";					//its If-Range, which a cached page must match for the Range to apply
+int pageFilling = 0;					//the page checkIfPageCached looked up is being filled for another request
+int fillBehind = 0;						//the child fetches the whole page for the cache after relaying a range of it
+ioloop_t relayLoop;						//the child's io_uring for relaying long responses, once relayRing is set
+int relayRing = 0;						//relayLoop is set up and its buffers registered
+char *relayBufs[2];						//relayLoop's buffers, allocated with it and kept for the child's life
+dedup_t dedup;							//page bodies by content, shared by every page with the same body
+purge_index_t purgeIndex;				//keys of the pages in pageCache, by prefix, for purges
+int *purgeSlots;						//slots of the pages a purge matches
+vary_t varyIndex;						//headers each URL known to vary by them varies by
+char varyNames[VARY_NAMES] = "";		//those the current request's page was keyed by, empty if none
+char varyHeaders[VARY_HEADERS] = "";	//the request's lines for them, forwarded to the origin
+struct bypassEntry bypassed[BYPASS_ENTRIES];	//pages streamed through uncached, direct mapped by key hash
+int streaming = 0;						//the current page is too large to cache, it is relayed without a copy
+int notePipe[2];						//children report fills to the parent through this pipe
+struct fillNote noteBuf[64];			//notes read from notePipe in one go
+int hostPipe[2];						//children report hosts they resolved or connected to through this pipe
+struct hostNote hostNoteBuf[4];			//notes read from hostPipe in one go
+pid_t parentPid;						//the parent, which owns DNSCaches
+ioloop_t loop;							//parent's accepts and reads, see ioloop.c
+int listenfd;							//listening descriptor
+struct pendingConn *pendingConns;		//config.maxPending connections reading their request line
+struct pendingConn *freeConns;			//unused entries of pendingConns
+size_t nfreeConns = 0;
+int acceptsQueued = 0;					//accepts waiting in the loop, each holds a free connection
+uint64_t fillCount = 0;					//number of fills started, used as fill ids
+int fileSlot = -1;						//slot the current page is being cached under
+time_t lastCheckpoint;					//when the index was last saved to config.indexFile
+uint64_t requestDeadline = 0;			//ioloop_time() the current request must be done by, 0 for none
+unsigned long indexChanges = 0;			//pages added or dropped since the last checkpoint
+int isPageCached = -1;					//slot of a page in the index if the lookup finds it was cached
 int hostsCached = 0;					//number of DNS entries cached
 int isIPCached = -1;					//location of a DNS entry in the DNS array if found
 
 int port; //port requested by user
-rio_t rio; //a file descriptor for the Rio package
 size_t n; //amount of data read from the client
-char buf[MAXLINE], uri[MAXLINE], version[MAXLINE], method[MAXLINE]; //a buffer to read client data and a set of variables to parse the buffer into
-char hostname[MAXLINE]; // the host name resolved from the uri
-char pathname[MAXLINE]; // the path name resolved from the uri
+char *buf, *uri, *version, *method; //the request line and the pieces it is parsed into, in the connection's arena
+char *hostname; // the host name resolved from the uri
+char *pathname; // the path name resolved from the uri
 int serverfd; //the file descriptor for the connection from the proxy to the host server
 char status[36] = ""; //a placeholder for status messages to be added for the log
 
@@ -60,6 +310,8 @@ const char* HOSTCACHED = "(HOSTNAME CACHED)";
 const char* PAGECACHED = "(PAGE CACHED)";
 const char* NOTFOUND = "(NOTFOUND)";
 const char* NOTCACHED = "(ADDED TO CACHE)";
+const char* FROMPEER = "(FROM PEER)";
+const char* STREAMED = "(STREAMED)";
 
 /* 
  * main - Main routine for the proxy program 
@@ -73,95 +325,645 @@ const char* NOTCACHED = "(ADDED TO CACHE)";
  */
 int main(int argc, char **argv)
 {     
-	int listenfd, connfd, clientlen; //listenfd for listening descriptor, connfd for connected descriptor
-	struct sockaddr_in clientaddr;
+    int i, j;
 
     /* Check arguments */
-    if (argc != 2) {
-		fprintf(stderr, "Usage: %s <port number>\n", argv[0]);
+    if (argc != 2 && argc != 3) {
+		fprintf(stderr, "Usage: %s <port number> [config file]\n", argv[0]);
 		exit(0);
     }
 
+	config_defaults(&config);
+	if (argc == 3 && config_load(&config, argv[2]) < 0)  //optional settings file
+		exit(1);
+	cache_init(&pageCache, config.cachePolicy, config.cacheEntries, config.cacheBytes);
+	cache_set_evict(&pageCache, evictPage, NULL);
+	cachedPages = Calloc(config.cacheEntries, sizeof(struct cachePage));
+	dedup_init(&dedup, config.dedupMinBytes > 0 ? config.cacheEntries : 0);
+	purge_init(&purgeIndex, config.cacheEntries);
+	vary_init(&varyIndex);
+	purgeSlots = Malloc(config.cacheEntries * sizeof(int));
+	int warm = store_open(&pageStore, config.storeFile, config.storeBytes, config.storeLogBytes, config.storeHugepages);
+	if (warm < 0)
+		exit(1);
+	if (warm) {  //store survived a restart, reload the index that points into it
+		struct timeval start, end;
+		long loaded;
+
+		gettimeofday(&start, NULL);
+		loaded = checkpoint_load(config.indexFile, pageStore.hdr->storeId, config.cacheEntries,
+					 config.cacheBytes, reloadPage, NULL);
+		store_recover_end(&pageStore);
+		gettimeofday(&end, NULL);
+		printf("Reloaded %ld of %ld cached pages in %.3f s\n", (long)pageCache.count, loaded < 0 ? 0 : loaded,
+		       (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6);
+		fflush(stdout);
+	}
+	lastCheckpoint = time(NULL);  //no checkpoint is due until the interval passes
+
+	//memory tier, sized so slab rounding does not keep it from reaching its budget
+	if (config.ramMaxObject > STORE_PAGE_SIZE - sizeof(struct storeObject))
+		config.ramMaxObject = STORE_PAGE_SIZE - sizeof(struct storeObject);
+	if (config.ramAdmitBytes > config.ramMaxObject)
+		config.ramAdmitBytes = config.ramMaxObject;
+	if (config.ramBytes > 0) {
+		if (store_open(&ramStore, NULL, config.ramBytes + config.ramBytes / 4 + 2 * STORE_PAGE_SIZE, 0, 0) < 0)
+			exit(1);
+		cache_init(&ramCache, CACHE_LRU, config.cacheEntries, config.ramBytes);
+		cache_set_evict(&ramCache, demotePage, NULL);
+		ramOwner = Malloc(config.cacheEntries * sizeof(int));
+	}
+
+	//children report finished fills back through this pipe, see fillNotesRead
+	if (pipe(notePipe) < 0 || pipe(hostPipe) < 0)
+		unix_error("pipe error");
+	parentPid = getpid();
+
+	bufpool_init(&bufPool, MAXLINE, 16);
+	admit_init(&admission, config.maxInFlight, config.originMaxInFlight, config.latencyTarget);
+	health_init(&health, config.healthFailures, config.healthOpenTime);
+	http_head_init(&overloadResponse);
+	http_head_add(&overloadResponse, "HTTP/1.1 503 Service Unavailable\r\n");
+	http_head_add(&overloadResponse, "Retry-After: %d\r\n", config.retryAfter);
+	http_head_add(&overloadResponse, "Content-Length: 0\r\nConnection: close\r\n\r\n");
+	if (ratelimit_init(&rateLimit, config.rateClients, config.rateRequests,
+			   config.rateRequestBurst > 0 ? config.rateRequestBurst : config.rateRequests,
+			   config.rateBytes, config.rateByteBurst, config.rateIdle) < 0)
+		unix_error("rate limit table");
+	for (i = 0; i < config.routes.npools; i++)  //backends' outstanding requests are counted by admission
+		for (j = 0; j < config.routes.pools[i].nbackends; j++)
+			config.routes.pools[i].backends[j].origin =
+				admit_origin(config.routes.pools[i].backends[j].host, config.routes.pools[i].backends[j].port);
+	if (config.peers.npeers > 0) {  //peers are counted and circuit broken like any origin
+		char selfHost[256] = "localhost", *colon;
+		int selfPort = atoi(argv[1]);
+
+		if ((colon = strrchr(config.peerSelf, ':')) != NULL) {
+			*colon = '\0';
+			strcpy(selfHost, config.peerSelf);
+			selfPort = atoi(colon + 1);
+		}
+		if (peer_ring(&config.peers, selfHost, selfPort, config.cacheEntries) < 0)
+			unix_error("peer ring");
+		for (i = 0; i < config.peers.npeers; i++)
+			config.peers.peers[i].origin = admit_origin(config.peers.peers[i].host, config.peers.peers[i].port);
+		printf("Peering with %d nodes%s\n", config.peers.npeers, config.peers.self < 0 ? ", none of them this one" : "");
+	}
+	http_head_init(&throttledResponse);
+	http_head_add(&throttledResponse, "HTTP/1.1 429 Too Many Requests\r\n");
+	http_head_add(&throttledResponse, "Retry-After: %d\r\n", config.rateRequests >= 1 ? 1 : (int)(1 / config.rateRequests + 0.999));
+	http_head_add(&throttledResponse, "Content-Length: 0\r\nConnection: close\r\n\r\n");
+
 	port = atoi(argv[1]);  //listens on port passed on the command line
+	listenPort = port;  //port is reused for each request's origin
 	Signal(SIGCHLD, sigchld_handler);
-	listenfd = Open_listenfd(port);   //listening descriptor
+	Signal(SIGPIPE, SIG_IGN);  //a peer gone mid-relay, or a socket shut by a deadline, fails the write instead
+	if ((listenfd = sockopt_listen(port, &config.listenOpts)) < 0)   //listening descriptor
+		unix_error("Open_listenfd error");
+
+	startLoop();  //accepts, request lines and fill notes are all driven by the I/O loop
 
 	while(1) {
-		clientlen = sizeof(clientaddr);
-		connfd = Accept(listenfd, (SA *)&clientaddr, (socklen_t *) &clientlen);   //Accept connection, returns connection file descriptor
+		if (ioloop_run(&loop, config.checkpointInterval > 0 ? 1000 : -1) < 0)
+			unix_error("ioloop error");
+		if (config.checkpointInterval > 0 && indexChanges > 0 &&
+		    time(NULL) - lastCheckpoint >= config.checkpointInterval) {
+			saveCheckpoint();
+		}
+	}
 
-		Rio_readinitb(&rio, connfd); //connection to client for reading, creates a read buffer
-		n = Rio_readlineb(&rio, buf, MAXLINE); //read from client
-		sscanf(buf, "%s %s %s", method, uri, version);  //scan input from client and extract method, uri, and version
-		if (strcmp(method, "GET") != 0) //if method is not GET, return error for invalid method
-		{
-			printf("%s is not a valid method. \n", method);  //prints to console 
-			char outputLine1[MAXLINE]; 
-			char outputLine2[MAXLINE]; 
-			char outputLine3[MAXLINE];
+    exit(0);   //should never get here
+}
+
+/*
+ * serveRequest - handles a connection whose request line is in buf:
+ * checks the method, parses the uri into strings allocated from arena,
+ * checks if the page and DNS are cached and forks a child that passes
+ * it off to handle_request.
+ */
+void serveRequest(int connfd, struct sockaddr_in *clientaddr, arena_t *arena)
+{
+	size_t len = strlen(buf) + 1;  //no piece of the line is longer than the line
+
+	method = arena_alloc(arena, len);
+	uri = arena_alloc(arena, len);
+	version = arena_alloc(arena, len);
+	hostname = arena_alloc(arena, len);
+	pathname = arena_alloc(arena, len);
+	if (!method || !uri || !version || !hostname || !pathname) {
+		Close(connfd);
+		return;
+	}
+	method[0] = uri[0] = version[0] = hostname[0] = pathname[0] = '\0';
+	status[0] = '\0';
+	isIPCached = -1;
+	requestDeadline = config.requestTimeout > 0 ? ioloop_time() + config.requestTimeout : 0;
+
+	sscanf(buf, "%s %s %s", method, uri, version);  //scan input from client and extract method, uri, and version
+	if (strcmp(method, "PURGE") == 0) {
+		purgeRequest(connfd, clientaddr, len);
+	}
+	else if (strcmp(method, "GET") != 0) //if method is not GET, return error for invalid method
+	{
+		printf("%s is not a valid method. \n", method);  //prints to console 
+		static http_head_t errorHead;
 
-			//error message to send out connection fd for invalid method
-			sprintf(outputLine1, "HTTP/1.1 400 OK\n");   
-			sprintf(outputLine2, "Content-Type: text/html; charset=ISO-8859-1\n");
-			sprintf(outputLine3, "Connection: close\n\n");
+		//error message to send out connection fd for invalid method
+		http_head_init(&errorHead);
+		http_head_add(&errorHead, "HTTP/1.1 400 OK\n");
+		http_head_add(&errorHead, "Content-Type: text/html; charset=ISO-8859-1\n");
+		http_head_add(&errorHead, "Connection: close\n\n");
 
-			//write error message to client
-			Write(connfd, outputLine1, strlen(outputLine1));
-			Write(connfd, outputLine2, strlen(outputLine2));
-			Write(connfd, outputLine3, strlen(outputLine3));
+		//write error message to client in one send, without waiting on it or failing with it: this is the parent
+		http_head_send(connfd, &errorHead, MSG_DONTWAIT);
 
+		Close(connfd);
+	}
+	else if (config.peers.npeers > 0 && strcmp(uri, PEER_DIGEST_PATH) == 0) {
+		sendDigest(connfd);
+	}
+	else {
+		char flag[16], accept[256];
+
+		parse_uri(uri, hostname, pathname, &port);  //call parse_uri to extract host name, path name, and port
+		originBucket = -1;
+		routePool = NULL;
+		backend = NULL;
+		peer = NULL;
+		keepCopy = 1;
+		fromPeer = 0;
+		if (config.peers.npeers > 0 && http_header(buf, PEER_HEADER, flag, sizeof(flag)) == 0)
+			fromPeer = strcmp(flag, "digest") == 0 ? PEER_ASKED_DIGEST : PEER_ASKED_OWNER;
+		rangeSpec[0] = ifRange[0] = '\0';
+		fillBehind = 0;
+		streaming = 0;
+		if (config.rangeRequests != HTTP_RANGE_OFF && http_header(buf, "Range", rangeSpec, sizeof(rangeSpec)) == 0 &&
+		    http_header(buf, "If-Range", ifRange, sizeof(ifRange)) < 0)
+			ifRange[0] = '\0';
+		prefetched = config.prefetchConcurrency > 0 && http_header(buf, PREFETCH_HEADER, flag, sizeof(flag)) == 0;
+		acceptGzip = config.compressLevel > 0 && http_header(buf, "Accept-Encoding", accept, sizeof(accept)) == 0 &&
+			     http_accepts(accept, "gzip");
+		if (uri[0] == '/' && config.routes.nroutes > 0)  //reverse proxy, the site is named by the Host header
+			routeRequest(len);
+		clientAddr = clientaddr->sin_addr.s_addr;
+		clientRate = ratelimit_entry(&rateLimit, clientAddr, 1);
+		if (ratelimit_request(&rateLimit, clientRate, clientAddr) < 0) {  //over its request rate
+			http_head_send(connfd, &throttledResponse, MSG_DONTWAIT);
 			Close(connfd);
+			return;
+		}
+		if (admit_check(&admission, -1) < 0) {  //at the limit, turn it away before doing any work
+			shedRequest(connfd);
+			return;
 		}
-		else {
-			parse_uri(uri, hostname, pathname, &port);  //call parse_uri to extract host name, path name, and port
-			if (fileCount == 1024) {      //max filecount is 1024.  So if file count reaches 1024, reset filecount to zero
-				fileCount = 0;
-			}
-
-			//check if page is cached
-			isPageCached = checkIfPageCached();
 
-			if (hostname == NULL) {   //if host null, then print invalid to console
-				printf("Invalid host name.\n");
+		//check if page is cached
+		isPageCached = checkIfPageCached();
+		staleSlot = -1;
+		if (isPageCached > -1 && pageStale) {  //past config.cacheTtl: refetch it, unless its origin is down
+			//or only a range of it is asked for and would not be cached: the next full request refetches it
+			if (originAvailable() && (rangeSpec[0] == '\0' || config.rangeRequests == HTTP_RANGE_FILL)) {
+				staleSlot = isPageCached;  //still pinned, served after all if the refetch cannot start
+				isPageCached = -1;
 			}
-			else {
-				if ((serverfd = Openclientfd(hostname, port)) < 0) //if Openclient returns less than 0, then host was not found
-				{
+			else
+				printf("Slot %d is stale, served as is while %s is down\n", isPageCached, hostname);
+		}
+		if (isPageCached < 0 && routePool == NULL && config.peers.npeers > 0 && fromPeer != PEER_ASKED_DIGEST)
+			pickPeer();
+
+		if (hostname[0] == '\0') {   //if host empty, then print invalid to console
+			printf("Invalid host name.\n");
+			Close(connfd);
+		}
+		else if (isPageCached > -1) {  //served from the store, no need to contact the host
+			serveCached(connfd, clientaddr);
+		}
+		else if (peer == NULL && !originAvailable()) {  //circuit is open, fail now rather than wait out a connect
+			printf("%s is down\n", hostname);
+			shedRequest(connfd);
+		}
+		else if (routePool != NULL && (backend = route_pick(&config.routes, routePool, admission.originLoad, NULL)) == NULL) {
+			Close(connfd);  //cannot happen, routed pools have backends
+		}
+		else if (admit_check(&admission, originBucket = backend ? backend->origin :
+					 peer ? peer->origin : admit_origin(hostname, port)) < 0) {
+			if (staleSlot > -1)
+				serveStale(connfd, clientaddr);
+			else
+				shedRequest(connfd);  //the origin already has its share of children
+		}
+		else {
+			if (pickOrigin() < 0) { //every circuit the request could go through is open
+				if (staleSlot > -1) {
+					serveStale(connfd, clientaddr);
+				}
+				else {
 					char logstring[MAXLINE];
 					strcpy(status, NOTFOUND);
 					//write to log file
-					format_log_entry(logstring, &clientaddr, uri, 0, status);
+					format_log_entry(logstring, clientaddr, uri, 0, status);
+					Close(connfd);
+				}
+			}
+			else { //the child connects, so a slow or dead origin holds up no one else
+				char key[2 * MAXLINE];
+				int keylen = pageKey(key, sizeof(key));
+				cache_entry_t *e = NULL;
+				uint64_t hash = keylen >= 0 ? cache_hash(key, keylen) : 0;
+
+				//add page to the cache, the child fills it in and reports back; a stale page is
+				//refetched into its own slot and served until the fill replaces it
+				if (staleSlot > -1)
+					fileSlot = staleSlot;
+				if (!keepCopy)
+					fileSlot = -1;  //fetched from the peer that owns it, which caches it
+				else if (rangeSpec[0] != '\0' && (config.rangeRequests != HTTP_RANGE_FILL || pageFilling || peer != NULL))
+					fileSlot = -1;  //the origin's answer to a range is relayed, not cached
+				else if (fileSlot < 0 && keylen >= 0 && isBypassed(hash))
+					streaming = 1;
+				else if (fileSlot < 0 && keylen >= 0)
+					e = cache_insert(&pageCache, key, keylen, hash, 0);
+				if (e != NULL) {
+					fileSlot = e->slot;
+					purge_add(&purgeIndex, key, keylen, e->slot);
+				}
+				if (fileSlot > -1) {
+					if (fileSlot != staleSlot)
+						cachedPages[fileSlot].state = PAGE_FILLING;
+					cachedPages[fileSlot].fillId = ++fillCount;
 				}
-				else { //connection was good
-					char fileCountAsChar[4];
-					sprintf(fileCountAsChar, "%d", fileCount); //convert fileCount variable to a char array to use as filename
-
-					//add file to the cache
-					strcpy(cachedPages[fileCount].cachedHostName, hostname);
-					strcpy(cachedPages[fileCount].cachedPathName, pathname);
-					strcpy(cachedPages[fileCount].filename, fileCountAsChar);
-
-					if (fork() == 0) { //if child
-						Close(listenfd); //close listen socket
-					
-						if (handle_request(connfd, &clientaddr) < 0) //handle request
+				fillBehind = rangeSpec[0] != '\0' && fileSlot > -1;
+
+				if (startChild(originBucket) == 0) { //if child
+					closeInherited(connfd); //close listen socket and other connections
+
+					if ((serverfd = connectOrigin()) < 0) {
+						unreachable(connfd, clientaddr);
+					}
+					else {
+						if (staleSlot > -1)  //refetched, the fill replaces it
+							unpinPage(&cachedPages[staleSlot]);
+						if (handle_request(connfd, clientaddr) < 0) //handle request
 						{
 							printf("Error Handling Request");
 						}
-						exit(0);  //on exit will close remaining fd and child ends
-					}
-					else  //if parent
-					{
-						Close(connfd);  //close connection fd
-						Close(serverfd);  //close server fd
-						fileCount++; //increase file count
 					}
+					exit(0);  //on exit will close remaining fd and child ends
+				}
+				else  //if parent
+				{
+					Close(connfd);  //close connection fd
 				}
 			}
 		}
 	}
+}
 
-    exit(0);   //should never get here
+//serveCached   forks a child that sends the page in isPageCached, pinned by checkIfPageCached
+void serveCached(int connfd, struct sockaddr_in *clientaddr) {
+	serverfd = -1;
+	if (startChild(-1) == 0) { //if child
+		closeInherited(connfd); //close listen socket and other connections
+		if (handle_request(connfd, clientaddr) < 0) //handle request
+		{
+			printf("Error Handling Request");
+		}
+		exit(0);
+	}
+	Close(connfd);  //parent: the child holds the store reference taken in checkIfPageCached
+}
+
+//serveStale   serves the stale page in staleSlot after all, its refetch could not be started
+void serveStale(int connfd, struct sockaddr_in *clientaddr) {
+	printf("Slot %d is stale, served as is while %s cannot be fetched\n", staleSlot, hostname);
+	isPageCached = staleSlot;
+	serveCached(connfd, clientaddr);
+}
+
+//pickPeer   picks the peer node the current miss is fetched from: the page's owner on the
+//ring, unless that is this node or it is down, else a peer whose digest says it has the page.
+//A request a peer sent as the owner is not passed to another owner, so it goes two hops at most.
+void pickPeer() {
+	peers_t *p = &config.peers;
+	char key[2 * MAXLINE];
+	uint64_t now = ioloop_time(), h;
+	int keylen, owner, i;
+
+	if ((keylen = pageKey(key, sizeof(key))) < 0)
+		return;
+	h = cache_hash(key, keylen);
+	owner = peer_owner(p, h);
+	if (owner != p->self && !fromPeer && health_allow(&health, p->peers[owner].host, p->peers[owner].port, now)) {
+		peer = &p->peers[owner];
+		keepCopy = 0;
+		return;
+	}
+	for (i = 0; i < p->npeers; i++) {
+		if (i != p->self && i != owner && peer_digest_test(p, i, h) &&
+		    health_allow(&health, p->peers[i].host, p->peers[i].port, now)) {
+			peer = &p->peers[i];
+			return;
+		}
+	}
+}
+
+//sendDigest   answers a peer asking for this node's digest, from a child so a large one never
+//holds up the parent
+void sendDigest(int connfd) {
+	http_head_t head;
+
+	if (startChild(-1) == 0) {
+		closeInherited(connfd);
+		http_head_init(&head);
+		http_head_add(&head, "HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream\r\n");
+		http_head_add(&head, "Content-Length: %lu\r\n\r\n", (unsigned long)config.peers.ownBytes);
+		if (http_head_send(connfd, &head, 0) >= 0)
+			rio_writen(connfd, config.peers.own, config.peers.ownBytes);
+		exit(0);
+	}
+	Close(connfd);
+}
+
+//refreshDigests   timer callback, rebuilds this node's digest from the pages it holds and forks
+//a child to fetch the other peers' digests
+void refreshDigests(ioloop_t *loop, ioloop_timer_t *t, void *arg) {
+	size_t i;
+
+	peer_digest_clear(&config.peers);
+	for (i = 0; i < config.cacheEntries; i++)
+		if (pageCache.entries[i].inuse && cachedPages[i].state == PAGE_READY)
+			peer_digest_add(&config.peers, pageCache.entries[i].hash);
+	fflush(stdout);  //or the child prints it again
+	if (fork() == 0) {
+		closeInherited(-1);
+		fetchDigests();
+		exit(0);
+	}
+	ioloop_timer_arm(loop, t, config.peerDigestInterval);
+}
+
+//fetchDigests   fetches every other peer's digest into the table shared with the parent, runs
+//in a child.  A peer that does not answer keeps its last digest.
+void fetchDigests() {
+	peers_t *p = &config.peers;
+	unsigned char *bits = Malloc(PEER_DIGEST_MAX);
+	char line[MAXLINE];
+	size_t length;
+	rio_t rio;
+	int i, fd;
+
+	for (i = 0; i < p->npeers; i++) {
+		if (i == p->self || (fd = Openclientfd(p->peers[i].host, p->peers[i].port)) < 0)
+			continue;
+		setTimeout(fd, SO_RCVTIMEO, config.firstByteTimeout);
+		length = 0;
+		sprintf(line, "GET %s HTTP/1.0\r\n\r\n", PEER_DIGEST_PATH);
+		if (rio_writen(fd, line, strlen(line)) < 0) {
+			Close(fd);
+			continue;
+		}
+		rio_readinitb(&rio, fd);
+		while (rio_readlineb(&rio, line, sizeof(line)) > 0 && strcmp(line, "\r\n") != 0)
+			if (strncasecmp(line, "Content-Length:", 15) == 0)
+				length = strtoul(line + 15, NULL, 10);
+		if (length > 0 && length <= PEER_DIGEST_MAX && rio_readnb(&rio, bits, length) == (ssize_t)length)
+			peer_digest_set(p, i, bits, length);
+		Close(fd);
+	}
+	free(bits);
+}
+
+//startChild   forks a child for the current request and counts it against the admission
+//limits until it is reaped.  Returns like fork.
+pid_t startChild(int origin) {
+	sigset_t mask, prev;
+	pid_t pid;
+
+	//a child that exits at once is reaped only after it has been counted
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	Sigprocmask(SIG_BLOCK, &mask, &prev);
+	if ((pid = fork()) > 0)
+		admit_start(&admission, pid, origin);
+	Sigprocmask(SIG_SETMASK, &prev, NULL);
+	return pid;
+}
+
+//purgeRequest   drops the page at the URL of a PURGE, whose head of len bytes is in buf, from the
+//index, with its variants; a URL ending in '*' drops every page under it, and "http://host/*"
+//all of a host's.  The pages are found in purgeIndex, so the parent does it inline at a cost of
+//the pages matched, and their objects are released as on eviction: a child still sending one
+//finishes first.  Only clients config.purge allows may purge.
+void purgeRequest(int connfd, struct sockaddr_in *clientaddr, size_t len) {
+	char key[2 * MAXLINE], body[64];
+	http_head_t response;
+	cache_entry_t *e;
+	size_t matched, purged = 0, i;
+	int keylen, prefix = 0;
+
+	http_head_init(&response);
+	if (config.purge == PURGE_OFF ||
+	    (config.purge == PURGE_LOCAL && (ntohl(clientaddr->sin_addr.s_addr) >> 24) != 127)) {
+		printf("PURGE %s refused\n", uri);
+		http_head_add(&response, "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+		http_head_send(connfd, &response, MSG_DONTWAIT);
+		Close(connfd);
+		return;
+	}
+
+	parse_uri(uri, hostname, pathname, &port);
+	if (uri[0] == '/' && config.routes.nroutes > 0)  //reverse proxy, the site is named by the Host header
+		routeRequest(len);
+	if (hostname[0] != '\0' && (keylen = cache_makekey(key, sizeof(key), hostname, pathname)) > 0) {
+		if (key[keylen - 1] == '*') {
+			key[--keylen] = '\0';
+			prefix = 1;
+		}
+		matched = purge_match(&purgeIndex, key, keylen, purgeSlots);
+		for (i = 0; i < matched; i++) {
+			e = &pageCache.entries[purgeSlots[i]];
+			//an exact URL also matches longer ones that start with it, which are other pages
+			if (!prefix && e->keylen > (size_t)keylen && e->key[keylen] != ' ')
+				continue;
+			cache_remove(&pageCache, e);  //evictPage releases it and takes it out of purgeIndex
+			purged++;
+		}
+	}
+	printf("PURGE %s dropped %zu pages\n", uri, purged);
+
+	snprintf(body, sizeof(body), "Purged %zu pages\n", purged);
+	http_head_add(&response, purged > 0 ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n");
+	http_head_add(&response, "Content-Type: text/plain\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n%s",
+		      strlen(body), body);
+	http_head_send(connfd, &response, MSG_DONTWAIT);
+	Close(connfd);
+}
+
+//routeRequest   routes a request with a relative URI, whose head of len bytes is in buf, to a
+//backend pool.  The page is cached under the Host header's name, so every backend of a pool
+//fills and serves the same cache entries.  A request no route matches is left with no host.
+void routeRequest(size_t len) {
+	char *colon;
+
+	strcpy(pathname, uri + 1);
+	if (http_header(buf, "Host", hostname, len) < 0)
+		hostname[0] = '\0';
+	if ((colon = strchr(hostname, ':')) != NULL)
+		*colon = '\0';
+	if ((routePool = route_match(&config.routes, hostname, uri)) == NULL || routePool->nbackends == 0) {
+		printf("No backend for %s%s\n", hostname, uri);
+		routePool = NULL;
+		hostname[0] = '\0';
+		return;
+	}
+	if (hostname[0] == '\0')  //HTTP/1.0 without a Host header, cached under the pool instead
+		snprintf(hostname, len, "%s", routePool->name);
+}
+
+//pickOrigin   settles what the current request is fetched from before its child is forked to
+//connect, without blocking: a peer whose circuit is open is given up for the origin, and a
+//backend whose circuit is open is passed over for the next pick of its pool.  Returns -1 if
+//nothing is left to try.
+int pickOrigin() {
+	uint64_t now = ioloop_time();
+	struct backend *next;
+	int tries;
+
+	if (peer != NULL) {
+		if (health_begin(&health, peer->host, peer->port, now))
+			return 0;
+		peer = NULL;  //fetch it from the origin after all, and keep it
+		keepCopy = 1;
+		originBucket = admit_origin(hostname, port);
+	}
+	if (backend == NULL)
+		return health_begin(&health, hostname, port, now) ? 0 : -1;
+	for (tries = 1; !health_begin(&health, backend->host, backend->port, now); tries++) {
+		backend->retryAt = time(NULL) + ROUTE_RETRY;
+		if (tries == routePool->nbackends ||
+		    (next = route_pick(&config.routes, routePool, admission.originLoad, backend)) == NULL)
+			return -1;
+		backend = next;
+		originBucket = backend->origin;
+	}
+	return 0;
+}
+
+//connectOrigin   connects to what pickOrigin settled on, in the child, so resolving and the
+//connect timeout hold up only this request.  A peer that cannot be reached is given up for the
+//origin.  A backend that cannot be reached is passed over for the next pick of its pool whose
+//circuit is not open, making as many attempts as the pool has backends.  Each failure is
+//reported to the parent's circuits with NOTE_ORIGIN.
+int connectOrigin() {
+	uint64_t now = ioloop_time();
+	struct backend *next;
+	int fd, tries;
+
+	if (peer != NULL) {
+		if ((fd = Openclientfd(peer->host, peer->port)) >= 0)
+			return fd;
+		originNote(-1, 0);
+		peer = NULL;  //fetch it from the origin after all; only kept if the parent gave it a slot
+		keepCopy = 1;
+		originBucket = admit_origin(hostname, port);
+		if (!health_allow(&health, hostname, port, now))
+			return -1;
+	}
+	if (backend == NULL) {
+		if ((fd = Openclientfd(hostname, port)) < 0)
+			originNote(-1, 0);
+		return fd;
+	}
+	for (tries = 1; ; tries++) {
+		//the first was let through by the parent, maybe as its circuit's trial
+		if (tries == 1 || health_allow(&health, backend->host, backend->port, now)) {
+			if ((fd = Openclientfd(backend->host, backend->port)) >= 0)
+				return fd;
+			originNote(-1, 0);
+		}
+		backend->retryAt = time(NULL) + ROUTE_RETRY;
+		if (tries == routePool->nbackends ||
+		    (next = route_pick(&config.routes, routePool, admission.originLoad, backend)) == NULL)
+			return -1;
+		backend = next;
+		originBucket = backend->origin;
+	}
+}
+
+//originFailed   counts a failed connect or response against the circuit of host:port
+void originFailed(const char *host, int port) {
+	if (health_failure(&health, host, port, ioloop_time()) > 0) {
+		printf("%s:%d is down, requests for it fail for %d ms\n", host, port, config.healthOpenTime);
+		fflush(stdout);
+	}
+}
+
+//originAvailable   whether the current request's origin, or any backend of its pool, has a
+//circuit that lets requests through
+int originAvailable() {
+	uint64_t now = ioloop_time();
+	int i;
+
+	if (routePool == NULL)
+		return health_allow(&health, hostname, port, now);
+	for (i = 0; i < routePool->nbackends; i++)
+		if (health_allow(&health, routePool->backends[i].host, routePool->backends[i].port, now))
+			return 1;
+	return 0;
+}
+
+//backendUnreachable   passes over the backends at host:port for ROUTE_RETRY seconds, a child
+//could not connect to them
+void backendUnreachable(const char *host, int port) {
+	routes_t *t = &config.routes;
+	struct backend *b;
+	int i, j;
+
+	for (i = 0; i < t->npools; i++)
+		for (j = 0; j < t->pools[i].nbackends; j++) {
+			b = &t->pools[i].backends[j];
+			if (b->port == port && strcmp(b->host, host) == 0)
+				b->retryAt = time(NULL) + ROUTE_RETRY;
+		}
+}
+
+//paceClient   charges n bytes about to be sent to the client against its byte rate, sleeping
+//for as long as it is ahead of the rate
+void paceClient(size_t n) {
+	uint64_t wait = ratelimit_bytes(&rateLimit, clientRate, clientAddr, n);
+	struct timespec ts;
+
+	if (wait > 0) {
+		ts.tv_sec = wait / 1000000000;
+		ts.tv_nsec = wait % 1000000000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+//shedRequest   turns a request away with the prebuilt 503, never waiting on the client
+void shedRequest(int connfd) {
+	http_head_send(connfd, &overloadResponse, MSG_DONTWAIT);
+	Close(connfd);
+}
+
+//unreachable   ends a request whose origin could not be connected to, in its child: the stale
+//page it was to refresh is served after all, otherwise the client is dropped and the slot the
+//parent set aside for the fill is given back
+void unreachable(int connfd, struct sockaddr_in *clientaddr) {
+	char logstring[MAXLINE];
+
+	if (staleSlot > -1) {
+		printf("Slot %d is stale, served as is while %s cannot be fetched\n", staleSlot, hostname);
+		isPageCached = staleSlot;
+		handle_request(connfd, clientaddr);
+		return;
+	}
+	if (fileSlot > -1)
+		sendNote(NOTE_UNFILLED, fileSlot, 0, cachedPages[fileSlot].fillId, 0, 0, 0);
+	strcpy(status, NOTFOUND);
+	format_log_entry(logstring, clientaddr, uri, 0, status);
+	Close(connfd);
 }
 
 /* handle_request checks if main found the page was cached or not.
@@ -173,95 +975,87 @@ int handle_request(int connfd, struct sockaddr_in *sockaddr)
 {
 	int bufSize=0; //total size of data written to client
 	char logstring[MAXLINE]; //char array for log entry
-	char msg[MAXLINE]; //char array of data returned by host
-	size_t m; //length of data returned by host
+	ssize_t m; //bytes written to the client
 	FILE *fp; //file pointer to log file
-	FILE *cachedfp; //file pointer to a cached file
-	int cachedfd; //file descriptor to send data out to client
-	int fileGood = -1; //boolean that signifies whether cached file is valid before sending to client
-
-	if (isPageCached > -1) {  //checks if page is cached (assigned in main)
-		fileGood = checkFileLength();  //checks file length
-	}
+	writer_t writer; //stages a copy of the page being fetched, moved into the store after the relay
+	int writing = 0; //page is being copied for the cache
 
-	//if file is good and length not zero, then send cached page
-	if(fileGood > -1) 
+	setTimeout(connfd, SO_SNDTIMEO, config.idleTimeout); //a client that stops reading is dropped
+	if (isPageCached > -1)  //page is cached (assigned in main), copy it straight out of the mapped store
 	{
-		char fileLocationAsChar[4];
-		sprintf(fileLocationAsChar, "%d", isPageCached);
-		cachedfd = open(fileLocationAsChar, O_RDONLY);  //open cached file
-		if (cachedfd > -1)
-		{
-			if (strlen(status) == 0) {  //if status empty, string copy status message
-				strcpy(status, PAGECACHED);
-			}
-			else { //if status not empty, concatenate status message
-				strcat(status, PAGECACHED);
+		struct cachePage *page = &cachedPages[isPageCached];
+		size_t remaining = page->length;
+		char *pos;
+
+		if (strlen(status) == 0) {  //if status empty, string copy status message
+			strcpy(status, PAGECACHED);
+		}
+		else { //if status not empty, concatenate status message
+			strcat(status, PAGECACHED);
+		}
+		printf("Slot %d was output from %s\n", isPageCached, page->tier == TIER_RAM ? "memory" : "disk");
+		if (rangeSpec[0] != '\0' && (bufSize = sendRanges(connfd, page)) >= 0) {
+			//sent only the ranges asked for
+		}
+		else if (page->packed) {
+			bufSize = sendPacked(connfd, page);
+		}
+		else if (page->tier == TIER_RAM) {  //already in memory, copy it into the socket
+			pos = ramStore.base + page->offset + sizeof(struct storeObject);
+			bufSize = 0;
+			while (remaining > 0 && (m = write(connfd, pos, rateLimit.byteCost > 0 && remaining > PACE_CHUNK ? PACE_CHUNK : remaining)) > 0) {
+				paceClient(m);
+				pos += m;
+				remaining -= m;
+				bufSize += m;
 			}
-			printf("File %s was output from cache\n", fileLocationAsChar);
-			dup2(cachedfd, serverfd);  //write cached file to client
 		}
+		else {
+			bufSize = sendFromDisk(connfd, page);
+		}
+		unpinPage(page);
 	}
 	else //if not cached
 	{
-		char serverRequestLine1[MAXLINE];
-		char serverRequestLine2[MAXLINE];
-		char serverRequestLine3[MAXLINE];
-		char serverRequestLine4[MAXLINE];
-
-		//create host request
-		sprintf(serverRequestLine1, "%s /%s HTTP/1.1\n", method, pathname);
-		sprintf(serverRequestLine2, "Host:%s\n", hostname);
-		sprintf(serverRequestLine3, "Connection: close\n");
-		sprintf(serverRequestLine4, "User-Agent: Mozilla / 5.0 (Windows NT 6.1; WOW64; rv:25.0) Gecko / 20100101 Firefox / 25.0\n");
-
-		//send request by line
-		Write(serverfd, serverRequestLine1, strlen(serverRequestLine1));
-		Write(serverfd, serverRequestLine2, strlen(serverRequestLine2));
-		Write(serverfd, serverRequestLine3, strlen(serverRequestLine3));
-		Write(serverfd, serverRequestLine4, strlen(serverRequestLine4));
-		Write(serverfd, "\n", 1);
-
-		Rio_readinitb(&rio, serverfd);  
+		http_head_t request;
+
+		buildRequest(&request, rangeSpec[0] != '\0');
+
+		//send the whole request at once, so it leaves in one packet instead of one per line
+		if (http_head_send(serverfd, &request, 0) < 0) {
+			fprintf(stderr, "Request to %s failed: %s\n", hostname, strerror(errno));
+			originNote(0, 0);
+			Close(serverfd);
+			Close(connfd);
+			return -1;
+		}
+
+		requestSent = ioloop_time();
 		printf("Data received from server\n");  //print to console
 
-		//create file for caching
-		char fileCountAsChar[4];
-		sprintf(fileCountAsChar, "%d", fileCount);
-		cachedfp = fopen(fileCountAsChar, "w");
+		//stage the page for the store on its own thread, unless the index had no room for it
+		if (fileSlot > -1 && !fillBehind)
+			writing = writer_start(&writer, config.storeMaxObject, config.fillQueueChunks, finishFill, NULL) == 0;
 
 		//add status message for log
 		if (strlen(status) == 0) {
-			strcpy(status, NOTCACHED);
+			strcpy(status, !keepCopy ? FROMPEER : streaming ? STREAMED : NOTCACHED);
 		}
 		else {
-			strcat(status, NOTCACHED);
-		}
-
-	}
-		
-	m = 1; //start m at 1 for first read
-	while (m > 0) {										//while data still coming in
-		m = Read(serverfd, msg, MAXLINE);				//read from server			
-
-		//check if page was not cached, if so write out received data to file
-		if (isPageCached < 0) {                         
-			fprintf(cachedfp, "%s", msg);
+			strcat(status, !keepCopy ? FROMPEER : streaming ? STREAMED : NOTCACHED);
 		}
 
-		//write out received data to client
-		Write(connfd, msg, m); 
+		//an HTML page's subresources are fetched next, unless this is itself a prefetch or a peer's fetch
+		if ((scanning = config.prefetchConcurrency > 0 && !prefetched && fromPeer == 0))
+			prefetch_init(&prefetcher, hostname, routePool != NULL ? 80 : port, pathname);
 
-		/*sum the total number of bytes written */
-		bufSize += m;
-	}
+		bufSize = relayPage(connfd, writing ? &writer : NULL, writing);
+		if (bufSize == 0)  //the origin never answered, counts against its circuit
+			originNote(0, 0);
 
-	if (isPageCached < 0) { //if page was not cached, close fp that was written to
-		fclose(cachedfp);
-	}
-	else //if file was cached
-	{
-		Close(cachedfd);    //otherwise just close fd
+		if (writing)
+			writer_close(&writer);  //committed while the connections are closed and the log is written
+		Close(serverfd);  //close server fd
 	}
 	Close(connfd); //close connection fd
 
@@ -277,24 +1071,1362 @@ int handle_request(int connfd, struct sockaddr_in *sockaddr)
 		fprintf(fp, "%s\n", logstring);   //otherwise write to log
 		fclose(fp);
 	}
+	if (writing) {
+		writer_wait(&writer);
+		if (writer.fill.failed)  //outgrew store_max_object with no length to tell beforehand
+			sendNote(NOTE_BYPASS, fileSlot, 0, cachedPages[fileSlot].fillId, 0, 0, 0);
+	}
+	if (scanning && bufSize > 0 && prefetcher.npaths > 0)
+		prefetchPages();
+	if (fillBehind)
+		fetchWhole();
 
-	Close(serverfd);  //close server fd
-	
 	return 0;
 }
 
-//checkIfPageCached   traverses all cached files and checks pathname and hostname for a match
-int checkIfPageCached() { 
-	int fileLocation = -1;
-	int index;
-	for (index = 0; index < fileCount; index++) {
-		if (!strcmp(cachedPages[index].cachedHostName, hostname)) {
-			if (!strcmp(cachedPages[index].cachedPathName, pathname)) {
-				fileLocation = index;
+//buildRequest   builds the request sent to the origin, or peer, for the current request; with
+//the client's Range and If-Range if ranged
+void buildRequest(http_head_t *request, int ranged) {
+	http_head_init(request);
+	if (peer != NULL)  //peers are proxies, asked for the whole URL and told why they are asked
+		http_head_add(request, "%s http://%s:%d/%s HTTP/1.1\n" PEER_HEADER ": %s\n", method, hostname, port,
+			      pathname, keepCopy ? "digest" : "owner");
+	else
+		http_head_add(request, "%s /%s HTTP/1.1\n", method, pathname);
+	http_head_add(request, "Host:%s\n", hostname);
+	if (peer != NULL && acceptGzip)  //the peer compresses, or has the variant cached
+		http_head_add(request, "Accept-Encoding: gzip\n");
+	if (varyHeaders[0] != '\0')  //the page is cached for their values, the origin has to see them
+		http_head_add(request, "%s", varyHeaders);
+	if (ranged)
+		http_head_add(request, "Range: %s\n", rangeSpec);
+	if (ranged && ifRange[0] != '\0')
+		http_head_add(request, "If-Range: %s\n", ifRange);
+	http_head_add(request, "Connection: close\n");
+	http_head_add(request, "User-Agent: Mozilla / 5.0 (Windows NT 6.1; WOW64; rv:25.0) Gecko / 20100101 Firefox / 25.0\n");
+	http_head_add(request, "\n");
+}
+
+//fetchWhole   fetches the whole of the page a range was relayed from and caches it in fileSlot,
+//so later ranges of it hit (range_requests fill).  The client has had its range by now.
+void fetchWhole() {
+	http_head_t request;
+	store_fill_t fill;
+	char data[MAXLINE];
+	ssize_t m;
+
+	serverfd = backend != NULL ? Openclientfd(backend->host, backend->port) : Openclientfd(hostname, port);
+	if (serverfd < 0)
+		return;  //the page stays unfilled, the next request for it fills it
+	setTimeout(serverfd, SO_RCVTIMEO, config.idleTimeout);
+	buildRequest(&request, 0);
+	store_fill_begin(&fill, config.storeMaxObject);
+	if (http_head_send(serverfd, &request, 0) < 0)
+		fill.failed = 1;
+	while (!fill.failed && (m = read(serverfd, data, sizeof(data))) != 0) {
+		if (m < 0 && errno != EINTR)
+			fill.failed = 1;
+		else if (m > 0)
+			store_fill_append(&fill, data, m);
+	}
+	Close(serverfd);
+	printf("Fetched the whole of %s/%s for its ranges%s\n", hostname, pathname, fill.failed ? ", failed" : "");
+	if (fill.failed)
+		store_fill_abort(&fill);
+	else
+		finishFill(&fill, NULL);
+}
+
+//checkIfPageCached   looks up hostname and pathname in the page index and returns the slot
+//of a page that is ready in the store, pinned for the child that will send it, with pageStale
+//set if it has outlived config.cacheTtl.  A page whose fill failed, is still running or was
+//overwritten is handed back for refilling through fileSlot.
+int checkIfPageCached() {
+	char key[2 * MAXLINE];
+	struct cachePage *page;
+	cache_entry_t *e;
+	int keylen;
+
+	fileSlot = -1;
+	pageStale = 0;
+	pageFilling = 0;
+	if ((keylen = pageKey(key, sizeof(key))) < 0)
+		return -1;
+	if ((e = cache_lookup(&pageCache, key, keylen, cache_hash(key, keylen))) == NULL)
+		return -1;
+
+	page = &cachedPages[e->slot];
+	if (page->state == PAGE_FILLING && rangeSpec[0] != '\0') {  //a range is fetched on its own, the fill goes on
+		pageFilling = 1;
+		return -1;
+	}
+	if (page->state != PAGE_READY || pinPage(page) < 0) {
+		if (page->state == PAGE_READY && page->blob >= 0)
+			releasePage(page);  //the page's head or the body it shares may still be there
+		else if (page->state == PAGE_READY)
+			dropFromRam(page);
+		page->state = PAGE_EMPTY;
+		fileSlot = e->slot;
+		return -1;
+	}
+	if (!page->verified) {  //first hit since a restart, make sure the bytes survived
+		if (store_verify(pageTier(page), page->offset) < 0) {
+			printf("Slot %d failed its checksum\n", e->slot);
+			unpinPage(page);
+			cache_remove(&pageCache, e);
+			return -1;
+		}
+		page->verified = 1;
+	}
+	if (page->tier == TIER_RAM)
+		cache_touch(&ramCache, &ramCache.entries[page->ramSlot]);
+	else if (config.ramBytes > 0 && page->length <= config.ramMaxObject && page->blob < 0 && ++page->hits >= config.promoteHits)
+		promotePage(e);
+	pageStale = config.cacheTtl > 0 && time(NULL) - page->filled >= config.cacheTtl;
+	return e->slot;
+}
+
+//pageKey   builds the index key of the current request's page: that of the variant its headers
+//pick if the page is known to vary by them, and of its gzip variant for a client that accepts
+//gzip.  Sets varyNames and varyHeaders.  Returns the key length, or -1 if it does not fit in
+//size bytes or the headers are too long to key a variant by.
+int pageKey(char *key, size_t size) {
+	int len = cache_makekey(key, size, hostname, pathname), n;
+	const char *names;
+
+	varyNames[0] = varyHeaders[0] = '\0';
+	if (len < 0)
+		return -1;
+	if ((names = vary_lookup(&varyIndex, cache_hash(key, len))) != NULL) {
+		strcpy(varyNames, names);
+		if ((n = vary_headers(varyHeaders, sizeof(varyHeaders), buf, names)) < 0 ||
+		    (len = vary_key(key, size, len, names, varyHeaders, n)) < 0) {
+			varyHeaders[0] = '\0';
+			return -1;
+		}
+	}
+	return gzipKey(key, size, len);
+}
+
+//variantKey   builds the index key of the page at host and path in the variant the current
+//request's client is sent, not counting headers it may vary by
+int variantKey(char *key, size_t size, const char *host, const char *path) {
+	int len = cache_makekey(key, size, host, path);
+
+	return len < 0 ? len : gzipKey(key, size, len);
+}
+
+//gzipKey   turns the len byte key of a page into that of its gzip variant if the current
+//request's client is sent that
+int gzipKey(char *key, size_t size, int len) {
+	if (!acceptGzip)
+		return len;
+	if ((size_t)len + 5 >= size)
+		return -1;
+	strcpy(key + len, " gzip");  //URLs hold no blanks, so this is never another page's key
+	return len + 5;
+}
+
+//evictPage   releases the store space behind a page the index is dropping
+void evictPage(cache_entry_t *e, void *arg) {
+	struct cachePage *page = &cachedPages[e->slot];
+
+	if (page->state == PAGE_READY) {
+		releasePage(page);
+		dropFromRam(page);
+		indexChanges++;
+	}
+	page->state = PAGE_EMPTY;
+	purge_remove(&purgeIndex, e->slot);
+}
+
+//releasePage   gives a page's objects back to the store: its own, unless that holds a body
+//other pages share, and its share of the body in the dedup table
+void releasePage(struct cachePage *page) {
+	if (page->blob < 0 || page->shared)
+		store_release(pageTier(page), page->offset, page->seq);
+	dropBody(page);
+}
+
+//dropBody   lets go of a page's share of its body in the dedup table, releasing the object
+//the body is in along with the last share
+void dropBody(struct cachePage *page) {
+	dedup_blob_t *b;
+
+	if (page->blob < 0)
+		return;
+	b = &dedup.blobs[page->blob];
+	if (dedup_put(&dedup, page->blob) == 0)
+		store_release(&pageStore, b->offset, b->seq);
+	page->blob = -1;
+	page->shared = 0;
+}
+
+//pinPage   pins a page's object, and the one holding its body if it shares another's, for
+//serving.  Returns -1 if either is gone.
+int pinPage(struct cachePage *page) {
+	if (store_ref(pageTier(page), page->offset, page->seq) < 0)
+		return -1;
+	if (page->shared && store_ref(&pageStore, dedup.blobs[page->blob].offset, dedup.blobs[page->blob].seq) < 0) {
+		store_unref(pageTier(page), page->offset);
+		return -1;
+	}
+	return 0;
+}
+
+//unpinPage   drops the pins pinPage took
+void unpinPage(struct cachePage *page) {
+	store_unref(pageTier(page), page->offset);
+	if (page->shared)
+		store_unref(&pageStore, dedup.blobs[page->blob].offset);
+}
+
+//sharedLength   bytes of a page's body that are in another page's object, after its own
+size_t sharedLength(struct cachePage *page) {
+	return page->shared ? dedup.blobs[page->blob].length : 0;
+}
+
+//pageTier   store holding a page
+store_t *pageTier(struct cachePage *page) {
+	return page->tier == TIER_RAM ? &ramStore : &pageStore;
+}
+
+//dropFromRam   forgets a page's memory tier slot without demoting it, its object is released by the caller
+void dropFromRam(struct cachePage *page) {
+	if (page->tier != TIER_RAM)
+		return;
+	ramOwner[page->ramSlot] = -1;
+	cache_remove(&ramCache, &ramCache.entries[page->ramSlot]);
+	page->tier = TIER_DISK;
+}
+
+//demotePage   ramCache callback, moves the page it is evicting from memory to disk
+void demotePage(cache_entry_t *re, void *arg) {
+	int slot = ramOwner[re->slot];
+	struct cachePage *page;
+	uint64_t offset, seq;
+
+	if (slot < 0)  //dropped outright, see dropFromRam
+		return;
+	ramOwner[re->slot] = -1;
+	page = &cachedPages[slot];
+	if (store_copy(&ramStore, page->offset, page->seq, &pageStore, slot, droppedHere, NULL, &offset, &seq) < 0) {
+		store_release(&ramStore, page->offset, page->seq);  //no room on disk either, the page leaves the cache
+		page->tier = TIER_DISK;
+		page->state = PAGE_EMPTY;
+		cache_remove(&pageCache, &pageCache.entries[slot]);
+		return;
+	}
+	store_release(&ramStore, page->offset, page->seq);
+	page->tier = TIER_DISK;
+	page->offset = offset;
+	page->seq = seq;
+	page->hits = 0;
+	indexChanges++;
+	cache_resize(&pageCache, &pageCache.entries[slot], page->length);  //now counts against the disk budget
+}
+
+//promotePage   copies a page that keeps getting hits into memory; the hit is then served from the copy
+void promotePage(cache_entry_t *e) {
+	struct cachePage *page = &cachedPages[e->slot];
+	uint64_t diskOffset = page->offset, diskSeq = page->seq;
+
+	if (admitToRam(e->slot) < 0)
+		return;
+	store_ref(&ramStore, page->offset, page->seq);  //the child serves the new copy
+	store_unref(&pageStore, diskOffset);
+	store_release(&pageStore, diskOffset, diskSeq);
+	indexChanges++;
+	cache_resize(&pageCache, e, 0);  //memory has its own budget
+}
+
+//admitToRam   gives a page on disk a ramCache slot and copies it into ramStore, demoting
+//others while the slabs are too fragmented to take it.  The disk copy is left to the caller.
+int admitToRam(int slot) {
+	struct cachePage *page = &cachedPages[slot];
+	cache_entry_t *e = &pageCache.entries[slot], *re;
+	uint64_t offset, seq;
+
+	if ((re = cache_insert(&ramCache, e->key, e->keylen, e->hash, page->length)) == NULL)
+		return -1;
+	ramOwner[re->slot] = slot;
+	while (store_copy(&pageStore, page->offset, page->seq, &ramStore, slot, NULL, NULL, &offset, &seq) < 0) {
+		if (ramCache.head == re) {
+			ramOwner[re->slot] = -1;
+			cache_remove(&ramCache, re);
+			return -1;
+		}
+		cache_remove(&ramCache, ramCache.head);
+	}
+	page->tier = TIER_RAM;
+	page->ramSlot = re->slot;
+	page->offset = offset;
+	page->seq = seq;
+	return 0;
+}
+
+//droppedHere   store callback for pages the parent overwrites in the log while demoting,
+//the entry stays in the index and is refetched on its next lookup
+void droppedHere(struct storeObject *o, void *arg) {
+	struct cachePage *page;
+
+	if (o->slot < 0 || o->slot >= (int)config.cacheEntries)
+		return;
+	page = &cachedPages[o->slot];
+	if (page->state == PAGE_READY && page->tier == TIER_DISK && page->seq == o->seq) {
+		dropBody(page);
+		page->state = PAGE_EMPTY;
+	}
+}
+
+//relayPage   copies the origin's response to the client, keeping a copy for the cache.  Short
+//responses are relayed through the client's output queue; once a response has gone on for
+//RELAY_RING_AFTER blocks and the queue has drained, the rest is relayed through an io_uring
+//ring, which submits each write to the client together with the next read from the origin.
+//A response compressed for the client goes through the queue all the way.
+//The origin gets config.firstByteTimeout to start, then either side config.idleTimeout per
+//block, and the whole relay has to finish by requestDeadline; a copy cut short by any of them
+//is dropped.
+long relayPage(int connfd, writer_t *writer, int writing) {
+	outq_t out;
+	long bytes = 0, rest;
+	int left = 0, rc;
+
+	outq_init(&out, config.outputLowWater, config.outputHighWater);
+	if ((compressing = acceptGzip && peer == NULL))
+		gzip_init(&gzipper, &bufPool, config.compressLevel, config.compressTypes, config.compressMinLength,
+			  queueChunk, NULL);
+	rc = relayQueued(connfd, &out, writer, writing, RELAY_RING_AFTER, &bytes);
+	if (rc > 0 && !compressing && config.ioBackend != IOLOOP_EPOLL && relayRingReady() == 0) {
+		if (requestDeadline > 0 && (left = (int)(long long)(requestDeadline - ioloop_time())) < 1)
+			left = 1;  //overdue, fail the relay at once
+		rest = ioloop_relay(&relayLoop, serverfd, connfd, relayBufs, RELAY_RING_BUFFER, config.idleTimeout, left,
+				    relaySeen, writer);
+		if (rest < 0) {  //either side failed or ran out of time, the copy is incomplete
+			ioloop_close(&relayLoop);  //operations of the relay may still be queued on it
+			relayRing = 0;
+			rc = -1;
+		}
+		else {
+			bytes += rest;
+		}
+	}
+	else if (rc > 0) {
+		rc = relayQueued(connfd, &out, writer, writing, 0, &bytes);
+	}
+	if (compressing)
+		gzip_free(&gzipper);
+	outq_free(&out);
+	if (rc < 0 && writing)
+		writer_abandon(writer);
+	return bytes;
+}
+
+//relayQueued   relays the origin's response through the output queue out without blocking on
+//either side.  Reads from the origin pause while the client is config.outputHighWater bytes
+//behind and resume once it has drained to config.outputLowWater, so a slow client costs at most
+//that much memory.  Stops reading after maxBlocks blocks (0 for no limit) and returns once the
+//queue is empty: 1 if the response goes on, 0 at its end, or -1 if either side failed or
+//timed out or the request is past its deadline.
+int relayQueued(int connfd, outq_t *out, writer_t *writer, int writing, int maxBlocks, long *bytes) {
+	struct relayTarget target = { connfd, out, writer, writing };
+	struct bufChunk *c;
+	struct pollfd fds[2];
+	int blocks = 0, eof = 0, timeout, rc;
+	ssize_t m;
+
+	gzipper.arg = &target;
+
+	while (!eof && (maxBlocks == 0 || blocks < maxBlocks)) {
+		fds[0].fd = serverfd;
+		fds[0].events = out->paused ? 0 : POLLIN;
+		fds[1].fd = connfd;
+		fds[1].events = out->bytes > 0 ? POLLOUT : 0;
+		if ((timeout = relayTimeout(*bytes == 0 ? config.firstByteTimeout : config.idleTimeout)) == 0)
+			return -1;
+		if ((m = poll(fds, 2, timeout)) == 0)
+			return -1;  //nothing moved in time
+		if (m < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (fds[1].revents && outq_flush(out, connfd) < 0)
+			return -1;
+		if (!fds[0].revents)
+			continue;
+		if ((c = bufpool_get(&bufPool)) == NULL)
+			return -1;
+		if ((m = read(serverfd, c->data, bufPool.chunkSize)) <= 0) {
+			bufchunk_put(c);
+			if (m < 0 && errno == EINTR)
+				continue;
+			if (m < 0)
+				return -1;
+			if (compressing && gzip_finish(&gzipper) < 0)
+				return -1;
+			eof = 1;
+			break;
+		}
+		c->len = m;
+		paceClient(m);
+		if (scanning)
+			prefetch_scan(&prefetcher, c->data, m);
+		if (*bytes == 0)  //feeds the parent's adaptive limit and the origin's circuit
+			originNote(1, ioloop_time() - requestSent);
+		if (*bytes == 0 && target.writing && !compressing)
+			target.writing = sizeFill(c->data, m, writer);
+		rc = compressing ? gzip_feed(&gzipper, c) : queueChunk(c, &target);
+		bufchunk_put(c);
+		if (rc < 0)
+			return -1;
+		*bytes += m;
+		blocks++;
+	}
+
+	//the ring writes from its own buffers, so hand over with nothing left queued
+	while (out->bytes > 0) {
+		fds[1].fd = connfd;
+		fds[1].events = POLLOUT;
+		if ((timeout = relayTimeout(config.idleTimeout)) == 0)
+			return -1;
+		if ((m = poll(&fds[1], 1, timeout)) == 0 || (m < 0 && errno != EINTR))
+			return -1;
+		if (outq_flush(out, connfd) < 0)
+			return -1;
+	}
+	return eof ? 0 : 1;
+}
+
+//queueChunk   queues a chunk of the response for the client and keeps a copy for the cache;
+//gzipper's output while compressing.  Returns -1 once the client's socket has failed.
+int queueChunk(struct bufChunk *c, void *arg) {
+	struct relayTarget *t = arg;
+
+	if (t->writing)
+		writer_push(t->writer, c->data, c->len);  //keep a copy for the cache, dropped if the writer falls behind
+	if (outq_push(t->out, c) < 0)  //the queue holds its own reference until the client has it
+		return -1;
+	return outq_flush(t->out, t->connfd);
+}
+
+//relayRingReady   sets up relayLoop the first time a relay of the child runs long, with its two
+//buffers registered; later relays reuse it.  Sockets are not registered, as they differ between
+//relays.  Returns -1 if the kernel gives no ring.
+int relayRingReady() {
+	struct iovec iov[2];
+	int i;
+
+	if (relayRing)
+		return 0;
+	if (ioloop_init(&relayLoop, IOLOOP_URING, 4) < 0)
+		return -1;
+	for (i = 0; i < 2; i++) {
+		if (relayBufs[i] == NULL)
+			relayBufs[i] = Malloc(RELAY_RING_BUFFER);
+		iov[i].iov_base = relayBufs[i];
+		iov[i].iov_len = RELAY_RING_BUFFER;
+	}
+	ioloop_register_buffers(&relayLoop, iov, 2);
+	relayRing = 1;
+	return 0;
+}
+
+//relayTimeout   poll timeout for waiting ms (0 for no limit) on a relay, cut short by
+//requestDeadline.  Returns 0 once the deadline has passed.
+int relayTimeout(int ms) {
+	long long left;
+
+	if (requestDeadline == 0)
+		return ms > 0 ? ms : -1;
+	if ((left = (long long)(requestDeadline - ioloop_time())) <= 0)
+		return 0;
+	return (ms > 0 && ms < left) ? ms : (int)left;
+}
+
+//setTimeout   sets a socket send or receive timeout in milliseconds, 0 for none
+void setTimeout(int fd, int option, int ms) {
+	struct timeval timeout; //struct used in setsockopt to define a timeout
+
+	timeout.tv_sec = ms / 1000;
+	timeout.tv_usec = (ms % 1000) * 1000;
+	if (setsockopt(fd, SOL_SOCKET, option, (char *)&timeout, sizeof(timeout)) < 0)
+		printf("setsockopt failed\n");
+}
+
+//relaySeen   ioloop_relay callback, queues each relayed block for the cache writer
+void relaySeen(const char *data, size_t n, void *arg) {
+	paceClient(n);
+	if (scanning)
+		prefetch_scan(&prefetcher, data, n);
+	if (arg != NULL)
+		writer_push(arg, data, n);
+}
+
+//prefetchPages   requests the subresources the relayed page refers to from this proxy, so they are
+//cached by the time the client asks for them.  The client has the whole page by now.  The child
+//keeps its admission slot meanwhile, so prefetching counts against the same limits as clients.
+void prefetchPages() {
+	char prefix[MAXLINE], headers[MAXLINE];
+	const char *gzip = acceptGzip ? "Accept-Encoding: gzip\r\n" : "";  //warm the variant the client is sent
+	long bytes;
+
+	if (routePool != NULL) {  //reverse proxied, asked for by path like the page was
+		strcpy(prefix, "/");
+		snprintf(headers, sizeof(headers), "Host: %s\r\n%s", hostname, gzip);
+	}
+	else {
+		snprintf(prefix, sizeof(prefix), "http://%s:%d/", hostname, port);
+		snprintf(headers, sizeof(headers), "%s", gzip);
+	}
+	bytes = prefetch_run(&prefetcher, listenPort, prefix, headers, config.prefetchConcurrency, config.prefetchBytes,
+			     config.idleTimeout, notCached, NULL);
+	printf("Prefetched %ld bytes of %d subresources of %s/%s\n", bytes, prefetcher.npaths, hostname, pathname);
+}
+
+//notCached   prefetch_run filter, whether the page at path on the current host was missing from
+//the index when this child was forked
+int notCached(const char *path, void *arg) {
+	char key[2 * MAXLINE];
+	int keylen = variantKey(key, sizeof(key), hostname, path);
+	cache_entry_t *e;
+
+	if (keylen < 0)
+		return 0;
+	e = cache_lookup(&pageCache, key, keylen, cache_hash(key, keylen));
+	return e == NULL || cachedPages[e->slot].state == PAGE_EMPTY;
+}
+
+//sendFromDisk   sends a page on disk with sendfile.  The socket keeps referring to the store's
+//page cache pages until the client acknowledges them, so the page's space is held from reuse
+//for a while after it is unpinned.
+int sendFromDisk(int connfd, struct cachePage *page) {
+	size_t sent = sendPageBytes(connfd, page, 0, page->length + sharedLength(page));
+
+	holdPage(page);
+	return sent;
+}
+
+//sendfileRange   sends n bytes of the disk store from pos with sendfile, returns the bytes sent
+size_t sendfileRange(int connfd, off_t pos, size_t n) {
+	size_t remaining = n;
+	ssize_t m;
+
+	while (remaining > 0 && (m = sendfile(connfd, pageStore.fd, &pos,
+				rateLimit.byteCost > 0 && remaining > PACE_CHUNK ? PACE_CHUNK : remaining)) > 0) {
+		remaining -= m;
+		paceClient(m);
+	}
+	return n - remaining;
+}
+
+//holdPage   keeps the store from reusing the space of a pinned page on disk, and of the body it
+//shares, for SENDFILE_HOLD seconds, so what sendfile queued is not overwritten before it is sent
+void holdPage(struct cachePage *page) {
+	store_hold(&pageStore, page->offset, SENDFILE_HOLD);
+	if (page->shared)
+		store_hold(&pageStore, dedup.blobs[page->blob].offset, SENDFILE_HOLD);
+}
+
+//sendRanges   answers a Range request from a cached page with a 206 of the ranges asked for,
+//each sent straight from the store, with sendfile from its offset for a page on disk, or with a
+//416 if none of them is in the page.  Returns the bytes sent, or -1 if the Range does not apply
+//and the whole page is to be sent: the page is not a 200 of known length, or If-Range names
+//another version of it, or the Range is not one this proxy serves.
+int sendRanges(int connfd, struct cachePage *page) {
+	char head[MAXLINE], value[256], type[256], part[512], *end, *line, *eol;
+	char *payload = pageTier(page)->base + page->offset + sizeof(struct storeObject);
+	struct httpRange ranges[HTTP_RANGES_MAX];
+	unsigned long long length, raw = page->packed ? pack_length(payload, page->length) : page->length + sharedLength(page), total;
+	size_t headLen, n, m;
+	http_head_t out;
+	int nranges, status, i;
+	long sent;
+
+	//the stored response's head, to check it and build the 206 from
+	n = raw < sizeof(head) - 1 ? raw : sizeof(head) - 1;
+	if (page->packed) {
+		char *block = Malloc(PACK_BLOCK), *at = head;
+		long got = pack_read(payload, page->length, block, 0, n, copyBlock, &at);
+
+		free(block);
+		if (got != (long)n)
+			return -1;
+	}
+	else {
+		if (n > page->length)  //the head is all a page sharing its body has in its own object
+			n = page->length;
+		memcpy(head, payload, n);
+	}
+	head[n] = '\0';
+	if ((end = strstr(head, "\r\n\r\n")) != NULL)
+		end += 4;
+	else if ((end = strstr(head, "\n\n")) != NULL)
+		end += 2;
+	else
+		return -1;
+	headLen = end - head;
+	length = raw - headLen;
+	if (sscanf(head, "HTTP/%*d.%*d %d", &status) != 1 || status != 200 ||
+	    http_header(head, "Transfer-Encoding", value, sizeof(value)) == 0)
+		return -1;
+	if (http_header(head, "Content-Length", value, sizeof(value)) == 0 && strtoull(value, NULL, 10) != length)
+		return -1;
+	if (ifRange[0] != '\0' &&  //an entity tag must match strongly, a date exactly
+	    (strncmp(ifRange, "W/", 2) == 0 ||
+	     http_header(head, ifRange[0] == '"' ? "ETag" : "Last-Modified", value, sizeof(value)) < 0 ||
+	     strcmp(value, ifRange) != 0))
+		return -1;
+	if ((nranges = http_ranges(rangeSpec, length, ranges, HTTP_RANGES_MAX)) < 0)
+		return -1;
+
+	http_head_init(&out);
+	if (nranges == 0) {
+		http_head_add(&out, "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%llu\r\n"
+			      "Content-Length: 0\r\nConnection: close\r\n\r\n", length);
+		return http_head_send(connfd, &out, 0) < 0 ? 0 : (int)out.len;
+	}
+	http_head_add(&out, "HTTP/1.1 206 Partial Content\r\n");
+	for (line = strchr(head, '\n') + 1; line < head + headLen; line = eol + 1) {
+		eol = strchr(line, '\n');
+		for (m = eol - line; m > 0 && (line[m - 1] == '\r' || line[m - 1] == '\n'); m--)
+			;
+		if (m == 0 || strncasecmp(line, "Content-Length:", 15) == 0 || strncasecmp(line, "Content-Range:", 14) == 0 ||
+		    strncasecmp(line, "Accept-Ranges:", 14) == 0 || (nranges > 1 && strncasecmp(line, "Content-Type:", 13) == 0))
+			continue;
+		http_head_add(&out, "%.*s\r\n", (int)m, line);
+	}
+	http_head_add(&out, "Accept-Ranges: bytes\r\n");
+	if (nranges == 1) {
+		http_head_add(&out, "Content-Range: bytes %llu-%llu/%llu\r\nContent-Length: %llu\r\n\r\n",
+			      ranges[0].first, ranges[0].last, length, ranges[0].last - ranges[0].first + 1);
+	}
+	else {
+		if (http_header(head, "Content-Type", type, sizeof(type)) < 0)
+			type[0] = '\0';
+		for (total = 0, i = 0; i < nranges; i++)
+			total += rangePart(part, sizeof(part), type, &ranges[i], length) + ranges[i].last - ranges[i].first + 1 + 2;
+		total += strlen("--" RANGE_BOUNDARY "--\r\n");
+		http_head_add(&out, "Content-Type: multipart/byteranges; boundary=" RANGE_BOUNDARY "\r\n"
+			      "Content-Length: %llu\r\n\r\n", total);
+	}
+	if (http_head_send(connfd, &out, MSG_MORE) < 0)
+		return 0;
+	sent = out.len;
+	for (i = 0; i < nranges; i++) {
+		n = ranges[i].last - ranges[i].first + 1;
+		if (nranges > 1) {
+			m = rangePart(part, sizeof(part), type, &ranges[i], length);
+			if (send(connfd, part, m, MSG_MORE | MSG_NOSIGNAL) != (ssize_t)m)
+				break;
+			sent += m;
+		}
+		m = sendPageBytes(connfd, page, headLen + ranges[i].first, n);
+		sent += m;
+		if (m < n || (nranges > 1 && send(connfd, "\r\n", 2, MSG_MORE | MSG_NOSIGNAL) != 2))
+			break;
+		sent += nranges > 1 ? 2 : 0;
+	}
+	if (i == nranges && nranges > 1 && send(connfd, "--" RANGE_BOUNDARY "--\r\n", strlen("--" RANGE_BOUNDARY "--\r\n"),
+						MSG_NOSIGNAL) > 0)
+		sent += strlen("--" RANGE_BOUNDARY "--\r\n");
+	if (page->tier == TIER_DISK && !page->packed)
+		holdPage(page);
+	return sent;
+}
+
+//rangePart   the head of a multiple range response's part for range r, in part; returns its length
+int rangePart(char *part, size_t size, const char *type, struct httpRange *r, unsigned long long length) {
+	return snprintf(part, size, "--" RANGE_BOUNDARY "\r\n%s%s%sContent-Range: bytes %llu-%llu/%llu\r\n\r\n",
+			type[0] ? "Content-Type: " : "", type, type[0] ? "\r\n" : "", r->first, r->last, length);
+}
+
+//sendPageBytes   sends n bytes of a cached page's stored response from byte from, inflating them
+//if the page is packed, and taking those past its head from the object holding its body if it
+//shares another's; returns the bytes sent
+size_t sendPageBytes(int connfd, struct cachePage *page, size_t from, size_t n) {
+	char *payload = pageTier(page)->base + page->offset + sizeof(struct storeObject), *block;
+	dedup_blob_t *b;
+	size_t own;
+	long sent;
+
+	if (page->shared) {
+		b = &dedup.blobs[page->blob];
+		own = from < page->length ? (n < page->length - from ? n : page->length - from) : 0;
+		if (own > 0 && (sent = sendfileRange(connfd, page->offset + sizeof(struct storeObject) + from, own)) < (long)own)
+			return sent;
+		return own + sendfileRange(connfd, b->offset + sizeof(struct storeObject) + b->start + from + own - page->length, n - own);
+	}
+
+	if (page->packed) {
+		block = Malloc(PACK_BLOCK);
+		sent = pack_read(payload, page->length, block, from, from + n, sendBlock, &connfd);
+		free(block);
+		return sent < 0 ? 0 : sent;
+	}
+	if (page->tier == TIER_DISK)
+		return sendfileRange(connfd, page->offset + sizeof(struct storeObject) + from, n);
+	return sendBlock(payload + from, n, &connfd) < 0 ? 0 : n;
+}
+
+//copyBlock   pack_read callback, appends a block to the buffer whose end arg points to
+int copyBlock(const char *data, size_t n, void *arg) {
+	char **at = arg;
+
+	memcpy(*at, data, n);
+	*at += n;
+	return 0;
+}
+
+//sendPacked   sends a packed page, inflating it a block at a time from the mapped store into
+//the buffer that is written to the client
+int sendPacked(int connfd, struct cachePage *page) {
+	char *payload = pageTier(page)->base + page->offset + sizeof(struct storeObject);
+	char *block = Malloc(PACK_BLOCK);
+	long sent = pack_read(payload, page->length, block, 0, UINT64_MAX, sendBlock, &connfd);
+
+	free(block);
+	return sent < 0 ? 0 : sent;
+}
+
+//sendBlock   pack_read callback, writes an unpacked block to the client socket in arg
+int sendBlock(const char *data, size_t n, void *arg) {
+	int connfd = *(int *)arg;
+	ssize_t m;
+
+	while (n > 0) {
+		if ((m = write(connfd, data, rateLimit.byteCost > 0 && n > PACE_CHUNK ? PACE_CHUNK : n)) <= 0)
+			return -1;
+		paceClient(m);
+		data += m;
+		n -= m;
+	}
+	return 0;
+}
+
+//sendNote   tells the parent about a fill or a dropped page, small enough to be written atomically
+void sendNote(int type, int slot, int tier, uint64_t fillId, uint64_t offset, uint64_t seq, uint32_t length) {
+	struct fillNote note;
+
+	memset(&note, 0, sizeof(note));
+	note.type = type;
+	note.slot = slot;
+	note.tier = tier;
+	note.fillId = fillId;
+	note.offset = offset;
+	note.seq = seq;
+	note.length = length;
+	note.blob = -1;
+	writeNote(&note);
+}
+
+//originNote   reports how the current request's origin, peer or backend did, for its circuit:
+//tier 1 if it answered, ms after the request was sent, 0 if it did not, -1 if it could not be
+//connected to
+void originNote(int tier, uint32_t ms) {
+	struct fillNote note;
+
+	memset(&note, 0, sizeof(note));
+	note.type = NOTE_ORIGIN;
+	note.tier = tier;
+	note.length = ms;
+	note.blob = -1;
+	snprintf(note.host, sizeof(note.host), "%s", peer != NULL ? peer->host : backend != NULL ? backend->host : hostname);
+	note.port = peer != NULL ? peer->port : backend != NULL ? backend->port : port;
+	writeNote(&note);
+}
+
+//writeNote   writes a note to the parent in one piece
+void writeNote(struct fillNote *note) {
+	if (write(notePipe[1], note, sizeof(*note)) != sizeof(*note))
+		printf("Fill note lost\n");
+}
+
+//droppedPage   store callback for a live page overwritten by the append log
+void droppedPage(struct storeObject *o, void *arg) {
+	sendNote(NOTE_DROPPED, o->slot, TIER_DISK, 0, (char *)o - pageStore.base, o->seq, 0);
+}
+
+//finishFill   moves a fetched page into the store and reports it to the parent, runs on the writer thread
+void finishFill(store_fill_t *fill, void *arg) {
+	struct fillNote note;
+	uint64_t offset, seq, bodyHash = 0;
+	size_t length = fill->len, headLength = 0;
+	uint64_t keyhash = pageCache.entries[fileSlot].hash;
+
+	int tier = TIER_RAM, blob = -1;
+
+	if (varyChanged(fill)) {  //cached under the wrong key, the next request is keyed right
+		store_fill_abort(fill);
+		return;
+	}
+
+	//small pages start out in memory, the rest or whatever memory has no room for go to disk
+	if (length == 0 || config.ramBytes == 0 || length > config.ramAdmitBytes ||
+	    store_fill_commit(&ramStore, fill, fileSlot, keyhash, NULL, NULL, &offset, &seq) < 0) {
+		tier = TIER_DISK;
+		if (config.dedupMinBytes > 0 && length > config.dedupMinBytes)
+			blob = findBody(fill, &bodyHash, &headLength);
+		if (blob >= 0)  //the body is stored already, only the head is written
+			length = fill->len = headLength;
+		else if (length > 0 && config.storeCompressLevel > 0 && packable(fill) && pack_fill(fill, config.storeCompressLevel) == 0) {
+			length = fill->len;
+			headLength = 0;  //a packed body is not shared
+		}
+		if (length == 0 || store_fill_commit(&pageStore, fill, fileSlot, keyhash, droppedPage, NULL, &offset, &seq) < 0) {
+			store_fill_abort(fill);
+			return;
+		}
+	}
+	memset(&note, 0, sizeof(note));
+	note.type = NOTE_FILLED;
+	note.slot = fileSlot;
+	note.tier = tier;
+	note.fillId = cachedPages[fileSlot].fillId;
+	note.offset = offset;
+	note.seq = seq;
+	note.length = length;
+	note.headLength = tier == TIER_DISK ? headLength : 0;
+	note.bodyHash = bodyHash;
+	note.blob = blob;
+	note.blobSeq = blob >= 0 ? dedup.blobs[blob].seq : 0;
+	writeNote(&note);
+}
+
+//varyChanged   whether a fetched page's response varies by other headers than the request was
+//keyed by, varyNames, so it would be cached under the wrong key.  The parent is told the ones to
+//key the page's URL by from now on, or to stream it if it varies by "*" or too many.  Returns 1 if
+//so, and the fill is to be dropped.
+int varyChanged(store_fill_t *fill) {
+	char head[8192], value[8192], names[VARY_NAMES];
+	size_t n = fill->len < sizeof(head) - 1 ? fill->len : sizeof(head) - 1;
+	struct fillNote note;
+
+	memcpy(head, fill->buf, n);
+	head[n] = '\0';
+	names[0] = '\0';
+	if (http_header(head, "Vary", value, sizeof(value)) == 0 && vary_names(names, sizeof(names), value) < 0) {
+		printf("%s/%s varies by %s, streamed without caching\n", hostname, pathname, value);
+		sendNote(NOTE_BYPASS, fileSlot, 0, cachedPages[fileSlot].fillId, 0, 0, 0);
+		return 1;
+	}
+	if (strcmp(names, varyNames) == 0)
+		return 0;
+	printf("%s/%s varies by \"%s\", not \"%s\"\n", hostname, pathname, names, varyNames);
+	memset(&note, 0, sizeof(note));
+	note.type = NOTE_VARY;
+	note.slot = fileSlot;
+	note.fillId = cachedPages[fileSlot].fillId;
+	strcpy(note.vary, names);
+	writeNote(&note);
+	return 1;
+}
+
+//findBody   hashes the body of a page going to disk, what follows its head, if it is at least
+//config.dedupMinBytes, and looks it up in the dedup table as it was when this child was forked.
+//Returns the entry of a body stored already that is the same byte for byte, or -1; hash and
+//headLength are set for any body hashed, headLength is left 0 otherwise.
+int findBody(store_fill_t *fill, uint64_t *hash, size_t *headLength) {
+	char head[8192], *end;
+	size_t n = fill->len < sizeof(head) - 1 ? fill->len : sizeof(head) - 1, length;
+	dedup_blob_t *b;
+	int i, same;
+
+	memcpy(head, fill->buf, n);
+	head[n] = '\0';
+	if ((end = strstr(head, "\r\n\r\n")) == NULL)
+		return -1;
+	if ((length = fill->len - (end + 4 - head)) < config.dedupMinBytes)
+		return -1;
+	*headLength = end + 4 - head;
+	*hash = dedup_hash(fill->buf + *headLength, length);
+	if ((i = dedup_find(&dedup, *hash, length)) < 0)
+		return -1;
+	b = &dedup.blobs[i];
+	if (store_ref(&pageStore, b->offset, b->seq) < 0)
+		return -1;
+	same = memcmp(pageStore.base + b->offset + sizeof(struct storeObject) + b->start, fill->buf + *headLength, length) == 0;
+	store_unref(&pageStore, b->offset);
+	return same ? i : -1;
+}
+
+//shareBody   enters a page just filled on disk in the dedup table: as sharing the body its
+//child found stored, or as the holder of a body later pages can share.  Returns -1 if the body
+//it was to share is gone, the caller drops the page.
+int shareBody(cache_entry_t *e, struct fillNote *note) {
+	struct cachePage *page = &cachedPages[e->slot];
+
+	if (note->blob < 0) {
+		if (dedup_find(&dedup, note->bodyHash, note->length - note->headLength) < 0)
+			page->blob = dedup_add(&dedup, note->bodyHash, note->offset, note->seq, note->headLength,
+					       note->length - note->headLength);
+		return 0;
+	}
+	if (!dedup_live(&dedup, note->blob, note->bodyHash, note->blobSeq))
+		return -1;
+	dedup_get(&dedup, note->blob);
+	page->blob = note->blob;
+	page->shared = 1;
+	printf("Slot %d shares a stored body of %u bytes, dedup ratio now %.2f\n", e->slot,
+	       dedup.blobs[note->blob].length, dedup_ratio(&dedup));
+	fflush(stdout);  //or every child forked later prints it again
+	return 0;
+}
+
+//sizeFill   checks the Content-Length in the first block of the origin's response: a page
+//over bypass_bytes or store_max_object is relayed without a copy and the parent told to stream
+//it from now on, one that fits has the writer stage it in one allocation.  Returns 0 if the
+//copy was dropped.  A compressed relay stores less than it declares, so it is not checked.
+int sizeFill(const char *data, size_t n, writer_t *writer) {
+	char head[4096], value[32], *end;
+	size_t limit = config.storeMaxObject;
+	unsigned long long length;
+
+	if (n > sizeof(head) - 1)
+		n = sizeof(head) - 1;
+	memcpy(head, data, n);
+	head[n] = '\0';
+	if (strcasecmp(method, "GET") != 0 || (end = strstr(head, "\r\n\r\n")) == NULL ||
+	    http_header(head, "Content-Length", value, sizeof(value)) < 0)
+		return 1;  //a HEAD has no body, and a page of unknown length is checked as it is staged
+	length = strtoull(value, NULL, 10) + (end + 4 - head);
+	if (config.bypassBytes > 0 && config.bypassBytes < limit)
+		limit = config.bypassBytes;
+	if (length <= limit) {
+		writer_expect(writer, length);
+		return 1;
+	}
+	printf("%s/%s is %llu bytes, streamed without caching\n", hostname, pathname, length);
+	writer_abandon(writer);
+	sendNote(NOTE_BYPASS, fileSlot, 0, cachedPages[fileSlot].fillId, 0, 0, 0);
+	return 0;
+}
+
+//bypassPage   remembers the page with key hash as too large to cache
+void bypassPage(uint64_t hash) {
+	struct bypassEntry *b = &bypassed[hash % BYPASS_ENTRIES];
+
+	b->hash = hash;
+	b->since = time(NULL);
+}
+
+//isBypassed   whether the page with key hash was found too large to cache, forgotten after
+//config.cacheTtl in case it has shrunk, or when another page takes its entry
+int isBypassed(uint64_t hash) {
+	struct bypassEntry *b = &bypassed[hash % BYPASS_ENTRIES];
+
+	if (hash == 0 || b->hash != hash)
+		return 0;
+	if (config.cacheTtl > 0 && time(NULL) - b->since >= config.cacheTtl) {
+		b->hash = 0;
+		return 0;
+	}
+	return 1;
+}
+
+//packable   whether a fetched page is worth packing for the disk store: not already encoded
+//and not of a type in config.storeCompressSkip, which is compressed already
+int packable(store_fill_t *fill) {
+	char head[4096], value[256];
+	size_t n = fill->len < sizeof(head) - 1 ? fill->len : sizeof(head) - 1;
+
+	memcpy(head, fill->buf, n);
+	head[n] = '\0';
+	if (http_header(head, "Content-Encoding", value, sizeof(value)) == 0)
+		return 0;
+	return http_header(head, "Content-Type", value, sizeof(value)) < 0 || !gzip_type(config.storeCompressSkip, value);
+}
+
+//isPacked   whether the object at offset in s, length bytes long, holds a packed page
+int isPacked(store_t *s, uint64_t offset, size_t length) {
+	return pack_length(s->base + offset + sizeof(struct storeObject), length) > 0;
+}
+
+//fillNotesRead   applies notes from children: finished fills become hits, dropped pages and pages too
+//large to cache are forgotten
+void fillNotesRead(ioloop_t *loop, int res, void *arg) {
+	struct fillNote note;
+	struct cachePage *page;
+	struct storeObject *o;
+	store_t *s;
+	cache_entry_t *e, *re;
+	char names[VARY_NAMES];
+	int i;
+
+	for (i = 0; res > 0 && i < res / (int)sizeof(note); i++) {
+		note = noteBuf[i];
+		if (note.type == NOTE_ORIGIN) {
+			int before = (int)admission.limit;
+
+			if (note.tier <= 0) {
+				originFailed(note.host, note.port);
+				if (note.tier < 0)
+					backendUnreachable(note.host, note.port);
+				continue;
+			}
+			health_success(&health, note.host, note.port);
+			if (config.latencyTarget == 0)
+				continue;
+			admit_sample(&admission, note.length, ioloop_time());
+			if ((int)admission.limit != before) {
+				printf("Concurrency limit now %d\n", (int)admission.limit);
+				fflush(stdout);  //or every child forked later prints it again
+			}
+			continue;
+		}
+		if (note.slot < 0 || note.slot >= (int)config.cacheEntries)
+			continue;
+		e = &pageCache.entries[note.slot];
+		page = &cachedPages[note.slot];
+
+		if (note.type == NOTE_FILLED) {
+			s = note.tier == TIER_RAM ? &ramStore : &pageStore;
+			o = store_object(s, note.offset);
+			if (!e->inuse || page->state == PAGE_EMPTY || page->fillId != note.fillId ||
+			    o->magic != STORE_OBJ_MAGIC || o->seq != note.seq) {
+				store_release(s, note.offset, note.seq);  //slot was evicted or refilled meanwhile
+				continue;
+			}
+			if (page->state == PAGE_READY) {  //a refetch of a stale page, which was served until now
+				releasePage(page);
+				dropFromRam(page);
+				page->state = PAGE_FILLING;
 			}
+			re = NULL;
+			if (note.tier == TIER_RAM) {
+				//making room demotes other pages, which can push this one out of the index
+				re = cache_insert(&ramCache, e->key, e->keylen, e->hash, note.length);
+				if (re == NULL || !e->inuse || page->state != PAGE_FILLING) {
+					if (re != NULL) {
+						ramOwner[re->slot] = -1;
+						cache_remove(&ramCache, re);
+					}
+					store_release(s, note.offset, note.seq);
+					page->state = PAGE_EMPTY;
+					continue;
+				}
+				ramOwner[re->slot] = note.slot;
+				page->ramSlot = re->slot;
+			}
+			page->state = PAGE_READY;
+			page->tier = note.tier;
+			page->offset = note.offset;
+			page->seq = note.seq;
+			page->length = note.length;
+			page->verified = 1;
+			page->hits = 0;
+			page->filled = time(NULL);
+			page->packed = isPacked(s, note.offset, note.length);
+			page->blob = -1;
+			page->shared = 0;
+			indexChanges++;
+			if (note.tier == TIER_DISK)
+				cache_resize(&pageCache, e, note.length);  //charge the real size now that it is known
+			if (!e->inuse)
+				continue;  //too large for cache_bytes, evictPage has released it and owns no share yet
+			if (note.headLength > 0 && note.tier == TIER_DISK && !page->packed && shareBody(e, &note) < 0)
+				cache_remove(&pageCache, e);  //its body went meanwhile, the head alone is no page
+		}
+		else if (note.type == NOTE_DROPPED) {
+			if (e->inuse && page->state == PAGE_READY && page->tier == TIER_DISK && page->seq == note.seq) {
+				dropBody(page);
+				page->state = PAGE_EMPTY;  //space is already gone, nothing to release
+				cache_remove(&pageCache, e);
+			}
+		}
+		else if (note.type == NOTE_BYPASS) {
+			//give the entry back rather than keep refilling it, later misses stream through
+			if (e->inuse && page->state != PAGE_EMPTY && page->fillId == note.fillId) {
+				bypassPage(e->hash);
+				cache_remove(&pageCache, e);  //releases a stale page the fill was to replace
+			}
+		}
+		else if (note.type == NOTE_VARY) {
+			//keyed by the wrong headers: key the URL by these from now on, its next miss fills it
+			if (e->inuse && page->state != PAGE_EMPTY && page->fillId == note.fillId) {
+				vary_learn(&varyIndex, cache_hash(e->key, vary_split(e->key, e->keylen, names, sizeof(names))), note.vary);
+				cache_remove(&pageCache, e);  //releases a stale page the fill was to replace
+			}
+		}
+		else if (note.type == NOTE_UNFILLED) {
+			if (e->inuse && page->state == PAGE_FILLING && page->fillId == note.fillId) {
+				page->state = PAGE_EMPTY;
+				cache_remove(&pageCache, e);
+			}
+		}
+	}
+	if (ioloop_read(loop, notePipe[0], noteBuf, sizeof(noteBuf), fillNotesRead, NULL) < 0)
+		unix_error("ioloop_read error");
+}
+
+//reloadPage   re-adds a page from the checkpoint if its object is still intact in the store
+void reloadPage(const char *key, const struct checkpointRecord *r, void *arg) {
+	struct cachePage *page;
+	cache_entry_t *e;
+	char names[VARY_NAMES];
+	int keyLen;
+
+	if (cache_hash(key, r->keyLen) != r->keyhash)
+		return;
+	if ((e = cache_insert(&pageCache, key, r->keyLen, r->keyhash, r->length)) == NULL)
+		return;
+	purge_add(&purgeIndex, key, r->keyLen, e->slot);
+	keyLen = vary_split(key, r->keyLen, names, sizeof(names));
+	if (names[0] != '\0')  //a variant, its URL's requests are keyed by the same headers
+		vary_learn(&varyIndex, cache_hash(key, keyLen), names);
+	if (store_claim(&pageStore, r->offset, r->seq, r->keyhash, e->slot) != (int)r->length) {
+		cache_remove(&pageCache, e);  //freed, overwritten or half written before the restart
+		return;
+	}
+	page = &cachedPages[e->slot];
+	page->state = PAGE_READY;
+	page->offset = r->offset;
+	page->seq = r->seq;
+	page->length = r->length;
+	page->verified = 0;  //payload is checked on its first hit
+	page->filled = time(NULL);  //fetch time is not checkpointed, the page's TTL starts over
+	page->packed = isPacked(&pageStore, r->offset, r->length);
+	page->blob = -1;  //bodies are entered for dedup as pages are filled, not reloaded
+	page->shared = 0;
+}
+
+//checkpointPage   describes a page for the checkpoint, pages still being fetched are left out
+int checkpointPage(cache_entry_t *e, struct checkpointRecord *r, void *arg) {
+	struct cachePage *page = &cachedPages[e->slot];
+
+	if (page->state != PAGE_READY || page->tier != TIER_DISK)  //the memory tier does not survive a restart
+		return -1;
+	if (page->shared)  //only its head is in its object, it is fetched again after a restart
+		return -1;
+	r->offset = page->offset;
+	r->seq = page->seq;
+	r->length = page->length;
+	return 0;
+}
+
+//saveCheckpoint   forks a child that writes the index from its copy-on-write snapshot
+void saveCheckpoint() {
+	lastCheckpoint = time(NULL);
+	indexChanges = 0;
+	if (fork() == 0) {
+		closeInherited(-1);
+		if (checkpoint_save(config.indexFile, pageStore.hdr->storeId, &pageCache, checkpointPage, NULL) < 0)
+			printf("Checkpoint not written!\n");
+		exit(0);
+	}
+}
+
+//startLoop   sets up the parent's I/O loop: accepts, waits for request lines and reads of
+//the fill note pipe all complete through it
+void startLoop() {
+	int files[3] = { listenfd, notePipe[0], hostPipe[0] };
+	size_t i;
+
+	if (ioloop_init(&loop, config.ioBackend, 2 * config.maxPending + ACCEPTS_IN_FLIGHT + PROBES_IN_FLIGHT + 3) < 0) {
+		fprintf(stderr, "I/O backend %s is not available\n", ioloop_backend_name(config.ioBackend));
+		exit(1);
+	}
+	printf("I/O backend: %s\n", ioloop_backend_name(loop.backend));
+	fflush(stdout);
+
+	pendingConns = Calloc(config.maxPending, sizeof(struct pendingConn));
+	for (i = config.maxPending; i-- > 0; ) {
+		pendingConns[i].fd = -1;
+		arena_init(&pendingConns[i].arena, &bufPool);
+		ioloop_timer_init(&pendingConns[i].timer, headExpired, &pendingConns[i]);
+		pendingConns[i].next = freeConns;
+		freeConns = &pendingConns[i];
+	}
+	nfreeConns = config.maxPending;
+	//only saves work per operation, the loop runs without it
+	ioloop_register_files(&loop, files, 3);
+
+	if (ioloop_read(&loop, notePipe[0], noteBuf, sizeof(noteBuf), fillNotesRead, NULL) < 0 ||
+	    ioloop_read(&loop, hostPipe[0], hostNoteBuf, sizeof(hostNoteBuf), hostNotesRead, NULL) < 0)
+		unix_error("ioloop_read error");
+	if (config.peers.npeers > 0) {
+		ioloop_timer_init(&digestTimer, refreshDigests, NULL);
+		ioloop_timer_arm(&loop, &digestTimer, config.peerDigestInterval);
+	}
+	if (config.healthProbeInterval > 0 && config.healthFailures > 0) {
+		ioloop_timer_init(&probeTimer, probeOrigins, NULL);
+		ioloop_timer_arm(&loop, &probeTimer, config.healthProbeInterval);
+	}
+	postAccepts();
+}
+
+//probeOrigins   timer callback, starts a connect to each origin with an open circuit so one
+//that is back is let through again without waiting out config.healthOpenTime
+void probeOrigins(ioloop_t *loop, ioloop_timer_t *t, void *arg) {
+	struct originHealth *o;
+	struct sockaddr_storage addr;
+	upstream_t *u;
+	int i, d, fd;
+
+	for (i = 0; i < HEALTH_CIRCUITS && probesRunning < PROBES_IN_FLIGHT; i++) {
+		o = &health.origins[i];
+		if (o->state != HEALTH_OPEN || o->probe >= 0 || (d = checkIfIPCached(o->host)) < 0)
+			continue;
+		u = &DNSCaches[d].upstream;
+		if (u->naddrs == 0)
+			continue;
+		addr = u->addrs[0].addr;
+		if (addr.ss_family == AF_INET6)
+			((struct sockaddr_in6 *)&addr)->sin6_port = htons(o->port);
+		else
+			((struct sockaddr_in *)&addr)->sin_port = htons(o->port);
+		if ((fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+			break;
+		if ((connect(fd, (SA *)&addr, u->addrs[0].addrlen) < 0 && errno != EINPROGRESS) ||
+		    ioloop_poll(loop, fd, POLLOUT, probeDone, (void *)(intptr_t)i) < 0) {
+			close(fd);
+			health_probed(&health, i, 0, ioloop_time());
+		}
+		else {
+			o->probe = fd;
+			probesRunning++;
+		}
+	}
+	ioloop_timer_arm(loop, t, config.healthProbeInterval);
+}
+
+//probeDone   a probe's connect finished, the origin is up if it was accepted
+void probeDone(ioloop_t *loop, int res, void *arg) {
+	int i = (int)(intptr_t)arg;
+	int fd = health.origins[i].probe, err = 0;
+	socklen_t len = sizeof(err);
+
+	if (res >= 0 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+		err = errno;
+	close(fd);
+	probesRunning--;
+	if (res >= 0 && err == 0) {
+		printf("%s:%d answered a probe\n", health.origins[i].host, health.origins[i].port);
+		fflush(stdout);
+	}
+	health_probed(&health, i, res >= 0 && err == 0, ioloop_time());
+}
+
+//postAccepts   keeps accepts queued while there are free connections for them; once every
+//connection is reading its request line, new ones wait in the listen backlog
+void postAccepts() {
+	struct pendingConn *c;
+
+	while (acceptsQueued < ACCEPTS_IN_FLIGHT && nfreeConns > 0) {
+		c = freeConns;
+		freeConns = c->next;
+		nfreeConns--;
+		c->addrlen = sizeof(c->addr);
+		if (ioloop_accept(&loop, listenfd, (SA *)&c->addr, &c->addrlen, acceptDone, c) < 0)
+			unix_error("ioloop_accept error");
+		acceptsQueued++;
+	}
+}
+
+//freeConn   puts a connection back on the free list once it has been handed off or closed,
+//returning its buffers to the pool
+void freeConn(struct pendingConn *c) {
+	ioloop_timer_cancel(&loop, &c->timer);
+	if (c->head != NULL) {
+		bufchunk_put(c->head);
+		c->head = NULL;
+	}
+	arena_reset(&c->arena);
+	c->fd = -1;
+	c->next = freeConns;
+	freeConns = c;
+	nfreeConns++;
+	postAccepts();
+}
+
+//acceptDone   waits for the request line of a new connection; no buffer is taken until
+//the client has sent something
+void acceptDone(ioloop_t *loop, int res, void *arg) {
+	struct pendingConn *c = arg;
+
+	acceptsQueued--;
+	if (res < 0) {
+		freeConn(c);
+		return;
+	}
+	c->fd = res;
+	sockopt_apply(c->fd, &config.clientOpts, SOCK_CLIENT);
+	if (ioloop_poll(loop, c->fd, POLLIN, headReady, c) < 0) {
+		Close(c->fd);
+		freeConn(c);
+		return;
+	}
+	ioloop_timer_arm(loop, &c->timer, config.headerTimeout);
+	postAccepts();
+}
+
+//headExpired   a client that has not sent its request line in time is shut down, which ends
+//the pending poll and lets headReady free the connection
+void headExpired(ioloop_t *loop, ioloop_timer_t *t, void *arg) {
+	struct pendingConn *c = arg;
+
+	shutdown(c->fd, SHUT_RDWR);
+}
+
+//headReady   reads what the client has sent into a pooled buffer and, once the request line
+//is complete, hands the connection to serveRequest.  A request for a reverse proxy route waits
+//for its headers too, since it is routed by its Host header.
+void headReady(ioloop_t *loop, int res, void *arg) {
+	struct pendingConn *c = arg;
+	struct bufChunk *h;
+	char *eol, *target;
+	int reverse, whole, complete;
+	ssize_t m;
+
+	if (res < 0 || (c->head == NULL && (c->head = bufpool_get(&bufPool)) == NULL)) {
+		Close(c->fd);
+		freeConn(c);
+		return;
+	}
+	h = c->head;
+	m = recv(c->fd, h->data + h->len, MAXLINE - 1 - h->len, MSG_DONTWAIT);
+	if (m == 0 || (m < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+		Close(c->fd);  //closed before sending a request line
+		freeConn(c);
+		return;
+	}
+	if (m > 0)
+		h->len += m;
+	h->data[h->len] = '\0';
+	eol = strchr(h->data, '\n');
+	reverse = eol != NULL && config.routes.nroutes > 0 && (target = strchr(h->data, ' ')) != NULL && target[1] == '/';
+	//peers and prefetches mark their requests with a header, compression depends on the client's and
+	//ranges are asked for in one
+	whole = reverse || (eol != NULL && (config.peers.npeers > 0 || config.compressLevel > 0 ||
+					    config.prefetchConcurrency > 0 || config.rangeRequests != HTTP_RANGE_OFF));
+	if (whole)
+		complete = strstr(h->data, "\n\r\n") != NULL || strstr(h->data, "\n\n") != NULL;
+	else
+		complete = eol != NULL;
+	if (!complete && h->len < MAXLINE - 1) {
+		if (ioloop_poll(loop, c->fd, POLLIN, headReady, c) < 0) {
+			Close(c->fd);
+			freeConn(c);
 		}
-	}	
-	return fileLocation;
+		return;
+	}
+	if (eol != NULL && !whole)
+		eol[1] = '\0';
+	buf = h->data;
+	serveRequest(c->fd, &c->addr, &c->arena);
+	freeConn(c);
+}
+
+//closeInherited   closes the parent's descriptors a forked child must not hold on to, so
+//other clients see their connections close when their own child is done
+void closeInherited(int connfd) {
+	size_t i;
+
+	Close(listenfd);
+	for (i = 0; i < config.maxPending; i++) {
+		if (pendingConns[i].fd >= 0 && pendingConns[i].fd != connfd)
+			Close(pendingConns[i].fd);
+	}
 }
 
 //checkIfIPCached iterates through DNS caches to see if hostname has been cached in DNS
@@ -311,117 +2443,96 @@ int checkIfIPCached(char* hostname) {
 
 //sigchld handler kills zombie processes
 void sigchld_handler(int sig) {
-	while (waitpid(-1, 0, WNOHANG) > 0)
-		;
+	int olderrno = errno;
+	pid_t pid;
+
+	while ((pid = waitpid(-1, 0, WNOHANG)) > 0)
+		admit_exit(&admission, pid);  //frees its place for the next request
+	errno = olderrno;
 	return;
 }
 
 
-//Openclientfd is passed hostname and port, checks if was stored in cache, and if not, 
-//caches it and then connects to the server 
+//openclientfd is passed hostname and port, checks if its addresses were stored in cache,
+//and if not, caches them and then connects to whichever address answers first
 int openclientfd(char *hostname, int port)
 {
 	int clientfd; //fd to host
-	struct hostent *hp; //DNS structure 
-	struct sockaddr_in serveraddr; //TCP structure
-
-	if ((clientfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
-		return -1; /* check errno for cause of error */
-
-	struct timeval timeout; //struct used in setsockopt to define a timeout
-	timeout.tv_sec = 10; //length of time needed for a timeout to occur
-	timeout.tv_usec = 0; // start of timer
+	upstream_t *upstream, uncached; //addresses of the host
 
-	if (setsockopt(clientfd, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout,
-		sizeof(timeout)) < 0)
-		printf("setsockopt failed\n");
 	int cachedIPLocation = checkIfIPCached(hostname);  //check if IP cached
-	if (cachedIPLocation > -1) {  //if found, set hostent to cached DNS
-		hp = DNSCaches[cachedIPLocation].hp;
+	if (cachedIPLocation > -1) {  //if found, use the cached addresses and their history
+		upstream = &DNSCaches[cachedIPLocation].upstream;
 		printf("DNS was found in cache\n");
 	}
 	else {
-		/* Fill in the server's IP address and port */
-		if ((hp = gethostbyname(hostname)) == NULL) {
-			return -2; /* check h_errno for cause of error */
+		//resolve into the next cache entry, or just for this request if the cache is full
+		upstream = hostsCached < DNS_CACHE_SIZE ? &DNSCaches[hostsCached].upstream : &uncached;
+		if (upstream_resolve(upstream, hostname) != 0) {
+			return -2;
+		}
+		if (upstream != &uncached) {
+			strcpy(DNSCaches[hostsCached].hostName, hostname);
+			hostsCached++;
+			printf("DNS was added to cache\n");
 		}
-		hostsCached++;
-		//fill struct with host to cache
-		strcpy(DNSCaches[hostsCached].hostName, hostname);
-		DNSCaches[hostsCached].hp = hp;
-		printf("DNS was added to cache\n");
 	}
-	bzero((char *)&serveraddr, sizeof(serveraddr)); //zero out variable
-	serveraddr.sin_family = AF_INET; //set protocol
-	bcopy((char *)hp->h_addr_list[0],(char *)&serveraddr.sin_addr.s_addr, hp->h_length); //copy first address in hp to address in serveraddr
-	serveraddr.sin_port = htons(port); //set port number
 
 	/* Establish a connection with the server */
-	if (connect(clientfd, (SA *)&serveraddr, sizeof(serveraddr)) < 0)
-		return -1;
-	return clientfd;
+	clientfd = upstream_connect(upstream, port, config.connectDelay, config.connectTimeout, &config.upstreamOpts);
+	if (getpid() != parentPid)  //a child's copy of the cache goes with it, tell the parent
+		reportHost(hostname, upstream);
+	return clientfd < 0 ? -1 : clientfd;
+}
+
+//reportHost   sends the parent a host's addresses and their connect history from a child
+void reportHost(const char *hostname, upstream_t *u) {
+	struct hostNote note;
+
+	if (strlen(hostname) >= sizeof(note.host))
+		return;
+	memset(&note, 0, sizeof(note));
+	strcpy(note.host, hostname);
+	note.upstream = *u;
+	if (write(hostPipe[1], &note, sizeof(note)) != sizeof(note))
+		printf("Host note lost\n");
+}
+
+//hostNotesRead   caches the hosts children resolved, and replaces the history of those already
+//cached with what the child saw; when children race on a host, the last to report wins
+void hostNotesRead(ioloop_t *loop, int res, void *arg) {
+	struct hostNote *note;
+	int i, d;
+
+	for (i = 0; res > 0 && i < res / (int)sizeof(*note); i++) {
+		note = &hostNoteBuf[i];
+		if ((d = checkIfIPCached(note->host)) < 0) {
+			if (hostsCached == DNS_CACHE_SIZE)
+				continue;
+			d = hostsCached++;
+			strcpy(DNSCaches[d].hostName, note->host);
+		}
+		DNSCaches[d].upstream = note->upstream;
+	}
+	if (ioloop_read(loop, hostPipe[0], hostNoteBuf, sizeof(hostNoteBuf), hostNotesRead, NULL) < 0)
+		unix_error("ioloop_read error");
 }
 
-//Openclientfd uses openclientfd to open client fd and report error 
-//if unsuccessful and returns openclientfd result
+//Openclientfd uses openclientfd to open client fd and reports an error 
+//if unsuccessful and returns openclientfd result; the proxy keeps running
 int Openclientfd(char *hostname, int port)
 {
 	int rc;
 
 	if ((rc = openclientfd(hostname, port)) < 0) {
 		if (rc == -1)
-			unix_error("Open_clientfd Unix error");
+			fprintf(stderr, "Open_clientfd Unix error: %s: %s\n", hostname, strerror(errno));
 		else
-			dns_error("Open_clientfd DNS error");
+			fprintf(stderr, "Open_clientfd DNS error: %s\n", hostname);
 	}
 	return rc;
 }
 
-/*
- * parse_uri - URI parser
- * 
- * Given a URI from an HTTP proxy GET request (i.e., a URL), extract
- * the host name, path name, and port.  The memory for hostname and
- * pathname must already be allocated and should be at least MAXLINE
- * bytes. Return -1 if there are any problems.
- */
-int parse_uri(char *uri, char *hostname, char *pathname, int *port)
-{
-    char *hostbegin;
-    char *hostend;
-    char *pathbegin;
-    int len;
-
-    if (strncasecmp(uri, "http://", 7) != 0) {
-	hostname[0] = '\0';
-	return -1;
-    }
-       
-    /* Extract the host name */
-    hostbegin = uri + 7;
-    hostend = strpbrk(hostbegin, " :/\r\n\0");
-    len = hostend - hostbegin;
-    strncpy(hostname, hostbegin, len);
-    hostname[len] = '\0';
-    
-    /* Extract the port number */
-    *port = 80; /* default */
-    if (*hostend == ':')   
-	*port = atoi(hostend + 1);
-    
-    /* Extract the path */
-    pathbegin = strchr(hostbegin, '/');
-    if (pathbegin == NULL) {
-	pathname[0] = '\0';
-    }
-    else {
-	pathbegin++;	
-	strcpy(pathname, pathbegin);
-    }
-
-    return 0;
-}
-
 /*
  * format_log_entry - Create a formatted log entry in logstring. 
  * 
@@ -468,22 +2579,3 @@ void format_log_entry(char *logstring, struct sockaddr_in *sockaddr,
 	sprintf(logstring, "%s: %d.%d.%d.%d %s %d %s %s", time_str, a, b, c, d, uri, size, DNSCachedStatus, pageCachedStatus);
 	
 }
-
-int checkFileLength() {
-
-	FILE *filePtr;
-	int fileSize;
-
-	filePtr = fopen(cachedPages[isPageCached].filename, "r");
-	//read to end of file
-	fseek(filePtr, 0, SEEK_END);
-	//find length of file
-	fileSize = ftell(filePtr);
-	//move file pointer back to beginning
-	rewind(filePtr);
-	fclose(filePtr);
-	return fileSize > 0 ? fileSize : -1;
-
-}
-
-
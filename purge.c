@@ -0,0 +1,224 @@
+/*
+ * purge.c - finding cached pages to purge by URL prefix
+ *
+ * Nodes come from an array sized for the most the tree can need, two
+ * per slot and the root, so adding a key never fails.  A node keeps its
+ * index when it is split or merged, so its place in its parent's child
+ * list stays valid.
+ */
+
+#include "csapp.h"
+#include "purge.h"
+
+static const char *purgeNames[] = { "off", "local", "any" };
+
+/* purge_init - an empty tree for keys of nslots index slots */
+void purge_init(purge_index_t *p, size_t nslots)
+{
+	size_t i, nnodes = 2 * nslots + 1;
+
+	p->nslots = nslots;
+	p->nodes = Calloc(nnodes, sizeof(purge_node_t));
+	p->nodeOf = Malloc(nslots * sizeof(int));
+	for (i = 0; i < nslots; i++)
+		p->nodeOf[i] = -1;
+	for (i = 0; i < nnodes; i++) {
+		p->nodes[i].parent = p->nodes[i].child = -1;
+		p->nodes[i].slot = -1;
+		p->nodes[i].sibling = i + 1 < nnodes ? (int)i + 1 : -1;
+	}
+	p->nodes[0].sibling = -1;
+	p->freeList = nnodes > 1 ? 1 : -1;
+}
+
+/* new_node - a node under parent for len bytes of key, holding no key yet */
+static int new_node(purge_index_t *p, int parent, const char *label, size_t len)
+{
+	int n = p->freeList;
+	purge_node_t *node = &p->nodes[n];
+
+	p->freeList = node->sibling;
+	node->label = Malloc(len);
+	memcpy(node->label, label, len);
+	node->len = len;
+	node->parent = parent;
+	node->child = -1;
+	node->slot = -1;
+	node->sibling = p->nodes[parent].child;
+	p->nodes[parent].child = n;
+	return n;
+}
+
+/* free_node - give back a node already unlinked from its parent */
+static void free_node(purge_index_t *p, int n)
+{
+	free(p->nodes[n].label);
+	p->nodes[n].label = NULL;
+	p->nodes[n].sibling = p->freeList;
+	p->freeList = n;
+}
+
+/* adopt - make n the parent of the children of from, and the holder of its key */
+static void adopt(purge_index_t *p, int n, int from)
+{
+	int c;
+
+	p->nodes[n].child = p->nodes[from].child;
+	for (c = p->nodes[n].child; c >= 0; c = p->nodes[c].sibling)
+		p->nodes[c].parent = n;
+	p->nodes[n].slot = p->nodes[from].slot;
+	if (p->nodes[n].slot >= 0)
+		p->nodeOf[p->nodes[n].slot] = n;
+}
+
+/* split - cut node n's label after m bytes; the rest, with n's children and key, goes to a new child */
+static void split(purge_index_t *p, int n, size_t m)
+{
+	purge_node_t *node = &p->nodes[n];
+	int rest = p->freeList;
+
+	p->freeList = p->nodes[rest].sibling;
+	p->nodes[rest].label = Malloc(node->len - m);
+	memcpy(p->nodes[rest].label, node->label + m, node->len - m);
+	p->nodes[rest].len = node->len - m;
+	p->nodes[rest].parent = n;
+	p->nodes[rest].sibling = -1;
+	adopt(p, rest, n);
+	node->len = m;
+	node->child = rest;
+	node->slot = -1;
+}
+
+/* find_child - the child of n whose label starts with c, -1 if there is none */
+static int find_child(purge_index_t *p, int n, char c)
+{
+	int k;
+
+	for (k = p->nodes[n].child; k >= 0 && p->nodes[k].label[0] != c; k = p->nodes[k].sibling)
+		;
+	return k;
+}
+
+/* unlink_node - take n out of its parent's child list */
+static void unlink_node(purge_index_t *p, int n)
+{
+	int *pp;
+
+	for (pp = &p->nodes[p->nodes[n].parent].child; *pp != n; pp = &p->nodes[*pp].sibling)
+		;
+	*pp = p->nodes[n].sibling;
+}
+
+/* tidy - drop node n if it holds nothing, or fold its only child into it */
+static void tidy(purge_index_t *p, int n)
+{
+	purge_node_t *node = &p->nodes[n];
+	int parent, c;
+	char *label;
+
+	if (n == 0 || node->slot >= 0)
+		return;
+	if (node->child < 0) {
+		parent = node->parent;
+		unlink_node(p, n);
+		free_node(p, n);
+		tidy(p, parent);  //may be left with a single child
+	}
+	else if (p->nodes[node->child].sibling < 0) {
+		c = node->child;
+		label = Malloc(node->len + p->nodes[c].len);
+		memcpy(label, node->label, node->len);
+		memcpy(label + node->len, p->nodes[c].label, p->nodes[c].len);
+		free(node->label);
+		node->label = label;
+		node->len += p->nodes[c].len;
+		adopt(p, n, c);
+		free_node(p, c);
+	}
+}
+
+/* purge_add - enter the len byte key of the page in slot */
+void purge_add(purge_index_t *p, const char *key, size_t len, int slot)
+{
+	int n = 0, c;
+	size_t i = 0, m;
+
+	if (slot < 0 || (size_t)slot >= p->nslots)
+		return;
+	purge_remove(p, slot);
+	while (i < len) {
+		if ((c = find_child(p, n, key[i])) < 0) {
+			n = new_node(p, n, key + i, len - i);
+			break;
+		}
+		for (m = 0; m < p->nodes[c].len && i + m < len && p->nodes[c].label[m] == key[i + m]; m++)
+			;
+		if (m < p->nodes[c].len)
+			split(p, c, m);
+		n = c;
+		i += m;
+	}
+	p->nodes[n].slot = slot;
+	p->nodeOf[slot] = n;
+}
+
+/* purge_remove - take the key of the page in slot out of the tree */
+void purge_remove(purge_index_t *p, int slot)
+{
+	int n;
+
+	if (slot < 0 || (size_t)slot >= p->nslots || (n = p->nodeOf[slot]) < 0)
+		return;
+	p->nodeOf[slot] = -1;
+	p->nodes[n].slot = -1;
+	tidy(p, n);
+}
+
+/*
+ * purge_match - the slots of every key starting with the len byte
+ * prefix, into slots, which must have room for them all.  Returns how
+ * many there are.
+ */
+size_t purge_match(purge_index_t *p, const char *prefix, size_t len, int *slots)
+{
+	int n = 0, c, at;
+	size_t i = 0, m, count = 0;
+
+	while (i < len) {
+		if ((c = find_child(p, n, prefix[i])) < 0)
+			return 0;
+		for (m = 0; m < p->nodes[c].len && i + m < len && p->nodes[c].label[m] == prefix[i + m]; m++)
+			;
+		if (m < p->nodes[c].len && i + m < len)
+			return 0;  //the prefix goes another way part way along the label
+		n = c;
+		i += m;
+	}
+
+	//every key below n, in depth first order
+	for (at = n;;) {
+		if (p->nodes[at].slot >= 0)
+			slots[count++] = p->nodes[at].slot;
+		if (p->nodes[at].child >= 0) {
+			at = p->nodes[at].child;
+			continue;
+		}
+		while (at != n && p->nodes[at].sibling < 0)
+			at = p->nodes[at].parent;
+		if (at == n)
+			break;
+		at = p->nodes[at].sibling;
+	}
+	return count;
+}
+
+/* purge_byname - map "off", "local" or "any" to who may purge, -1 if unknown */
+int purge_byname(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(purgeNames) / sizeof(purgeNames[0])); i++)
+		if (strcasecmp(name, purgeNames[i]) == 0)
+			return i;
+	return -1;
+}
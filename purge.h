@@ -0,0 +1,45 @@
+/*
+ * purge.h - finding cached pages to purge by URL prefix
+ *
+ * A PURGE names one URL, every URL under a path prefix, or a whole
+ * host.  Every page in the index has its key, host then path, entered
+ * in a radix tree: each edge carries a run of key bytes, and a node
+ * where a key ends holds the key's index slot.  The pages under a
+ * prefix are the subtree below the point where the prefix ends, so a
+ * purge costs the prefix's length plus the entries it matches, however
+ * many other pages are cached; a host is the prefix "host/".  A node
+ * left with one child and no key of its own is merged into the child,
+ * so the tree has fewer than two nodes per key.
+ */
+#ifndef __PURGE_H__
+#define __PURGE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Who may purge */
+#define PURGE_OFF     0                  /* nobody, PURGE is refused */
+#define PURGE_LOCAL   1                  /* clients on the loopback network */
+#define PURGE_ANY     2                  /* any client */
+
+typedef struct {
+	char *label;                  //key bytes on the edge from the parent
+	uint32_t len;
+	int parent, child, sibling;   //-1 for none
+	int slot;                     //index slot of the key ending here, -1 for none
+} purge_node_t;
+
+typedef struct {
+	purge_node_t *nodes;          //node 0 is the root, the empty key
+	int *nodeOf;                  //node of each slot's key, -1 for none
+	size_t nslots;
+	int freeList;                 //unused nodes, chained through sibling
+} purge_index_t;
+
+void purge_init(purge_index_t *p, size_t nslots);
+void purge_add(purge_index_t *p, const char *key, size_t len, int slot);
+void purge_remove(purge_index_t *p, int slot);
+size_t purge_match(purge_index_t *p, const char *prefix, size_t len, int *slots);
+int purge_byname(const char *name);
+
+#endif /* __PURGE_H__ */
@@ -0,0 +1,137 @@
+/*
+ * ratelimit.c - per-client request and byte rate limits
+ *
+ * Only the parent claims entries; children look theirs up and charge it.
+ * A charge checks the entry still belongs to its address, since an idle
+ * entry can be handed to another client in the meantime.
+ */
+
+#include "csapp.h"
+#include "ratelimit.h"
+
+/*
+ * ratelimit_init - set up limits of requests and bytes per second, each
+ * with a burst of that many allowed at once; a rate of 0 turns a limit
+ * off.  entries is rounded up to whole shards.  Returns -1 if the table
+ * cannot be mapped.
+ */
+int ratelimit_init(ratelimit_t *r, size_t entries, double requests, double requestBurst,
+		   double bytes, double byteBurst, int idleSec)
+{
+	memset(r, 0, sizeof(*r));
+	if (requests <= 0 && bytes <= 0)
+		return 0;  //nothing to limit, no table
+	r->nshards = (entries + RATE_SHARD_SIZE - 1) / RATE_SHARD_SIZE;
+	if (r->nshards == 0)
+		r->nshards = 1;
+	r->entries = mmap(NULL, r->nshards * RATE_SHARD_SIZE * sizeof(struct rateEntry),
+			  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (r->entries == MAP_FAILED) {
+		r->entries = NULL;
+		return -1;
+	}
+	if (requests > 0) {
+		r->requestCost = 1e9 / requests;
+		r->requestBurst = r->requestCost * (requestBurst > 1 ? requestBurst : 1);
+	}
+	if (bytes > 0) {
+		r->byteCost = 1e9 / bytes;
+		r->byteBurst = r->byteCost * byteBurst;
+	}
+	r->idle = idleSec * 1000000000ULL;
+	return 0;
+}
+
+/* ratelimit_now - monotonic time in ns, the same clock in every process */
+uint64_t ratelimit_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * ratelimit_entry - the entry of addr, claiming a free or idle one in its
+ * shard if create is set.  Returns NULL if limits are off, or the shard is
+ * full of active clients, in which case the client goes unlimited.
+ */
+struct rateEntry *ratelimit_entry(ratelimit_t *r, uint32_t addr, int create)
+{
+	struct rateEntry *shard, *e, *reuse = NULL;
+	uint32_t h = addr * 2654435761u, owner;
+	uint64_t now;
+	size_t i, start;
+
+	if (r->entries == NULL || addr == 0)
+		return NULL;
+	shard = r->entries + (h >> 16) % r->nshards * RATE_SHARD_SIZE;
+	start = h % RATE_SHARD_SIZE;
+	now = create ? ratelimit_now() : 0;
+	for (i = 0; i < RATE_SHARD_SIZE; i++) {
+		e = &shard[(start + i) % RATE_SHARD_SIZE];
+		owner = __atomic_load_n(&e->addr, __ATOMIC_ACQUIRE);
+		if (owner == addr)
+			return e;
+		if (create && reuse == NULL &&
+		    (owner == 0 || now - __atomic_load_n(&e->lastSeen, __ATOMIC_RELAXED) > r->idle))
+			reuse = e;
+	}
+	if (reuse == NULL)
+		return NULL;
+	//an idle client's buckets are full by now, so the newcomer starts with full ones too
+	__atomic_store_n(&reuse->requestsFull, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&reuse->bytesFull, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&reuse->lastSeen, now, __ATOMIC_RELAXED);
+	__atomic_store_n(&reuse->addr, addr, __ATOMIC_RELEASE);
+	return reuse;
+}
+
+/*
+ * charge - take cost ns from the bucket full at *full, which may run
+ * burst ns ahead.  Returns how far past the burst the charge went, 0 if
+ * it fit; with strict set a charge that does not fit is not taken.
+ */
+static uint64_t charge(uint64_t *full, uint64_t cost, uint64_t burst, uint64_t now, int strict)
+{
+	uint64_t old = __atomic_load_n(full, __ATOMIC_RELAXED), next, over;
+
+	do {
+		next = (old > now ? old : now) + cost;
+		over = next - now > burst ? next - now - burst : 0;
+		if (over > 0 && strict)
+			return over;
+	} while (!__atomic_compare_exchange_n(full, &old, next, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return over;
+}
+
+/* ratelimit_request - charge addr for a request, -1 if it is over its request limit */
+int ratelimit_request(ratelimit_t *r, struct rateEntry *e, uint32_t addr)
+{
+	uint64_t now;
+
+	if (e == NULL || r->requestCost == 0)
+		return 0;
+	now = ratelimit_now();
+	if (__atomic_load_n(&e->addr, __ATOMIC_ACQUIRE) != addr)
+		return 0;
+	__atomic_store_n(&e->lastSeen, now, __ATOMIC_RELAXED);
+	return charge(&e->requestsFull, r->requestCost, r->requestBurst, now, 1) > 0 ? -1 : 0;
+}
+
+/*
+ * ratelimit_bytes - charge addr for n bytes sent to it.  Returns the ns to
+ * wait before sending them to keep to its byte rate, 0 under the limit.
+ */
+uint64_t ratelimit_bytes(ratelimit_t *r, struct rateEntry *e, uint32_t addr, size_t n)
+{
+	uint64_t now;
+
+	if (e == NULL || r->byteCost == 0)
+		return 0;
+	now = ratelimit_now();
+	if (__atomic_load_n(&e->addr, __ATOMIC_ACQUIRE) != addr)
+		return 0;
+	__atomic_store_n(&e->lastSeen, now, __ATOMIC_RELAXED);
+	return charge(&e->bytesFull, (uint64_t)(n * r->byteCost), r->byteBurst, now, 0);
+}
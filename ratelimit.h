@@ -0,0 +1,46 @@
+/*
+ * ratelimit.h - per-client request and byte rate limits
+ *
+ * Each client address has two token buckets, one for requests and one
+ * for bytes sent to it, kept in a table in shared memory so the parent,
+ * which admits requests, and the children, which send the bytes, charge
+ * the same buckets.  A bucket is a single word, the time at which it
+ * will be full again (GCRA), updated with compare-and-swap, so charging
+ * takes no lock and costs one atomic operation for a client under its
+ * limit.  The table is split into shards probed separately; entries of
+ * clients that have been idle for idleSec are reused for new clients.
+ */
+#ifndef __RATELIMIT_H__
+#define __RATELIMIT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RATE_SHARD_SIZE 64      /* entries per shard, a client is probed for within one */
+
+struct rateEntry {
+	uint32_t addr;              //client IPv4 address in network order, 0 while free
+	uint32_t unused;
+	uint64_t requestsFull;      //ns when the request bucket is full again
+	uint64_t bytesFull;         //ns when the byte bucket is full again
+	uint64_t lastSeen;          //ns of the last charge
+};
+
+typedef struct {
+	struct rateEntry *entries;  //shared with every child
+	size_t nshards;
+	uint64_t requestCost;       //ns of refill one request costs, 0 for no request limit
+	uint64_t requestBurst;      //ns of requests a client may run ahead
+	double byteCost;            //ns of refill one byte costs, 0 for no byte limit
+	uint64_t byteBurst;
+	uint64_t idle;              //ns after which an entry may be reused
+} ratelimit_t;
+
+int ratelimit_init(ratelimit_t *r, size_t entries, double requests, double requestBurst,
+		   double bytes, double byteBurst, int idleSec);
+uint64_t ratelimit_now(void);
+struct rateEntry *ratelimit_entry(ratelimit_t *r, uint32_t addr, int create);
+int ratelimit_request(ratelimit_t *r, struct rateEntry *e, uint32_t addr);
+uint64_t ratelimit_bytes(ratelimit_t *r, struct rateEntry *e, uint32_t addr, size_t n);
+
+#endif /* __RATELIMIT_H__ */
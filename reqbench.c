@@ -0,0 +1,161 @@
+/*
+ * reqbench.c - packets and reads per request through the proxy
+ *
+ * Acts as both the client and the origin server for a running proxy.
+ * Each round asks the proxy for a page it cannot have cached, from an
+ * origin on a local port, and measures on the origin's socket how many
+ * data segments the proxy's request arrived in and how many reads it
+ * took to collect.  A second set of rounds sends a method the proxy
+ * rejects and counts the segments of its error response.  Segment
+ * counts come from TCP_INFO, so they are exact on loopback.  Latency is
+ * reported as the mean and the 50th and 99th percentiles of each kind,
+ * so runs against differently configured proxies can be compared.
+ */
+
+#include "csapp.h"
+#include <linux/tcp.h>
+
+/* usage - print the command line summary and exit */
+static void usage(char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n rounds] [-s size] proxyport\n"
+		"  -n rounds  requests of each kind (default: 100)\n"
+		"  -s size    body bytes the origin answers with (default: 1024)\n",
+		prog);
+	exit(1);
+}
+
+/* data_segs_in - data segments fd has received, 0 if the kernel does not say */
+static unsigned data_segs_in(int fd)
+{
+	struct tcp_info ti;
+	socklen_t len = sizeof(ti);
+
+	memset(&ti, 0, sizeof(ti));
+	if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) < 0)
+		return 0;
+	return ti.tcpi_data_segs_in;
+}
+
+/* now_ms - monotonic time in milliseconds */
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* by_value - qsort comparison of doubles */
+static int by_value(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* report - print one line of results, sorting times */
+static void report(const char *kind, int rounds, double segs, double reads, double *times)
+{
+	double total = 0;
+	char readsCol[32];
+	int i;
+
+	for (i = 0; i < rounds; i++)
+		total += times[i];
+	qsort(times, rounds, sizeof(double), by_value);
+	if (reads < 0)
+		strcpy(readsCol, "-");
+	else
+		sprintf(readsCol, "%.2f", reads / rounds);
+	printf("%-8s %8d %12.2f %10s %9.3f %9.3f %9.3f\n", kind, rounds, segs / rounds, readsCol,
+	       total / rounds, times[rounds / 2], times[(rounds * 99) / 100]);
+}
+
+/* read_all - read fd to its end, returning the data segments it came in */
+static unsigned read_all(int fd)
+{
+	char buf[MAXLINE];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	return data_segs_in(fd);
+}
+
+int main(int argc, char **argv)
+{
+	int c, i, rounds = 100, size = 1024, proxyport, originport;
+	int listenfd, clientfd, originfd;
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	char head[MAXLINE], request[MAXLINE], *body;
+	size_t len;
+	ssize_t m;
+	unsigned long reads = 0, segs = 0, errorSegs = 0;
+	double start, *missMs, *errorMs;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n': rounds = atoi(optarg); break;
+		case 's': size = atoi(optarg); break;
+		default: usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || rounds < 1 || size < 0)
+		usage(argv[0]);
+	proxyport = atoi(argv[optind]);
+	Signal(SIGPIPE, SIG_IGN);
+
+	listenfd = Open_listenfd(0);
+	if (getsockname(listenfd, (SA *)&addr, &addrlen) < 0)
+		unix_error("getsockname error");
+	originport = ntohs(addr.sin_port);
+	body = Calloc(size + 1, 1);
+	missMs = Calloc(rounds, sizeof(double));
+	errorMs = Calloc(rounds, sizeof(double));
+	memset(body, 'x', size);
+
+	for (i = 0; i < rounds; i++) {
+		start = now_ms();
+		clientfd = Open_clientfd("localhost", proxyport);
+		len = snprintf(request, sizeof(request), "GET http://localhost:%d/reqbench/%d/%d HTTP/1.0\r\n\r\n",
+			       originport, (int)getpid(), i);
+		Rio_writen(clientfd, request, len);
+
+		//collect the proxy's request as it arrives, one read per wakeup
+		originfd = Accept(listenfd, NULL, NULL);
+		len = 0;
+		do {
+			if ((m = read(originfd, head + len, sizeof(head) - 1 - len)) <= 0)
+				break;
+			len += m;
+			head[len] = '\0';
+			reads++;
+		} while (strstr(head, "\n\n") == NULL && strstr(head, "\r\n\r\n") == NULL && len < sizeof(head) - 1);
+		segs += data_segs_in(originfd);
+		len = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\nContent-Length: %d\r\n\r\n", size);
+		Rio_writen(originfd, head, len);
+		Rio_writen(originfd, body, size);
+		Close(originfd);
+
+		read_all(clientfd);
+		Close(clientfd);
+		missMs[i] = now_ms() - start;
+	}
+
+	for (i = 0; i < rounds; i++) {
+		start = now_ms();
+		clientfd = Open_clientfd("localhost", proxyport);
+		len = snprintf(request, sizeof(request), "POST http://localhost:%d/ HTTP/1.0\r\n\r\n", originport);
+		Rio_writen(clientfd, request, len);
+		errorSegs += read_all(clientfd);
+		Close(clientfd);
+		errorMs[i] = now_ms() - start;
+	}
+
+	printf("%-8s %8s %12s %10s %9s %9s %9s\n", "request", "rounds", "segments/req", "reads/req", "mean ms", "p50 ms", "p99 ms");
+	report("miss", rounds, segs, reads, missMs);
+	report("400", rounds, errorSegs, -1, errorMs);
+	return 0;
+}
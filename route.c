@@ -0,0 +1,151 @@
+/*
+ * route.c - reverse proxy routes to pools of backend servers
+ */
+
+#include "csapp.h"
+#include "route.h"
+
+static const char *balanceNames[] = { "least", "p2c" };
+
+/* route_balance_byname - ROUTE_LEAST or ROUTE_P2C by name, -1 if unknown */
+int route_balance_byname(const char *name)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+		if (strcasecmp(name, balanceNames[i]) == 0)
+			return i;
+	return -1;
+}
+
+/* find_pool - the pool called name, created empty if it is new; -1 if there is no room */
+static int find_pool(routes_t *t, const char *name)
+{
+	int i;
+
+	for (i = 0; i < t->npools; i++)
+		if (strcmp(t->pools[i].name, name) == 0)
+			return i;
+	if (t->npools == ROUTE_MAX_POOLS || strlen(name) >= sizeof(t->pools[0].name))
+		return -1;
+	strcpy(t->pools[t->npools].name, name);
+	t->pools[t->npools].nbackends = 0;
+	return t->npools++;
+}
+
+/* route_add_backend - add "pool host[:port]" to t, -1 if it is malformed or there is no room */
+int route_add_backend(routes_t *t, const char *value)
+{
+	char name[MAXLINE], host[MAXLINE], *colon;
+	struct backendPool *p;
+	struct backend *b;
+	int i;
+
+	if (sscanf(value, "%s %s", name, host) != 2 || (i = find_pool(t, name)) < 0)
+		return -1;
+	p = &t->pools[i];
+	if (p->nbackends == ROUTE_MAX_BACKENDS)
+		return -1;
+	b = &p->backends[p->nbackends];
+	b->port = 80;
+	if ((colon = strrchr(host, ':')) != NULL) {
+		*colon = '\0';
+		if ((b->port = atoi(colon + 1)) <= 0 || b->port > 65535)
+			return -1;
+	}
+	if (host[0] == '\0' || strlen(host) >= sizeof(b->host))
+		return -1;
+	strcpy(b->host, host);
+	b->origin = -1;
+	p->nbackends++;
+	return 0;
+}
+
+/* route_add - add "match pool" to t, -1 if it is malformed or there is no room */
+int route_add(routes_t *t, const char *value)
+{
+	char match[MAXLINE], name[MAXLINE];
+	struct route *r;
+	int i;
+
+	if (sscanf(value, "%s %s", match, name) != 2 || t->nroutes == ROUTE_MAX_ROUTES ||
+	    strlen(match) >= sizeof(r->match) || (i = find_pool(t, name)) < 0)
+		return -1;
+	r = &t->routes[t->nroutes++];
+	strcpy(r->match, match);
+	r->pool = i;
+	return 0;
+}
+
+/*
+ * route_match - the pool for a request to host (without a port) for path
+ * (starting with '/'): a route for the host wins, then the longest path
+ * prefix, then "*".  Returns NULL if nothing matches.
+ */
+struct backendPool *route_match(routes_t *t, const char *host, const char *path)
+{
+	struct route *r, *best = NULL;
+	size_t len, bestLen = 0;
+	int i;
+
+	for (i = 0; i < t->nroutes; i++) {
+		r = &t->routes[i];
+		if (r->match[0] == '/') {
+			len = strlen(r->match);
+			if (len > bestLen && strncmp(path, r->match, len) == 0) {
+				best = r;
+				bestLen = len;
+			}
+		}
+		else if (strcmp(r->match, "*") == 0) {
+			if (best == NULL)
+				best = r;
+		}
+		else if (strcasecmp(r->match, host) == 0) {
+			return &t->pools[r->pool];
+		}
+	}
+	return best != NULL ? &t->pools[best->pool] : NULL;
+}
+
+/* cost - how loaded b is, a backend that failed recently counting as more than any load */
+static long cost(struct backend *b, const int *load, time_t now)
+{
+	return load[b->origin] + (b->retryAt > now ? 1L << 30 : 0);
+}
+
+/*
+ * route_pick - the backend of p to send a request to, load[b->origin]
+ * being the requests b has outstanding.  Backends that failed to connect
+ * in the last ROUTE_RETRY seconds are only picked if all have.  exclude,
+ * if not NULL, is left out, as when it has just failed to connect.
+ * Returns NULL if p has no other backend.
+ */
+struct backend *route_pick(routes_t *t, struct backendPool *p, const int *load, struct backend *exclude)
+{
+	static int start;
+	struct backend *b, *best = NULL;
+	int i, j, n = p->nbackends - (exclude != NULL);
+	time_t now = time(NULL);
+
+	if (n <= 0)
+		return NULL;
+	if (t->balance == ROUTE_P2C && n > 2) {
+		//two distinct backends other than exclude, at random
+		do
+			i = random() % p->nbackends;
+		while (&p->backends[i] == exclude);
+		do
+			j = random() % p->nbackends;
+		while (j == i || &p->backends[j] == exclude);
+		return cost(&p->backends[j], load, now) < cost(&p->backends[i], load, now) ? &p->backends[j] : &p->backends[i];
+	}
+	//least outstanding, ties taken in turn so an idle pool still spreads its requests
+	start = start % p->nbackends + 1;
+	for (j = 0; j < p->nbackends; j++) {
+		b = &p->backends[(start + j) % p->nbackends];
+		if (b != exclude && (best == NULL || cost(b, load, now) < cost(best, load, now)))
+			best = b;
+	}
+	return best;
+}
@@ -0,0 +1,56 @@
+/*
+ * route.h - reverse proxy routes to pools of backend servers
+ *
+ * A request with a relative URI is routed by its Host header or its
+ * path to a pool of backends, and one backend of the pool is picked for
+ * each request that has to be fetched: the one with the fewest requests
+ * outstanding, or the less loaded of two picked at random (power of two
+ * choices), which stays nearly as balanced without every proxy piling
+ * onto the same momentarily idle backend.
+ */
+#ifndef __ROUTE_H__
+#define __ROUTE_H__
+
+#include <time.h>
+
+#define ROUTE_MAX_POOLS     16
+#define ROUTE_MAX_BACKENDS  16    /* per pool */
+#define ROUTE_MAX_ROUTES    64
+#define ROUTE_RETRY         10    /* seconds a backend that failed to connect is passed over */
+
+#define ROUTE_LEAST  0            /* fewest outstanding requests */
+#define ROUTE_P2C    1            /* power of two choices */
+
+struct backend {
+	char host[256];
+	int port;
+	int origin;                   //admission bucket, which counts its outstanding requests
+	time_t retryAt;               //after failing to connect, picked only if every backend has until then
+};
+
+struct backendPool {
+	char name[64];
+	int nbackends;
+	struct backend backends[ROUTE_MAX_BACKENDS];
+};
+
+struct route {
+	char match[256];              //"/prefix" for a path, "*" for any request, else a host name
+	int pool;
+};
+
+typedef struct {
+	int balance;                  //ROUTE_LEAST or ROUTE_P2C
+	int npools;
+	struct backendPool pools[ROUTE_MAX_POOLS];
+	int nroutes;
+	struct route routes[ROUTE_MAX_ROUTES];
+} routes_t;
+
+int route_balance_byname(const char *name);
+int route_add_backend(routes_t *t, const char *value);
+int route_add(routes_t *t, const char *value);
+struct backendPool *route_match(routes_t *t, const char *host, const char *path);
+struct backend *route_pick(routes_t *t, struct backendPool *p, const int *load, struct backend *exclude);
+
+#endif /* __ROUTE_H__ */
@@ -0,0 +1,44 @@
+#!/bin/sh
+#
+# sockbench.sh - latency of the proxy under each socket option scenario
+#
+# Starts the proxy once per scenario with just that scenario's settings,
+# runs reqbench against it and prints reqbench's table under the
+# scenario's name.  Each proxy runs in its own scratch directory, so the
+# cache is cold every time, and on the next port up, so no scenario waits
+# for the last one's listener to go away.
+#
+# usage: ./sockbench.sh [port [rounds [size]]]
+
+port=${1:-15299}
+rounds=${2:-200}
+size=${3:-65536}
+here=$(cd "$(dirname "$0")" && pwd)
+
+run() {
+	name=$1
+	shift
+	dir=$(mktemp -d)
+	for setting in "$@"; do
+		echo "$setting" >> "$dir/proxy.conf"
+	done
+	touch "$dir/proxy.conf"
+	(cd "$dir" && exec "$here/proxy" "$port" proxy.conf > proxy.out 2>&1) &
+	pid=$!
+	sleep 0.5
+	echo "== $name: $*"
+	"$here/reqbench" -n "$rounds" -s "$size" "$port"
+	kill "$pid"
+	wait "$pid" 2> /dev/null
+	rm -rf "$dir"
+	port=$((port + 1))
+}
+
+run default
+run nodelay "client_nodelay 1" "upstream_nodelay 1"
+run defer_accept "listen_defer_accept 5"
+run fastopen "listen_fastopen 256" "upstream_fastopen 1"
+run buffers "client_sndbuf 1M" "upstream_rcvbuf 1M"
+run small_buffers "client_sndbuf 16K" "upstream_rcvbuf 16K"
+run keepalive "client_keepalive 60" "upstream_keepalive 60"
+run backlog "listen_backlog 16" "listen_reuseport 1"
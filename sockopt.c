@@ -0,0 +1,79 @@
+/*
+ * sockopt.c - socket options for the proxy's three kinds of socket
+ */
+
+#include "csapp.h"
+#include "sockopt.h"
+#include <netinet/tcp.h>
+
+#ifndef TCP_FASTOPEN_CONNECT
+#define TCP_FASTOPEN_CONNECT 30
+#endif
+
+/* set_int - set an int option if it is not 0, counting a failure in *failed */
+static void set_int(int fd, int level, int option, int value, int *failed)
+{
+	if (value != 0 && setsockopt(fd, level, option, &value, sizeof(value)) < 0)
+		(*failed)++;
+}
+
+/*
+ * sockopt_apply - set o's options for role on fd.  Options are set one
+ * by one and a kernel that lacks one does not stop the rest.  Returns 0,
+ * or -1 with errno from the last option that could not be set.
+ */
+int sockopt_apply(int fd, const struct sockOpts *o, int role)
+{
+	int failed = 0, err = 0;
+
+	set_int(fd, SOL_SOCKET, SO_SNDBUF, (int)o->sndBuf, &failed);
+	set_int(fd, SOL_SOCKET, SO_RCVBUF, (int)o->rcvBuf, &failed);
+	if (role == SOCK_LISTEN) {
+		set_int(fd, SOL_SOCKET, SO_REUSEPORT, o->reusePort, &failed);
+		set_int(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, o->deferAccept, &failed);
+		set_int(fd, IPPROTO_TCP, TCP_FASTOPEN, o->fastOpen, &failed);
+	}
+	else {
+		set_int(fd, IPPROTO_TCP, TCP_NODELAY, o->noDelay, &failed);
+		if (role == SOCK_UPSTREAM)
+			set_int(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, o->fastOpen, &failed);
+		if (o->keepIdle > 0) {
+			set_int(fd, SOL_SOCKET, SO_KEEPALIVE, 1, &failed);
+			set_int(fd, IPPROTO_TCP, TCP_KEEPIDLE, o->keepIdle, &failed);
+			set_int(fd, IPPROTO_TCP, TCP_KEEPINTVL, o->keepInterval, &failed);
+			set_int(fd, IPPROTO_TCP, TCP_KEEPCNT, o->keepProbes, &failed);
+		}
+	}
+	if (failed)
+		err = errno;
+	errno = err;
+	return failed ? -1 : 0;
+}
+
+/*
+ * sockopt_listen - open_listenfd with o's listener options, which have to
+ * be set before bind and listen.  An option the kernel does not support
+ * is reported and skipped.  Returns the socket, or -1 with errno set.
+ */
+int sockopt_listen(int port, const struct sockOpts *o)
+{
+	int listenfd, optval = 1;
+	struct sockaddr_in serveraddr;
+
+	if ((listenfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		return -1;
+	if (setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval)) < 0)
+		return -1;
+	if (sockopt_apply(listenfd, o, SOCK_LISTEN) < 0)
+		fprintf(stderr, "Some listener options were not set: %s\n", strerror(errno));
+
+	memset(&serveraddr, 0, sizeof(serveraddr));
+	serveraddr.sin_family = AF_INET;
+	serveraddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	serveraddr.sin_port = htons((unsigned short)port);
+	if (bind(listenfd, (SA *)&serveraddr, sizeof(serveraddr)) < 0)
+		return -1;
+	if (listen(listenfd, o->backlog > 0 ? o->backlog : LISTENQ) < 0)
+		return -1;
+	return listenfd;
+}
@@ -0,0 +1,33 @@
+/*
+ * sockopt.h - socket options for the proxy's three kinds of socket
+ *
+ * The listener, the client connections it accepts and the connections
+ * to origin servers are each tuned by their own set of options.  A zero
+ * field leaves the system default, so an empty set changes nothing.
+ */
+#ifndef __SOCKOPT_H__
+#define __SOCKOPT_H__
+
+#include <stddef.h>
+
+#define SOCK_LISTEN    0         /* the proxy's listening socket */
+#define SOCK_CLIENT    1         /* a connection accepted from a client */
+#define SOCK_UPSTREAM  2         /* a connection to an origin server */
+#define SOCK_NROLES    3
+
+struct sockOpts {
+	int backlog;                 //listen backlog, listener only
+	int reusePort;               //SO_REUSEPORT, listener only
+	int deferAccept;             //TCP_DEFER_ACCEPT seconds, listener only
+	int fastOpen;                //TCP_FASTOPEN queue on the listener, TCP_FASTOPEN_CONNECT upstream
+	int noDelay;                 //TCP_NODELAY
+	size_t sndBuf, rcvBuf;       //SO_SNDBUF and SO_RCVBUF bytes
+	int keepIdle;                //seconds idle before keepalive probes, enables SO_KEEPALIVE
+	int keepInterval;            //seconds between probes
+	int keepProbes;              //unanswered probes before the connection is dropped
+};
+
+int sockopt_apply(int fd, const struct sockOpts *o, int role);
+int sockopt_listen(int port, const struct sockOpts *o);
+
+#endif /* __SOCKOPT_H__ */
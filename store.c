@@ -0,0 +1,781 @@
+/*
+ * store.c - single-file slab storage engine for cached objects
+ *
+ * File layout:
+ *     struct storeHeader | page table | chunk bitmaps | slab pages | log
+ *
+ * Slab pages are STORE_PAGE_SIZE bytes and are given to a size class on
+ * first use.  Classes grow by about 25% from STORE_MIN_CHUNK up to a
+ * whole page, and a per-page bitmap records which chunks are handed
+ * out.  A page whose last chunk is freed goes back on the free page
+ * list so any class can reuse it.
+ *
+ * Objects too large for a page (or that find the slabs full) are
+ * appended to a circular log.  The log reclaims space from its head:
+ * objects the cache already released are skipped, live ones are
+ * overwritten and reported through the dropped callback so the owner
+ * can forget them, and objects still being read stop the allocation.
+ *
+ * All processes share one robust, process-shared mutex in the header.
+ * Readers pin objects with store_ref() so space is never reused under
+ * a client that is still being served.  A reader whose sends go on
+ * after it unpins, as sendfile's do, asks with store_hold() for the
+ * space to be left alone a while longer: a freed slab chunk waits in the
+ * held list until then, and the log does not reclaim past it.
+ *
+ * When an existing file with the same geometry is opened the objects in
+ * it are kept.  The slab allocator starts out empty and the owner claims
+ * every object it still knows about with store_claim() before calling
+ * store_recover_end(); unclaimed chunks and log objects become free.
+ *
+ * A store opened without a file lives in anonymous shared memory; the
+ * proxy uses one as its RAM tier.  It is always formatted empty.
+ */
+
+#include "csapp.h"
+#include "store.h"
+
+#define ALIGN(x, a) (((x) + (a) - 1) / (a) * (a))
+
+/* store_lock - take the shared lock, recovering it if its holder died */
+static void store_lock(store_t *s)
+{
+	if (pthread_mutex_lock(&s->hdr->lock) == EOWNERDEAD)
+		pthread_mutex_consistent(&s->hdr->lock);
+}
+
+static void store_unlock(store_t *s)
+{
+	pthread_mutex_unlock(&s->hdr->lock);
+}
+
+/* init_lock - (re)create the shared mutex, a previous run may have died holding it */
+static void init_lock(store_t *s)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&s->hdr->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+/* meta_bytes - bytes of header, page table and bitmaps for npages pages */
+static size_t meta_bytes(size_t npages)
+{
+	return sizeof(struct storeHeader) + npages * sizeof(struct storePage) +
+		npages * STORE_PAGE_WORDS * sizeof(uint64_t);
+}
+
+/* page_unlink - take page p off whichever list starts at *head */
+static void page_unlink(store_t *s, int32_t *head, int32_t p)
+{
+	struct storePage *pg = &s->pages[p];
+
+	if (pg->prev >= 0)
+		s->pages[pg->prev].next = pg->next;
+	else
+		*head = pg->next;
+	if (pg->next >= 0)
+		s->pages[pg->next].prev = pg->prev;
+	pg->next = pg->prev = -1;
+}
+
+/* page_push - put page p at the front of the list starting at *head */
+static void page_push(store_t *s, int32_t *head, int32_t p)
+{
+	struct storePage *pg = &s->pages[p];
+
+	pg->prev = -1;
+	pg->next = *head;
+	if (*head >= 0)
+		s->pages[*head].prev = p;
+	*head = p;
+}
+
+/* store_reset - format an empty store over the mapped file */
+static void store_reset(store_t *s, size_t slabPages, uint64_t slabStart)
+{
+	struct storeHeader *h = s->hdr;
+	struct timeval now;
+	uint32_t size;
+	size_t i;
+
+	memset(s->base, 0, slabStart);
+	gettimeofday(&now, NULL);
+	h->storeId = ((uint64_t)now.tv_sec << 32) ^ ((uint64_t)now.tv_usec << 12) ^ getpid();
+	h->magic = STORE_MAGIC;
+	h->version = STORE_VERSION;
+	h->fileBytes = s->size;
+	h->slabStart = slabStart;
+	h->slabPages = slabPages;
+	h->logStart = slabStart + slabPages * STORE_PAGE_SIZE;
+	h->logBytes = s->size - h->logStart;
+	h->nextSeq = 1;
+
+	for (size = STORE_MIN_CHUNK; h->nclasses < STORE_MAX_CLASSES - 1; ) {
+		h->classSize[h->nclasses++] = size;
+		if (size >= STORE_PAGE_SIZE)
+			break;
+		size = ALIGN(size + size / 4, STORE_MIN_CHUNK);
+		if (size > STORE_PAGE_SIZE)
+			size = STORE_PAGE_SIZE;
+	}
+	for (i = 0; i < STORE_MAX_CLASSES; i++)
+		h->partial[i] = -1;
+	h->freePages = -1;
+	for (i = slabPages; i-- > 0; ) {
+		s->pages[i].cls = -1;
+		page_push(s, &h->freePages, i);
+	}
+	init_lock(s);
+}
+
+/*
+ * store_recover - reuse a store left by a previous run.  Every slab page
+ * becomes free until claimed, and the log is walked from head to tail:
+ * it is cut short at the first damaged header, objects that were being
+ * written or freed die, and the rest wait for store_claim().
+ */
+static void store_recover(store_t *s)
+{
+	struct storeHeader *h = s->hdr;
+	struct storeObject *o;
+	uint64_t pos, remaining;
+	size_t i;
+
+	init_lock(s);
+	for (i = 0; i < STORE_MAX_CLASSES; i++)
+		h->partial[i] = -1;
+	h->freePages = -1;
+	for (i = h->slabPages; i-- > 0; ) {
+		s->pages[i].cls = -1;
+		s->pages[i].used = 0;
+		page_push(s, &h->freePages, i);
+	}
+	h->slabBytes = 0;
+	h->heldFirst = h->nheld = 0;  //held chunks were freed with the slabs
+
+	if (h->logHead >= h->logBytes || h->logTail > h->logBytes || h->logUsed > h->logBytes ||
+	    (h->logWrapped && h->logWrapEnd > h->logBytes)) {
+		h->logUsed = 0;  //bookkeeping is damaged, start with an empty log
+	}
+	pos = h->logHead;
+	remaining = h->logUsed;
+	while (remaining > 0) {
+		if (h->logWrapped && pos >= h->logWrapEnd)
+			pos = 0;
+		o = store_object(s, h->logStart + pos);
+		if (o->magic != STORE_OBJ_MAGIC || o->allocLen < sizeof(*o) ||
+		    o->allocLen % STORE_MIN_CHUNK != 0 || o->allocLen > remaining ||
+		    pos + o->allocLen > h->logBytes) {
+			//keep what came before the damage
+			if (h->logWrapped && pos >= h->logHead)
+				h->logWrapped = 0;
+			h->logTail = pos;
+			h->logUsed -= remaining;
+			break;
+		}
+		o->refs = 0;
+		o->heldUntil = 0;
+		o->flags = (o->flags & (STORE_FILLING | STORE_DOOMED | STORE_DEAD)) ? STORE_DEAD : STORE_RECOVER;
+		pos += o->allocLen;
+		remaining -= o->allocLen;
+	}
+}
+
+/*
+ * store_open - create the store file, preallocate and map it.  logBytes
+ * of the file are kept for the append log.  With hugepages set the slab
+ * region is advised to use transparent huge pages, which takes effect
+ * when the file is on tmpfs.  Returns 1 if an existing store was
+ * reopened and its objects must be claimed, 0 if an empty store was
+ * formatted, or -1 with a message on stderr if it cannot be set up.
+ */
+int store_open(store_t *s, const char *filename, size_t bytes, size_t logBytes, int hugepages)
+{
+	size_t slabPages;
+	uint64_t slabStart = 0;
+	struct stat st;
+	int rc, warm;
+
+	memset(s, 0, sizeof(*s));
+	if (logBytes >= bytes) {
+		fprintf(stderr, "store: log does not leave room for slabs\n");
+		return -1;
+	}
+	for (slabPages = (bytes - logBytes) / STORE_PAGE_SIZE; slabPages > 0; slabPages--) {
+		slabStart = ALIGN(meta_bytes(slabPages), STORE_PAGE_SIZE);
+		if (slabStart + slabPages * STORE_PAGE_SIZE <= bytes - logBytes)
+			break;
+	}
+	if (slabPages == 0) {
+		fprintf(stderr, "store: %lu bytes is too small\n", (unsigned long)bytes);
+		return -1;
+	}
+
+	if (filename == NULL) {  //memory only, shared with children forked later
+		s->fd = -1;
+		warm = 0;
+		s->base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (s->base == MAP_FAILED) {
+			fprintf(stderr, "store: mmap: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	else {
+		if ((s->fd = open(filename, O_RDWR | O_CREAT, 0644)) < 0) {
+			fprintf(stderr, "store: %s: %s\n", filename, strerror(errno));
+			return -1;
+		}
+		warm = fstat(s->fd, &st) == 0 && st.st_size == (off_t)bytes;
+		if (ftruncate(s->fd, bytes) < 0) {
+			fprintf(stderr, "store: %s: %s\n", filename, strerror(errno));
+			close(s->fd);
+			return -1;
+		}
+		//reserve the blocks now so a full disk shows up at startup, not mid-fill
+		if ((rc = posix_fallocate(s->fd, 0, bytes)) != 0 && rc != EOPNOTSUPP && rc != EINVAL) {
+			fprintf(stderr, "store: %s: %s\n", filename, strerror(rc));
+			close(s->fd);
+			return -1;
+		}
+		s->base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+		if (s->base == MAP_FAILED) {
+			fprintf(stderr, "store: mmap %s: %s\n", filename, strerror(errno));
+			close(s->fd);
+			return -1;
+		}
+	}
+	s->size = bytes;
+	s->hdr = (struct storeHeader *)s->base;
+	s->pages = (struct storePage *)(s->base + sizeof(struct storeHeader));
+	s->bitmaps = (uint64_t *)(s->pages + slabPages);
+	if (hugepages)
+		madvise(s->base + slabStart, slabPages * STORE_PAGE_SIZE, MADV_HUGEPAGE);
+
+	warm = warm && s->hdr->magic == STORE_MAGIC && s->hdr->version == STORE_VERSION &&
+		s->hdr->fileBytes == bytes && s->hdr->slabStart == slabStart &&
+		s->hdr->slabPages == slabPages && s->hdr->logStart == slabStart + slabPages * STORE_PAGE_SIZE;
+	if (warm)
+		store_recover(s);
+	else
+		store_reset(s, slabPages, slabStart);
+	return warm;
+}
+
+/* store_close - unmap the store, objects stay in the file */
+void store_close(store_t *s)
+{
+	if (s->base != NULL) {
+		munmap(s->base, s->size);
+		if (s->fd >= 0)
+			close(s->fd);
+	}
+	memset(s, 0, sizeof(*s));
+}
+
+/* store_object - header of the object at offset */
+struct storeObject *store_object(store_t *s, uint64_t offset)
+{
+	return (struct storeObject *)(s->base + offset);
+}
+
+/*
+ * store_checksum - fast 64-bit hash of a payload, eight bytes per step.
+ * Used to spot objects damaged on disk, not as a cryptographic hash.
+ */
+uint64_t store_checksum(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+	uint64_t w;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&w, p, 8);
+		h ^= w;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	for (w = 0; len > 0; len--)
+		w = (w << 8) | p[len - 1];
+	h ^= w;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 29;
+	return h;
+}
+
+/* store_verify - 0 if the payload at offset still matches its checksum */
+int store_verify(store_t *s, uint64_t offset)
+{
+	struct storeObject *o = store_object(s, offset);
+
+	return store_checksum((char *)(o + 1), o->length) == o->checksum ? 0 : -1;
+}
+
+/* slab_alloc - hand out a chunk of class cls, returns its offset or 0 */
+static uint64_t slab_alloc(store_t *s, int cls)
+{
+	struct storeHeader *h = s->hdr;
+	struct storePage *pg;
+	uint64_t *bits;
+	int32_t p;
+	uint32_t w, bit;
+
+	if ((p = h->partial[cls]) < 0) {
+		if ((p = h->freePages) < 0)
+			return 0;
+		page_unlink(s, &h->freePages, p);
+		pg = &s->pages[p];
+		pg->cls = cls;
+		pg->used = 0;
+		pg->nchunks = STORE_PAGE_SIZE / h->classSize[cls];
+		memset(s->bitmaps + (size_t)p * STORE_PAGE_WORDS, 0, STORE_PAGE_WORDS * sizeof(uint64_t));
+		page_push(s, &h->partial[cls], p);
+	}
+	pg = &s->pages[p];
+	bits = s->bitmaps + (size_t)p * STORE_PAGE_WORDS;
+	for (w = 0; bits[w] == ~0ULL; w++)
+		;
+	bit = w * 64 + __builtin_ctzll(~bits[w]);
+	bits[w] |= 1ULL << (bit % 64);
+	if (++pg->used == pg->nchunks)
+		page_unlink(s, &h->partial[cls], p);
+	h->slabBytes += h->classSize[cls];
+	return h->slabStart + (uint64_t)p * STORE_PAGE_SIZE + (uint64_t)bit * h->classSize[cls];
+}
+
+/* slab_free - return the chunk at offset to its page */
+static void slab_free(store_t *s, uint64_t offset)
+{
+	struct storeHeader *h = s->hdr;
+	int32_t p = (offset - h->slabStart) / STORE_PAGE_SIZE;
+	struct storePage *pg = &s->pages[p];
+	uint32_t bit = (offset - h->slabStart - (uint64_t)p * STORE_PAGE_SIZE) / h->classSize[pg->cls];
+	uint64_t *bits = s->bitmaps + (size_t)p * STORE_PAGE_WORDS;
+
+	bits[bit / 64] &= ~(1ULL << (bit % 64));
+	h->slabBytes -= h->classSize[pg->cls];
+	if (pg->used-- == pg->nchunks)
+		page_push(s, &h->partial[pg->cls], p);
+	if (pg->used == 0) {  //reclaim the whole page for any class
+		page_unlink(s, &h->partial[pg->cls], p);
+		pg->cls = -1;
+		page_push(s, &h->freePages, p);
+	}
+}
+
+/* held_free - free the held slab chunk at the front of the held list */
+static void held_free(store_t *s)
+{
+	struct storeHeader *h = s->hdr;
+
+	store_object(s, h->held[h->heldFirst])->magic = 0;
+	slab_free(s, h->held[h->heldFirst]);
+	h->heldFirst = (h->heldFirst + 1) % STORE_HELD;
+	h->nheld--;
+}
+
+/* held_sweep - free the held slab chunks whose hold has run out */
+static void held_sweep(store_t *s)
+{
+	struct storeHeader *h = s->hdr;
+	uint64_t now = time(NULL);
+
+	while (h->nheld > 0 && store_object(s, h->held[h->heldFirst])->heldUntil <= now)
+		held_free(s);
+}
+
+/* log_reclaim - free the object at the log head, -1 if it is still in use */
+static int log_reclaim(store_t *s, store_dropped_t *dropped, void *arg)
+{
+	struct storeHeader *h = s->hdr;
+	struct storeObject *o = store_object(s, h->logStart + h->logHead);
+
+	if (o->refs > 0 || o->heldUntil > (uint64_t)time(NULL))
+		return -1;
+	if (!(o->flags & (STORE_DOOMED | STORE_DEAD)) && dropped)
+		dropped(o, arg);
+	o->magic = 0;
+	h->logHead += o->allocLen;
+	h->logUsed -= o->allocLen;
+	if (h->logWrapped && h->logHead >= h->logWrapEnd) {
+		h->logHead = 0;
+		h->logWrapped = 0;
+	}
+	return 0;
+}
+
+/* log_alloc - append need bytes to the log, returns the offset or 0 */
+static uint64_t log_alloc(store_t *s, uint64_t need, store_dropped_t *dropped, void *arg)
+{
+	struct storeHeader *h = s->hdr;
+	uint64_t off;
+
+	if (need > h->logBytes)
+		return 0;
+	for (;;) {
+		if (h->logUsed == 0) {
+			h->logHead = h->logTail = 0;
+			h->logWrapped = 0;
+		}
+		if (!h->logWrapped) {
+			if (h->logTail + need <= h->logBytes)
+				break;
+			h->logWrapped = 1;  //the rest of the log is skipped once head gets there
+			h->logWrapEnd = h->logTail;
+			h->logTail = 0;
+			continue;
+		}
+		if (h->logTail + need <= h->logHead)
+			break;
+		if (log_reclaim(s, dropped, arg) < 0)
+			return 0;
+	}
+	off = h->logStart + h->logTail;
+	h->logTail += need;
+	h->logUsed += need;
+	return off;
+}
+
+/*
+ * store_alloc - reserve room for a length byte object owned by slot.
+ * The object starts out pinned for its writer; call store_seal() once
+ * the payload is written.  Live log objects overwritten on the way are
+ * passed to dropped.  Returns -1 if the store has no room.
+ */
+int store_alloc(store_t *s, size_t length, int slot, uint64_t keyhash,
+		store_dropped_t *dropped, void *arg, uint64_t *offset, uint64_t *seq)
+{
+	struct storeHeader *h = s->hdr;
+	struct storeObject *o;
+	uint64_t need = sizeof(struct storeObject) + length;
+	uint64_t off = 0, allocLen = 0;
+	uint32_t cls;
+
+	store_lock(s);
+	held_sweep(s);
+	if (need <= STORE_PAGE_SIZE) {
+		for (cls = 0; h->classSize[cls] < need; cls++)
+			;
+		if ((off = slab_alloc(s, cls)) != 0)
+			allocLen = h->classSize[cls];
+	}
+	if (off == 0) {  //too large for a slab, or the slabs are full
+		allocLen = ALIGN(need, STORE_MIN_CHUNK);
+		off = log_alloc(s, allocLen, dropped, arg);
+	}
+	if (off == 0) {
+		store_unlock(s);
+		return -1;
+	}
+
+	o = store_object(s, off);
+	o->magic = STORE_OBJ_MAGIC;
+	o->flags = STORE_FILLING;
+	o->seq = h->nextSeq++;
+	o->keyhash = keyhash;
+	o->length = length;
+	o->allocLen = allocLen;
+	o->refs = 1;
+	o->slot = slot;
+	o->heldUntil = 0;
+	*offset = off;
+	*seq = o->seq;
+	store_unlock(s);
+	return 0;
+}
+
+/*
+ * free_locked - give an unreferenced object's space back.  A slab chunk
+ * still held goes on the held list instead; if the list is full the
+ * chunk held longest is freed early to make room.
+ */
+static void free_locked(store_t *s, uint64_t offset)
+{
+	struct storeHeader *h = s->hdr;
+	struct storeObject *o = store_object(s, offset);
+
+	if (offset >= h->logStart) {
+		o->flags |= STORE_DEAD;  //the log reclaims it when its head gets here
+	}
+	else if (o->heldUntil > (uint64_t)time(NULL)) {
+		o->flags |= STORE_DOOMED;  //no longer found by store_ref or store_release
+		if (h->nheld == STORE_HELD)
+			held_free(s);
+		h->held[(h->heldFirst + h->nheld++) % STORE_HELD] = offset;
+	}
+	else {
+		o->magic = 0;
+		slab_free(s, offset);
+	}
+}
+
+/* unref_locked - drop one reference, freeing a doomed object on the last */
+static void unref_locked(store_t *s, uint64_t offset)
+{
+	struct storeObject *o = store_object(s, offset);
+
+	if (--o->refs == 0 && (o->flags & STORE_DOOMED))
+		free_locked(s, offset);
+}
+
+/* store_seal - mark the object at offset complete and drop the writer's pin */
+void store_seal(store_t *s, uint64_t offset)
+{
+	store_lock(s);
+	store_object(s, offset)->flags &= ~STORE_FILLING;
+	unref_locked(s, offset);
+	store_unlock(s);
+}
+
+/*
+ * store_ref - pin the object at offset for reading if it is still the
+ * complete object with sequence number seq.  Returns its payload length,
+ * or -1 if the space has been released or reused.
+ */
+int store_ref(store_t *s, uint64_t offset, uint64_t seq)
+{
+	struct storeObject *o = store_object(s, offset);
+	int rc = -1;
+
+	store_lock(s);
+	if (o->magic == STORE_OBJ_MAGIC && o->seq == seq &&
+	    !(o->flags & (STORE_FILLING | STORE_DOOMED | STORE_DEAD))) {
+		o->refs++;
+		rc = o->length;
+	}
+	store_unlock(s);
+	return rc;
+}
+
+/* store_unref - drop a pin taken with store_ref */
+void store_unref(store_t *s, uint64_t offset)
+{
+	store_lock(s);
+	unref_locked(s, offset);
+	store_unlock(s);
+}
+
+/*
+ * store_hold - keep the space of the object at offset from being reused
+ * for seconds from now, even once it is freed.  For a reader whose sends
+ * still refer to the object after it unpins it; call before unpinning.
+ */
+void store_hold(store_t *s, uint64_t offset, int seconds)
+{
+	struct storeObject *o = store_object(s, offset);
+	uint64_t until = time(NULL) + seconds;
+
+	store_lock(s);
+	if (o->heldUntil < until)
+		o->heldUntil = until;
+	store_unlock(s);
+}
+
+/*
+ * store_release - the cache no longer wants object seq at offset.  Its
+ * space is freed now, or by the last reader if it is still pinned.
+ */
+void store_release(store_t *s, uint64_t offset, uint64_t seq)
+{
+	struct storeObject *o = store_object(s, offset);
+
+	store_lock(s);
+	if (o->magic == STORE_OBJ_MAGIC && o->seq == seq &&
+	    !(o->flags & (STORE_DOOMED | STORE_DEAD))) {
+		if (o->refs > 0)
+			o->flags |= STORE_DOOMED;
+		else
+			free_locked(s, offset);
+	}
+	store_unlock(s);
+}
+
+/* store_fill_begin - start staging a payload of at most max bytes */
+void store_fill_begin(store_fill_t *f, size_t max)
+{
+	memset(f, 0, sizeof(*f));
+	f->max = max;
+}
+
+/* store_fill_append - add n bytes to a staged payload */
+void store_fill_append(store_fill_t *f, const void *data, size_t n)
+{
+	size_t cap;
+	char *buf;
+
+	if (f->failed)
+		return;
+	if (f->len + n > f->max) {
+		store_fill_abort(f);
+		f->failed = 1;
+		return;
+	}
+	if (f->len + n > f->cap) {
+		for (cap = f->cap ? f->cap : 16384; cap < f->len + n; cap *= 2)
+			;
+		if ((buf = realloc(f->buf, cap)) == NULL) {
+			store_fill_abort(f);
+			f->failed = 1;
+			return;
+		}
+		f->buf = buf;
+		f->cap = cap;
+	}
+	memcpy(f->buf + f->len, data, n);
+	f->len += n;
+}
+
+/*
+ * store_fill_reserve - size a staged payload's buffer for n bytes in one
+ * allocation, when its length is known before it arrives.  Returns -1,
+ * failing the payload, if n is over its limit or cannot be allocated.
+ */
+int store_fill_reserve(store_fill_t *f, size_t n)
+{
+	char *buf;
+
+	if (f->failed)
+		return -1;
+	if (n <= f->cap)
+		return 0;
+	if (n > f->max || (buf = realloc(f->buf, n)) == NULL) {
+		store_fill_abort(f);
+		f->failed = 1;
+		return -1;
+	}
+	f->buf = buf;
+	f->cap = n;
+	return 0;
+}
+
+/*
+ * store_fill_commit - copy a staged payload into the store and seal it.
+ * Returns -1 if the payload was abandoned or the store had no room; the
+ * payload is kept in that case so it can be offered to another store.
+ */
+int store_fill_commit(store_t *s, store_fill_t *f, int slot, uint64_t keyhash,
+		      store_dropped_t *dropped, void *arg, uint64_t *offset, uint64_t *seq)
+{
+	if (f->failed || store_alloc(s, f->len, slot, keyhash, dropped, arg, offset, seq) < 0)
+		return -1;
+	memcpy(s->base + *offset + sizeof(struct storeObject), f->buf, f->len);
+	store_object(s, *offset)->checksum = store_checksum(f->buf, f->len);
+	store_seal(s, *offset);
+	store_fill_abort(f);
+	return 0;
+}
+
+/*
+ * store_copy - copy the object seq at offset in from into to, for slot.
+ * Returns -1 if the object is gone or to has no room.
+ */
+int store_copy(store_t *from, uint64_t offset, uint64_t seq, store_t *to, int slot,
+	       store_dropped_t *dropped, void *arg, uint64_t *newOffset, uint64_t *newSeq)
+{
+	struct storeObject *o = store_object(from, offset);
+	int length;
+
+	if ((length = store_ref(from, offset, seq)) < 0)
+		return -1;
+	if (store_alloc(to, length, slot, o->keyhash, dropped, arg, newOffset, newSeq) < 0) {
+		store_unref(from, offset);
+		return -1;
+	}
+	memcpy(to->base + *newOffset + sizeof(struct storeObject), o + 1, length);
+	store_object(to, *newOffset)->checksum = o->checksum;
+	store_seal(to, *newOffset);
+	store_unref(from, offset);
+	return 0;
+}
+
+/* store_fill_abort - discard a staged payload */
+void store_fill_abort(store_fill_t *f)
+{
+	free(f->buf);
+	f->buf = NULL;
+	f->len = f->cap = 0;
+}
+
+/*
+ * store_claim - during recovery, keep the object seq at offset for slot.
+ * Returns its payload length, or -1 if the header shows the object was
+ * freed, overwritten or damaged.  The payload itself is checked later
+ * with store_verify() so startup does not have to read every object.
+ */
+int store_claim(store_t *s, uint64_t offset, uint64_t seq, uint64_t keyhash, int slot)
+{
+	struct storeHeader *h = s->hdr;
+	struct storeObject *o;
+	struct storePage *pg;
+	uint64_t *bits, rel;
+	uint32_t cls, bit;
+	int32_t p;
+
+	if (offset < h->slabStart || offset + sizeof(*o) > h->logStart + h->logBytes)
+		return -1;
+	o = store_object(s, offset);
+	if (o->magic != STORE_OBJ_MAGIC || o->seq != seq || o->keyhash != keyhash ||
+	    sizeof(*o) + (uint64_t)o->length > o->allocLen)
+		return -1;
+
+	if (offset >= h->logStart) {
+		if (o->flags != STORE_RECOVER)  //outside the live log, or claimed twice
+			return -1;
+	}
+	else {
+		if (o->flags & (STORE_FILLING | STORE_DOOMED))
+			return -1;
+		for (cls = 0; cls < h->nclasses && h->classSize[cls] != o->allocLen; cls++)
+			;
+		p = (offset - h->slabStart) / STORE_PAGE_SIZE;
+		rel = offset - h->slabStart - (uint64_t)p * STORE_PAGE_SIZE;
+		pg = &s->pages[p];
+		if (cls == h->nclasses || rel % o->allocLen != 0 || (pg->cls >= 0 && pg->cls != (int32_t)cls))
+			return -1;
+		bits = s->bitmaps + (size_t)p * STORE_PAGE_WORDS;
+		if (pg->cls < 0) {  //first object seen in this page
+			page_unlink(s, &h->freePages, p);
+			pg->cls = cls;
+			pg->used = 0;
+			pg->nchunks = STORE_PAGE_SIZE / o->allocLen;
+			memset(bits, 0, STORE_PAGE_WORDS * sizeof(uint64_t));
+		}
+		bit = rel / o->allocLen;
+		if (bits[bit / 64] & (1ULL << (bit % 64)))
+			return -1;
+		bits[bit / 64] |= 1ULL << (bit % 64);
+		pg->used++;
+		h->slabBytes += o->allocLen;
+	}
+	o->flags = 0;
+	o->refs = 0;
+	o->heldUntil = 0;  //no send from the last run is left
+	o->slot = slot;
+	return o->length;
+}
+
+/* store_recover_end - free everything recovery did not claim */
+void store_recover_end(store_t *s)
+{
+	struct storeHeader *h = s->hdr;
+	struct storeObject *o;
+	uint64_t pos = h->logHead, remaining = h->logUsed;
+	size_t p;
+
+	for (p = 0; p < h->slabPages; p++) {
+		if (s->pages[p].cls >= 0 && s->pages[p].used < s->pages[p].nchunks)
+			page_push(s, &h->partial[s->pages[p].cls], p);
+	}
+	while (remaining > 0) {
+		if (h->logWrapped && pos >= h->logWrapEnd)
+			pos = 0;
+		o = store_object(s, h->logStart + pos);
+		if (o->flags == STORE_RECOVER)
+			o->flags = STORE_DEAD;
+		pos += o->allocLen;
+		remaining -= o->allocLen;
+	}
+}
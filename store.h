@@ -0,0 +1,128 @@
+/*
+ * store.h - single-file slab storage engine for cached objects
+ *
+ * All cached objects live in one preallocated file that every proxy
+ * process maps shared.  Objects up to one slab page are kept in
+ * size-class slabs; anything larger goes to a circular append log.
+ * Each object starts with a struct storeObject header; the payload
+ * follows it directly, so a hit is a copy from a known offset.
+ */
+#ifndef __STORE_H__
+#define __STORE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define STORE_MAGIC        0x45524f5453595850ULL  /* "PXYSTORE" */
+#define STORE_VERSION      3
+#define STORE_OBJ_MAGIC    0x4a424f50             /* "POBJ" */
+#define STORE_PAGE_SIZE    (1 << 20)              /* bytes per slab page */
+#define STORE_MIN_CHUNK    64                     /* smallest size class */
+#define STORE_MAX_CLASSES  48
+#define STORE_PAGE_WORDS   (STORE_PAGE_SIZE / STORE_MIN_CHUNK / 64)
+#define STORE_HELD         4096                   /* freed slab chunks whose reuse waits */
+
+/* storeObject flags */
+#define STORE_FILLING  0x1   /* writer still copying the payload */
+#define STORE_DOOMED   0x2   /* released while referenced, free on last unref */
+#define STORE_DEAD     0x4   /* log object released, space reclaimed by the log */
+#define STORE_RECOVER  0x8   /* log object found at startup, not yet claimed */
+
+/* Header in front of every stored object */
+struct storeObject {
+	uint32_t magic;       //STORE_OBJ_MAGIC
+	uint32_t flags;       //STORE_FILLING, STORE_DOOMED, STORE_DEAD
+	uint64_t seq;         //unique per allocation, tells reused space apart
+	uint64_t keyhash;     //cache_hash of the owning key
+	uint32_t length;      //payload bytes
+	uint32_t allocLen;    //bytes reserved for header and payload
+	int32_t refs;         //writers and readers in flight
+	int32_t slot;         //cache index slot that owns the object
+	uint64_t checksum;    //store_checksum of the payload
+	uint64_t heldUntil;   //time before which the space is not reused, see store_hold
+};
+
+/* Per slab page bookkeeping */
+struct storePage {
+	int32_t cls;          //size class, -1 while on the free page list
+	uint32_t used;        //chunks handed out
+	uint32_t nchunks;     //chunks that fit in the page
+	int32_t next, prev;   //free page list or the class's partial page list
+};
+
+/* Shared state at the start of the store file */
+struct storeHeader {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t nclasses;
+	uint64_t fileBytes;           //size of the whole store file
+	uint64_t slabStart;           //offset of the first slab page
+	uint64_t slabPages;           //number of slab pages
+	uint64_t logStart;            //offset of the append log
+	uint64_t logBytes;            //size of the append log
+	uint64_t nextSeq;             //next storeObject.seq
+	uint64_t storeId;             //random, set when the file is formatted
+	pthread_mutex_t lock;         //process shared, guards everything below
+	int32_t freePages;            //head of the free page list
+	int32_t partial[STORE_MAX_CLASSES];  //pages of each class with free chunks
+	uint32_t classSize[STORE_MAX_CLASSES];
+	uint64_t logHead;             //oldest log object, relative to logStart
+	uint64_t logTail;             //next log allocation, relative to logStart
+	uint64_t logUsed;             //bytes between head and tail
+	uint64_t logWrapEnd;          //end of the data behind head while wrapped
+	int32_t logWrapped;           //tail has wrapped around behind head
+	uint64_t slabBytes;           //bytes of slab chunks handed out
+	int32_t heldFirst;            //oldest entry of held
+	int32_t nheld;                //freed slab chunks waiting out their hold
+	uint64_t held[STORE_HELD];    //their offsets, in the order they were freed
+};
+
+/* One process's view of the shared store */
+typedef struct {
+	int fd;                       //-1 for a memory only store
+	char *base;                   //whole file mapped MAP_SHARED
+	size_t size;
+	struct storeHeader *hdr;
+	struct storePage *pages;
+	uint64_t *bitmaps;            //STORE_PAGE_WORDS words per slab page
+} store_t;
+
+/* Payload of an object being fetched, staged until its size is known */
+typedef struct {
+	char *buf;
+	size_t len, cap, max;
+	int failed;                   //too large or out of memory, do not commit
+} store_fill_t;
+
+/* Called for each live log object overwritten to make room */
+typedef void store_dropped_t(struct storeObject *o, void *arg);
+
+int store_open(store_t *s, const char *filename, size_t bytes, size_t logBytes, int hugepages);
+void store_close(store_t *s);
+struct storeObject *store_object(store_t *s, uint64_t offset);
+uint64_t store_checksum(const void *data, size_t len);
+int store_verify(store_t *s, uint64_t offset);
+
+int store_claim(store_t *s, uint64_t offset, uint64_t seq, uint64_t keyhash, int slot);
+void store_recover_end(store_t *s);
+
+int store_alloc(store_t *s, size_t length, int slot, uint64_t keyhash,
+		store_dropped_t *dropped, void *arg, uint64_t *offset, uint64_t *seq);
+void store_seal(store_t *s, uint64_t offset);
+int store_ref(store_t *s, uint64_t offset, uint64_t seq);
+void store_unref(store_t *s, uint64_t offset);
+void store_hold(store_t *s, uint64_t offset, int seconds);
+void store_release(store_t *s, uint64_t offset, uint64_t seq);
+
+void store_fill_begin(store_fill_t *f, size_t max);
+void store_fill_append(store_fill_t *f, const void *data, size_t n);
+int store_fill_reserve(store_fill_t *f, size_t n);
+int store_fill_commit(store_t *s, store_fill_t *f, int slot, uint64_t keyhash,
+		      store_dropped_t *dropped, void *arg, uint64_t *offset, uint64_t *seq);
+void store_fill_abort(store_fill_t *f);
+
+int store_copy(store_t *from, uint64_t offset, uint64_t seq, store_t *to, int slot,
+	       store_dropped_t *dropped, void *arg, uint64_t *newOffset, uint64_t *newSeq);
+
+#endif /* __STORE_H__ */
@@ -0,0 +1,236 @@
+/*
+ * upstream.c - connecting to origin servers
+ *
+ * Addresses are tried healthy ones first, fastest measured connect time
+ * first, then addresses never connected to, in resolver order with the
+ * families interleaved, and last the ones that failed recently.  Each
+ * attempt is a non-blocking connect; a new one starts whenever the last
+ * one has had delayMs without an answer or as soon as one fails, and any
+ * attempt pending for timeoutMs is given up.  The first to connect wins
+ * and the others are closed without counting against their address.
+ */
+
+#include "csapp.h"
+#include "upstream.h"
+#include <poll.h>
+
+#define UNTRIED_RANK    (1ULL << 32)
+#define PENALIZED_RANK  (2ULL << 32)
+#define MAX_BACKOFF     300   /* seconds a failing address can be passed over */
+
+/* now_us - monotonic time in microseconds */
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/*
+ * upstream_resolve - look up every address of hostname into u, dropping
+ * any history u had.  The resolver's order is kept within each family but
+ * the families alternate, so a broken IPv6 (or IPv4) path costs one
+ * attempt delay rather than one per address.  Returns 0, or the
+ * getaddrinfo error.
+ */
+int upstream_resolve(upstream_t *u, const char *hostname)
+{
+	struct addrinfo hints, *res, *ai;
+	struct sockaddr_storage found[UPSTREAM_MAX_ADDRS];
+	socklen_t lens[UPSTREAM_MAX_ADDRS];
+	int used[UPSTREAM_MAX_ADDRS];
+	int rc, n = 0, i, family;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_ADDRCONFIG;
+	if ((rc = getaddrinfo(hostname, NULL, &hints, &res)) != 0)
+		return rc;
+	for (ai = res; ai != NULL && n < UPSTREAM_MAX_ADDRS; ai = ai->ai_next) {
+		if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6)
+			continue;
+		for (i = 0; i < n; i++)
+			if (lens[i] == ai->ai_addrlen && memcmp(&found[i], ai->ai_addr, lens[i]) == 0)
+				break;
+		if (i < n)
+			continue;
+		memcpy(&found[n], ai->ai_addr, ai->ai_addrlen);
+		lens[n] = ai->ai_addrlen;
+		used[n++] = 0;
+	}
+	freeaddrinfo(res);
+	if (n == 0)
+		return EAI_NONAME;
+
+	memset(u, 0, sizeof(*u));
+	family = found[0].ss_family;
+	while (u->naddrs < n) {
+		//take the next unused address of family, or of any family if it has none left
+		for (i = 0; i < n && (used[i] || found[i].ss_family != family); i++)
+			;
+		if (i == n)
+			for (i = 0; used[i]; i++)
+				;
+		used[i] = 1;
+		memcpy(&u->addrs[u->naddrs].addr, &found[i], lens[i]);
+		u->addrs[u->naddrs++].addrlen = lens[i];
+		family = found[i].ss_family == AF_INET ? AF_INET6 : AF_INET;
+	}
+	return 0;
+}
+
+/* rank - where a goes in the order addresses are tried, lowest first */
+static unsigned long long rank(struct upstreamAddr *a, time_t now)
+{
+	if (a->retryAt > now)
+		return PENALIZED_RANK + (a->retryAt - now);
+	return a->srttUs ? a->srttUs : UNTRIED_RANK;
+}
+
+/* failed - count a failed attempt, passing a over for longer each time */
+static void failed(struct upstreamAddr *a)
+{
+	int shift = a->failures < 8 ? a->failures : 8;
+	time_t backoff = (time_t)1 << shift;
+
+	a->failures++;
+	a->retryAt = time(NULL) + (backoff < MAX_BACKOFF ? backoff : MAX_BACKOFF);
+}
+
+/* connected - fold a successful connect time into a's history */
+static void connected(struct upstreamAddr *a, long long us)
+{
+	if (us < 1)
+		us = 1;
+	a->srttUs = a->srttUs ? (7ULL * a->srttUs + us) / 8 : us;
+	a->failures = 0;
+	a->retryAt = 0;
+}
+
+/*
+ * start_attempt - begin a non-blocking connect to a on a socket with
+ * opts applied.  Returns the socket, with *done set if it connected at
+ * once, or -1 with *err set.
+ */
+static int start_attempt(struct upstreamAddr *a, int port, const struct sockOpts *opts, int *done, int *err)
+{
+	struct sockaddr_storage addr = a->addr;
+	int fd;
+
+	if (addr.ss_family == AF_INET)
+		((struct sockaddr_in *)&addr)->sin_port = htons(port);
+	else
+		((struct sockaddr_in6 *)&addr)->sin6_port = htons(port);
+	if ((fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {
+		*err = errno;
+		return -1;
+	}
+	sockopt_apply(fd, opts, SOCK_UPSTREAM);  //whatever the kernel lacks is left at its default
+	*done = connect(fd, (SA *)&addr, a->addrlen) == 0;
+	if (!*done && errno != EINPROGRESS) {
+		*err = errno;
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * upstream_connect - connect to one of u's addresses on port, racing
+ * staggered attempts as described above and updating each address's
+ * history.  Every attempt's socket gets opts.  Returns a blocking socket,
+ * or -1 with errno set from the last attempt that failed.
+ */
+int upstream_connect(upstream_t *u, int port, int delayMs, int timeoutMs, const struct sockOpts *opts)
+{
+	struct pollfd pfds[UPSTREAM_MAX_ADDRS];
+	int which[UPSTREAM_MAX_ADDRS], order[UPSTREAM_MAX_ADDRS];
+	long long started[UPSTREAM_MAX_ADDRS];
+	long long t, wait, lastStart = 0, delay = delayMs * 1000LL, timeout = timeoutMs * 1000LL;
+	int n = u->naddrs, next = 0, nactive = 0, fd = -1, err = EHOSTUNREACH;
+	int i, j, s, done, soerr;
+	socklen_t len;
+	time_t now = time(NULL);
+
+	//insertion sort keeps the resolver's interleaving among equal ranks
+	for (i = 0; i < n; i++) {
+		for (j = i; j > 0 && rank(&u->addrs[order[j - 1]], now) > rank(&u->addrs[i], now); j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	while (fd < 0 && (next < n || nactive > 0)) {
+		t = now_us();
+		if (next < n && (nactive == 0 || t - lastStart >= delay)) {
+			i = order[next++];
+			lastStart = t;
+			if ((s = start_attempt(&u->addrs[i], port, opts, &done, &err)) < 0) {
+				failed(&u->addrs[i]);
+				lastStart = t - delay;  //no point waiting on a refusal
+			}
+			else if (done) {
+				connected(&u->addrs[i], now_us() - t);
+				fd = s;
+			}
+			else {
+				pfds[nactive].fd = s;
+				pfds[nactive].events = POLLOUT;
+				which[nactive] = i;
+				started[nactive++] = t;
+			}
+			continue;
+		}
+
+		//sleep until an attempt finishes, the oldest times out or the next is due
+		wait = started[0] + timeout - t;
+		if (next < n && lastStart + delay - t < wait)
+			wait = lastStart + delay - t;
+		if (poll(pfds, nactive, wait > 0 ? (int)((wait + 999) / 1000) : 0) < 0 && errno != EINTR) {
+			err = errno;
+			break;
+		}
+		t = now_us();
+		for (i = 0; i < nactive && fd < 0; ) {
+			if (pfds[i].revents) {
+				len = sizeof(soerr);
+				if (getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &soerr, &len) < 0)
+					soerr = errno;
+				if (soerr == 0) {
+					connected(&u->addrs[which[i]], t - started[i]);
+					fd = pfds[i].fd;
+				}
+				else {
+					err = soerr;
+					failed(&u->addrs[which[i]]);
+					close(pfds[i].fd);
+					lastStart = t - delay;
+				}
+			}
+			else if (t - started[i] >= timeout) {
+				err = ETIMEDOUT;
+				failed(&u->addrs[which[i]]);
+				close(pfds[i].fd);
+				lastStart = t - delay;
+			}
+			else {
+				i++;
+				continue;
+			}
+			nactive--;
+			memmove(&pfds[i], &pfds[i + 1], (nactive - i) * sizeof(pfds[0]));
+			memmove(&which[i], &which[i + 1], (nactive - i) * sizeof(which[0]));
+			memmove(&started[i], &started[i + 1], (nactive - i) * sizeof(started[0]));
+		}
+	}
+
+	for (i = 0; i < nactive; i++)  //lost the race, which says nothing against them
+		close(pfds[i].fd);
+	if (fd < 0) {
+		errno = err;
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+	return fd;
+}
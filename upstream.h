@@ -0,0 +1,42 @@
+/*
+ * upstream.h - connecting to origin servers
+ *
+ * A host's addresses are resolved once, IPv4 and IPv6 alike, and kept
+ * with the connect time and failure history of each one.  Connecting
+ * tries the addresses in order of preference, starting another attempt
+ * every few hundred milliseconds while earlier ones are still pending
+ * (Happy Eyeballs) and taking whichever completes first.
+ *
+ * Both block, resolving for as long as the resolver takes and connecting
+ * for up to the connect timeout, so the proxy only calls them in the
+ * child serving a request, never in the parent's event loop.  A child's
+ * changes to a host's history are sent back to the parent with the
+ * host's addresses, see reportHost in proxy.c.
+ */
+#ifndef __UPSTREAM_H__
+#define __UPSTREAM_H__
+
+#include <time.h>
+#include <sys/socket.h>
+#include "sockopt.h"
+
+#define UPSTREAM_MAX_ADDRS 16
+
+/* One resolved address and how connecting to it has gone */
+struct upstreamAddr {
+	struct sockaddr_storage addr;     //port left 0, set per connect
+	socklen_t addrlen;
+	unsigned srttUs;                  //smoothed connect time, 0 until one succeeds
+	unsigned failures;                //failed attempts since the last success
+	time_t retryAt;                   //tried after every healthy address until then
+};
+
+typedef struct {
+	int naddrs;
+	struct upstreamAddr addrs[UPSTREAM_MAX_ADDRS];
+} upstream_t;
+
+int upstream_resolve(upstream_t *u, const char *hostname);
+int upstream_connect(upstream_t *u, int port, int delayMs, int timeoutMs, const struct sockOpts *opts);
+
+#endif /* __UPSTREAM_H__ */
@@ -0,0 +1,146 @@
+/*
+ * vary.c - cache keys for responses that vary by request headers
+ */
+
+#include "csapp.h"
+#include "cache.h"
+#include "vary.h"
+
+#define VARY_TAG  " vary:"
+
+/* vary_init - an empty table */
+void vary_init(vary_t *v)
+{
+	v->entries = Calloc(VARY_ENTRIES, sizeof(vary_entry_t));
+}
+
+/* vary_lookup - the names the URL with key hash varies by, NULL if none are known */
+const char *vary_lookup(vary_t *v, uint64_t hash)
+{
+	vary_entry_t *e = &v->entries[hash % VARY_ENTRIES];
+
+	return hash != 0 && e->hash == hash ? e->names : NULL;
+}
+
+/* vary_learn - remember that the URL with key hash varies by names, or forget it if names is empty */
+void vary_learn(vary_t *v, uint64_t hash, const char *names)
+{
+	vary_entry_t *e = &v->entries[hash % VARY_ENTRIES];
+
+	if (names[0] == '\0' || strlen(names) >= VARY_NAMES) {
+		if (e->hash == hash)
+			e->hash = 0;
+		return;
+	}
+	e->hash = hash;  //a URL already here with the same slot is learnt again on its next fill
+	strcpy(e->names, names);
+}
+
+/*
+ * vary_names - the header names in the value of a Vary header, as
+ * lowercase names separated by commas, without Accept-Encoding, into
+ * names.  Returns -1 if the value is "*", which no request can match,
+ * or the names do not fit in size bytes.
+ */
+int vary_names(char *names, size_t size, const char *value)
+{
+	const char *p = value, *end;
+	size_t len = 0, n, i;
+
+	names[0] = '\0';
+	while (*p != '\0') {
+		while (*p == ' ' || *p == '\t' || *p == ',')
+			p++;
+		for (end = p; *end != '\0' && *end != ',' && *end != ' ' && *end != '\t'; end++)
+			;
+		if ((n = end - p) == 0)
+			break;
+		if (n == 1 && *p == '*')
+			return -1;
+		if (n != 15 || strncasecmp(p, "Accept-Encoding", 15) != 0) {
+			if (len + (len > 0) + n >= size)
+				return -1;
+			if (len > 0)
+				names[len++] = ',';
+			for (i = 0; i < n; i++)
+				names[len++] = tolower((unsigned char)p[i]);
+			names[len] = '\0';
+		}
+		p = end;
+	}
+	return 0;
+}
+
+/*
+ * vary_headers - copy the lines of request head for the headers in
+ * names, a vary_names list, into out as they are, every line of each in
+ * the order they come.  Returns the bytes copied, or -1 if they do not
+ * fit in size bytes.
+ */
+int vary_headers(char *out, size_t size, const char *head, const char *names)
+{
+	const char *name, *comma, *line, *eol;
+	size_t len = 0, nameLen, n;
+
+	out[0] = '\0';
+	for (name = names; *name != '\0'; name = *comma ? comma + 1 : comma) {
+		comma = strchr(name, ',');
+		if (comma == NULL)
+			comma = name + strlen(name);
+		nameLen = comma - name;
+		for (line = strchr(head, '\n'); line != NULL && line[1] != '\0'; line = strchr(line, '\n')) {
+			line++;
+			if (*line == '\r' || *line == '\n')  //blank line, end of the headers
+				break;
+			if (strncasecmp(line, name, nameLen) != 0 || line[nameLen] != ':')
+				continue;
+			eol = line + strcspn(line, "\r\n");
+			n = eol - line;
+			if (len + n + 2 >= size)
+				return -1;
+			memcpy(out + len, line, n);
+			memcpy(out + len + n, "\r\n", 2);
+			len += n + 2;
+			out[len] = '\0';
+		}
+	}
+	return len;
+}
+
+/*
+ * vary_key - append to the len byte key of a URL the part naming the
+ * variant a request with the n bytes of headers, from vary_headers for
+ * names, is sent.  Returns the new key length, or -1 if it does not fit
+ * in size bytes.
+ */
+int vary_key(char *key, size_t size, int len, const char *names, const char *headers, size_t n)
+{
+	int m = snprintf(key + len, size - len, VARY_TAG "%s=%016llx", names,
+			 (unsigned long long)cache_hash(headers, n));
+
+	if (m < 0 || (size_t)m >= size - len)
+		return -1;
+	return len + m;
+}
+
+/*
+ * vary_split - the length of the URL's key at the start of the len
+ * byte index key, with the names of the variant the key is for copied
+ * into names, empty if it is not a variant
+ */
+int vary_split(const char *key, size_t len, char *names, size_t size)
+{
+	const char *blank = memchr(key, ' ', len), *p, *end;
+
+	names[0] = '\0';
+	if (blank == NULL)
+		return len;
+	if ((size_t)(key + len - blank) > strlen(VARY_TAG) && strncmp(blank, VARY_TAG, strlen(VARY_TAG)) == 0) {
+		p = blank + strlen(VARY_TAG);
+		if ((end = memchr(p, '=', key + len - p)) != NULL && (size_t)(end - p) < size) {
+			memcpy(names, p, end - p);
+			names[end - p] = '\0';
+		}
+	}
+	return blank - key;  //URLs hold no blanks, what follows one names a variant
+}
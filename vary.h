@@ -0,0 +1,49 @@
+/*
+ * vary.h - cache keys for responses that vary by request headers
+ *
+ * An origin's Vary header names the request headers a response depends
+ * on, so one URL can have as many answers as those headers have values.
+ * Each answer is cached as a page of its own, keyed by the URL's key
+ * followed by " vary:", the names, '=' and a hash of the request's
+ * lines for them, which are also what is forwarded to the origin.  A
+ * variant is found with one index lookup and has its own fill time,
+ * hits and place in eviction, like any page.
+ *
+ * The names a URL varies by are learnt from its responses and kept in
+ * a direct mapped table by the hash of the URL's key, one probe per
+ * request.  A fill whose response names others than its request was
+ * keyed with is not cached; the names are learnt instead, so the next
+ * request is keyed by them.  Being in every variant's key, the names
+ * are learnt again from the pages reloaded after a restart.
+ *
+ * Accept-Encoding is left out: the proxy fetches pages unencoded and
+ * keeps its own gzip variant of them.
+ */
+#ifndef __VARY_H__
+#define __VARY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define VARY_ENTRIES  4096               /* URLs whose names are remembered */
+#define VARY_NAMES    96                 /* bytes of a URL's names, more and it is not cached */
+#define VARY_HEADERS  4096               /* bytes of a request's lines for them, likewise */
+
+typedef struct {
+	uint64_t hash;                //key hash of the URL, 0 while the entry is free
+	char names[VARY_NAMES];       //header names, lowercase and comma separated
+} vary_entry_t;
+
+typedef struct {
+	vary_entry_t *entries;        //VARY_ENTRIES of them, by hash
+} vary_t;
+
+void vary_init(vary_t *v);
+const char *vary_lookup(vary_t *v, uint64_t hash);
+void vary_learn(vary_t *v, uint64_t hash, const char *names);
+int vary_names(char *names, size_t size, const char *value);
+int vary_headers(char *out, size_t size, const char *head, const char *names);
+int vary_key(char *key, size_t size, int len, const char *names, const char *headers, size_t n);
+int vary_split(const char *key, size_t len, char *names, size_t size);
+
+#endif /* __VARY_H__ */
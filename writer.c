@@ -0,0 +1,186 @@
+/*
+ * writer.c - write-behind cache fills
+ *
+ * The relay thread fills ring slots at head + count and the writer
+ * thread empties them from head.  The writer takes every queued chunk
+ * in one pass, copies them into the staged page without holding the
+ * lock, and only then gives the slots back, so the relay never has to
+ * wait on a copy or on the store.  The relay packs short reads into the
+ * open slot and only publishes full ones, and once half the ring is in
+ * use it yields the CPU so a writer sharing the core gets to run.
+ */
+
+#include "csapp.h"
+#include "writer.h"
+#include <sched.h>
+
+/* writer_thread - stage queued chunks until the relay ends, then commit */
+static void *writer_thread(void *arg)
+{
+	writer_t *w = arg;
+	size_t first, n, i, expect;
+	int closed, abandoned;
+
+	for (;;) {
+		pthread_mutex_lock(&w->lock);
+		while (w->count == 0 && !w->closed && !w->abandoned)
+			pthread_cond_wait(&w->ready, &w->lock);
+		first = w->head;
+		n = w->count;
+		closed = w->closed;
+		abandoned = w->abandoned;
+		expect = w->expect;
+		w->expect = 0;
+		pthread_mutex_unlock(&w->lock);
+
+		if (abandoned)
+			break;
+		if (expect > 0)  //one allocation for the whole page instead of doubling as it arrives
+			store_fill_reserve(&w->fill, expect);
+		for (i = 0; i < n; i++) {
+			size_t slot = (first + i) % w->nchunks;
+			store_fill_append(&w->fill, w->chunks + slot * WRITER_CHUNK, w->lengths[slot]);
+		}
+
+		pthread_mutex_lock(&w->lock);
+		w->head = (first + n) % w->nchunks;
+		w->count -= n;
+		pthread_mutex_unlock(&w->lock);
+		if (closed && n == 0)
+			break;
+	}
+
+	if (abandoned || w->fill.failed)
+		store_fill_abort(&w->fill);
+	else
+		w->done(&w->fill, w->doneArg);
+	return NULL;
+}
+
+/*
+ * writer_start - start a writer staging at most max bytes through a ring
+ * of nchunks chunks; done is called with the staged page when the relay
+ * closes it.  Returns -1 if the thread or its ring could not be set up.
+ */
+int writer_start(writer_t *w, size_t max, size_t nchunks, writer_done_t *done, void *arg)
+{
+	memset(w, 0, sizeof(*w));
+	if (nchunks == 0)
+		return -1;
+	w->chunks = malloc(nchunks * WRITER_CHUNK);
+	w->lengths = malloc(nchunks * sizeof(size_t));
+	if (w->chunks == NULL || w->lengths == NULL) {
+		free(w->chunks);
+		free(w->lengths);
+		return -1;
+	}
+	w->nchunks = nchunks;
+	w->done = done;
+	w->doneArg = arg;
+	store_fill_begin(&w->fill, max);
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->ready, NULL);
+	if (pthread_create(&w->tid, NULL, writer_thread, w) != 0) {
+		free(w->chunks);
+		free(w->lengths);
+		return -1;
+	}
+	return 0;
+}
+
+/* publish - hand the open chunk to the writer, -1 if the ring is full */
+static int publish(writer_t *w)
+{
+	int rc = 0, behind;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->abandoned || w->count == w->nchunks) {
+		w->abandoned = 1;
+		rc = -1;
+	}
+	else {
+		w->count++;
+	}
+	behind = w->count > w->nchunks / 2;
+	pthread_cond_signal(&w->ready);
+	pthread_mutex_unlock(&w->lock);
+	w->openLen = 0;
+	if (behind)  //let the writer run if it shares our CPU, without waiting for it
+		sched_yield();
+	return rc;
+}
+
+/*
+ * writer_push - queue a copy of n bytes, abandoning the fill if the ring
+ * is full.  Short reads are packed into one chunk, which is handed over
+ * once it is full.
+ */
+void writer_push(writer_t *w, const void *data, size_t n)
+{
+	size_t len;
+
+	while (n > 0 && !w->abandoned) {
+		if (w->openLen == 0) {  //claim the next free slot
+			pthread_mutex_lock(&w->lock);
+			if (w->count == w->nchunks)
+				w->abandoned = 1;
+			w->open = (w->head + w->count) % w->nchunks;
+			pthread_mutex_unlock(&w->lock);
+			if (w->abandoned)
+				break;
+		}
+		//the writer does not touch slots past head + count, so copy unlocked
+		len = WRITER_CHUNK - w->openLen;
+		if (len > n)
+			len = n;
+		memcpy(w->chunks + w->open * WRITER_CHUNK + w->openLen, data, len);
+		w->openLen += len;
+		w->lengths[w->open] = w->openLen;
+		data = (const char *)data + len;
+		n -= len;
+		if (w->openLen == WRITER_CHUNK && publish(w) < 0)
+			break;
+	}
+}
+
+/*
+ * writer_expect - announce that the page will take n bytes, once its
+ * length is known from the response head; the writer sizes its staging
+ * buffer for it in one go.
+ */
+void writer_expect(writer_t *w, size_t n)
+{
+	pthread_mutex_lock(&w->lock);
+	w->expect = n;
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* writer_close - no more chunks are coming, the writer commits what it has */
+void writer_close(writer_t *w)
+{
+	if (w->openLen > 0 && !w->abandoned)
+		publish(w);
+	pthread_mutex_lock(&w->lock);
+	w->closed = 1;
+	pthread_cond_signal(&w->ready);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* writer_abandon - drop the page, e.g. because the relay failed part way */
+void writer_abandon(writer_t *w)
+{
+	pthread_mutex_lock(&w->lock);
+	w->abandoned = 1;
+	pthread_cond_signal(&w->ready);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* writer_wait - wait for the writer to finish and free its ring */
+void writer_wait(writer_t *w)
+{
+	pthread_join(w->tid, NULL);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->ready);
+	free(w->chunks);
+	free(w->lengths);
+}
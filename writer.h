@@ -0,0 +1,46 @@
+/*
+ * writer.h - write-behind cache fills
+ *
+ * A child relaying a miss hands every chunk it sends to the client to a
+ * writer thread through a fixed ring of chunk buffers.  The thread
+ * stages the chunks and commits the page to the store once the relay
+ * ends, after the client connection is closed.  The relay never waits
+ * for the writer: if the ring is full the fill is abandoned instead.
+ */
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+#include <stddef.h>
+#include <pthread.h>
+#include "store.h"
+
+#define WRITER_CHUNK 8192                 /* largest chunk, one relay read */
+
+/* Called on the writer thread once the whole page is staged */
+typedef void writer_done_t(store_fill_t *fill, void *arg);
+
+typedef struct {
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;                //chunks queued or the relay ended
+	char *chunks;                        //nchunks buffers of WRITER_CHUNK bytes
+	size_t *lengths;
+	size_t nchunks;
+	size_t head, count;                  //oldest queued chunk and number queued
+	size_t open, openLen;                //slot the relay is packing and bytes in it
+	int closed;                          //relay finished, no more chunks
+	int abandoned;                       //ring overflowed, drop the page
+	size_t expect;                       //page length announced ahead, for the writer to reserve
+	store_fill_t fill;
+	writer_done_t *done;
+	void *doneArg;
+} writer_t;
+
+int writer_start(writer_t *w, size_t max, size_t nchunks, writer_done_t *done, void *arg);
+void writer_push(writer_t *w, const void *data, size_t n);
+void writer_expect(writer_t *w, size_t n);
+void writer_close(writer_t *w);
+void writer_abandon(writer_t *w);
+void writer_wait(writer_t *w);
+
+#endif /* __WRITER_H__ */